@@ -32,8 +32,8 @@ struct BRDFImportance : public Algorithm {
                             const float pdf = uniform_hemisphere_pdf();
                             Ray secondary_ray = Ray(hit.P, w_i);
                             const SurfaceHit secondary_hit = context.scene.intersect(secondary_ray);
-                            if (secondary_hit.valid && secondary_hit.is_light() && dot(secondary_hit.N, -w_i) > 0)
-                                L += secondary_hit.Le() * hit.f(-ray.dir, w_i) * fmaxf(0.f, dot(hit.N, w_i)) / pdf;
+                            if (secondary_hit.valid && secondary_hit.is_light() && dot(secondary_hit.N(), -w_i) > 0)
+                                L += secondary_hit.Le() * hit.f(-ray.dir, w_i) * fmaxf(0.f, dot(hit.N(), w_i)) / pdf;
                         }
                         L /= float(N);
                     } else {
@@ -42,8 +42,8 @@ struct BRDFImportance : public Algorithm {
                             const auto [brdf, w_i, pdf] = hit.sample(-ray.dir, RNG::uniform<vec2>());
                             Ray secondary_ray = Ray(hit.P, w_i);
                             const SurfaceHit secondary_hit = context.scene.intersect(secondary_ray);
-                            if (secondary_hit.valid && secondary_hit.is_light() && dot(secondary_hit.N, -w_i) > 0)
-                                L += secondary_hit.Le() * brdf * fmaxf(0.f, dot(hit.N, secondary_ray.dir)) / pdf;
+                            if (secondary_hit.valid && secondary_hit.is_light() && dot(secondary_hit.N(), -w_i) > 0)
+                                L += secondary_hit.Le() * brdf * fmaxf(0.f, dot(hit.N(), secondary_ray.dir)) / pdf;
                         }
                         L /= float(N);
                     }
@@ -6,6 +6,9 @@
 #include "gi/ray.h"
 #include "gi/hit.h"
 
+#include <vector>
+#include <algorithm>
+
 using namespace std;
 using namespace glm;
 
@@ -13,7 +16,10 @@ struct DirectIllumination : public Algorithm {
     inline static const std::string name = "DirectIllumination";
 
     void sample_pixel(Context& context, uint32_t x, uint32_t y, uint32_t samples) {
+        const uint32_t pixel = y * context.fbo.width() + x;
         for (uint32_t i = 0; i < samples; ++i) {
+            const uint32_t sample = context.fbo.num_samples(x, y);
+            RNG::seed(pixel, sample);
             vec3 L(0);
             // setup a view ray
             Ray ray = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
@@ -24,11 +30,12 @@ struct DirectIllumination : public Algorithm {
                 if (hit.is_light()) // direct light source hit
                     L = hit.Le();
                 else { // surface hit -> shade
-                    const auto [light, pdf_light_source] = context.scene.sample_light_source(RNG::uniform<float>());
-                    auto [Li, shadow_ray, pdf_light_sample] = light->sample_Li(hit.P, RNG::uniform<vec2>());
+                    RNG::seed(pixel, sample, RNG_CAMERA_DIMS);
+                    const auto [light, primID, pdf_light_source] = context.scene.sample_light_source(hit.P, hit.N(), RNG::uniform<float>());
+                    auto [Li, shadow_ray, pdf_light_sample] = light->sample_Li(hit.P, primID, RNG::uniform<vec2>());
                     const float pdf = pdf_light_source * pdf_light_sample;
                     if (pdf > 0.f && !context.scene.occluded(shadow_ray))
-                        L = Li * hit.f(-ray.dir, shadow_ray.dir) * fmaxf(0.f, dot(hit.N, shadow_ray.dir)) / pdf;
+                        L = Li * hit.f(-ray.dir, shadow_ray.dir) * fmaxf(0.f, dot(hit.N(), shadow_ray.dir)) / pdf;
                 }
             } else // ray esacped the scene
                 L = context.scene.Le(ray);
@@ -36,6 +43,73 @@ struct DirectIllumination : public Algorithm {
             context.fbo.add_sample(x, y, L);
         }
     }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+        trace_tile(context, x0, y0, x1, y1, [samples](uint32_t, uint32_t) { return samples; });
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Buffer<uint32_t>& spp) {
+        trace_tile(context, x0, y0, x1, y1, [&spp](uint32_t x, uint32_t y) { return spp(x, y); });
+    }
+
+    /**
+     * @brief Trace count(x, y) samples for each pixel of a tile, one sample per pixel with samples left in each pass
+     */
+    template <typename Count> void trace_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Count& count) {
+        const uint32_t w = x1 - x0, N = w * (y1 - y0);
+        thread_local std::vector<Ray> rays, shadow_rays;
+        thread_local std::vector<vec3> L, Ld;
+        thread_local std::vector<uint32_t> sample, pixels;
+        uint32_t passes = 0;
+        for (uint32_t i = 0; i < N; ++i)
+            passes = std::max(passes, count(x0 + i % w, y0 + i / w));
+        for (uint32_t s = 0; s < passes; ++s) {
+            // gather the tile pixels with samples left
+            pixels.clear();
+            for (uint32_t i = 0; i < N; ++i)
+                if (count(x0 + i % w, y0 + i / w) > s)
+                    pixels.push_back(i);
+            const uint32_t M = pixels.size();
+            rays.resize(M);
+            shadow_rays.resize(M);
+            L.resize(M);
+            Ld.resize(M);
+            sample.resize(M);
+            // setup coherent view rays and intersect them in packets
+            for (uint32_t k = 0; k < M; ++k) {
+                const uint32_t x = x0 + pixels[k] % w, y = y0 + pixels[k] / w;
+                sample[k] = context.fbo.num_samples(x, y);
+                RNG::seed(y * context.fbo.width() + x, sample[k]);
+                rays[k] = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
+            }
+            context.scene.intersect(rays.data(), M);
+            // shade hits and setup shadow rays
+            for (uint32_t k = 0; k < M; ++k) {
+                L[k] = Ld[k] = vec3(0);
+                shadow_rays[k] = Ray();
+                const SurfaceHit hit = context.scene.surface_hit(rays[k]);
+                if (hit.valid) {
+                    if (hit.is_light()) // direct light source hit
+                        L[k] = hit.Le();
+                    else { // surface hit -> sample light, defer visibility test
+                        RNG::seed((y0 + pixels[k] / w) * context.fbo.width() + x0 + pixels[k] % w, sample[k], RNG_CAMERA_DIMS);
+                        const auto [light, primID, pdf_light_source] = context.scene.sample_light_source(hit.P, hit.N(), RNG::uniform<float>());
+                        auto [Li, shadow_ray, pdf_light_sample] = light->sample_Li(hit.P, primID, RNG::uniform<vec2>());
+                        const float pdf = pdf_light_source * pdf_light_sample;
+                        if (pdf > 0.f) {
+                            Ld[k] = Li * hit.f(-rays[k].dir, shadow_ray.dir) * fmaxf(0.f, dot(hit.N(), shadow_ray.dir)) / pdf;
+                            shadow_rays[k] = shadow_ray;
+                        }
+                    }
+                } else // ray esacped the scene
+                    L[k] = context.scene.Le(rays[k]);
+            }
+            // trace shadow rays in packets and add results to framebuffer
+            context.scene.occluded(shadow_rays.data(), M);
+            for (uint32_t k = 0; k < M; ++k)
+                context.fbo.add_sample(x0 + pixels[k] % w, y0 + pixels[k] / w, shadow_rays[k].tfar < 0.f ? L[k] : L[k] + Ld[k]);
+        }
+    }
 };
 
 static AlgorithmRegistrar<DirectIllumination> registrar;
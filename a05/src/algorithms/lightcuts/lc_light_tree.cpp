@@ -245,7 +245,7 @@ glm::vec3 calc_estimate(const LightTree::Node *light, const PathVertex &vertex,
         return glm::vec3(0.f);
     }
 
-    const float cos_theta_vertex = fmaxf(0.f, dot(vertex.hit.N, l));
+    const float cos_theta_vertex = fmaxf(0.f, dot(vertex.hit.N(), l));
     const float cos_theta_light  = fmaxf(0.f, glm::dot(light->light->norm, -l));
     const float G                = cos_theta_vertex * cos_theta_light / (r * r);
 
@@ -288,12 +288,12 @@ glm::vec3 bound_error(const LightTree::Node *light, const PathVertex &vertex) {
         return glm::vec3(std::numeric_limits<float>::max());
     }
 
-    const float cos_theta_vertex = fmaxf(0.f, bound_cos_theta(light->aabb.align(vertex.hit.P, vertex.hit.N)));
+    const float cos_theta_vertex = fmaxf(0.f, bound_cos_theta(light->aabb.align(vertex.hit.P, vertex.hit.N())));
     const float cos_theta_light  = 1.f; // TODO
     const float G                = cos_theta_vertex * cos_theta_light / dist_sqr;
 
     // assume max brdf at normal
-    const glm::vec3 brdf_cam = vertex.escaped ? glm::vec3(1) : vertex.hit.f(vertex.w_o, vertex.hit.N);
+    const glm::vec3 brdf_cam = vertex.escaped ? glm::vec3(1) : vertex.hit.f(vertex.w_o, vertex.hit.N());
 
     return light->intensity * brdf_cam * G;
 }
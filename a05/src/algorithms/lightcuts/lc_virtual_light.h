@@ -5,7 +5,7 @@
 
 struct VirtualLight {
     explicit VirtualLight(const PathVertex &v)
-        : pos(v.hit.P), norm(v.hit.N), color(v.throughput * brdf_average(v)) {
+        : pos(v.hit.P), norm(v.hit.N()), color(v.throughput * brdf_average(v)) {
         assert(v.hit.valid && "virtual lights can only be constructed from valid hits");
         assert(!v.infinite && "directional lights not implemented yet");
     }
@@ -23,7 +23,7 @@ struct VirtualLight {
 
         glm::vec3 rho{};
         for (uint32_t j = 0; j < N; j++) {
-            const auto w_i  = align(v.hit.N, uniform_sample_hemisphere(sampler.next()));
+            const auto w_i  = align(v.hit.N(), uniform_sample_hemisphere(sampler.next()));
             rho            += v.hit.f(v.w_o, w_i);
         }
         return rho / static_cast<float>(N);
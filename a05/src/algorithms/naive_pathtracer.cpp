@@ -22,7 +22,7 @@ struct NaivePathtracer : public Algorithm {
                 const SurfaceHit& hit = context.scene.intersect(ray);
                 // handle direct frontal light source hits
                 if (hit.is_light()) {
-                    if (hit.valid && dot(hit.Ng, -ray.dir) <= 0.f) break; // no double sided light sources
+                    if (hit.valid && dot(hit.Ng(), -ray.dir) <= 0.f) break; // no double sided light sources
                     L += throughput * (hit.valid ? hit.Le() : hit.light->Le(ray));
                     break;
                 }
@@ -35,7 +35,7 @@ struct NaivePathtracer : public Algorithm {
                 // bounce main ray
                 const auto [brdf, w_i, pdf] = hit.sample(-ray.dir, RNG::uniform<vec2>());
                 if (pdf <= 0.f || luma(brdf) <= 0.f) break;
-                throughput *= brdf * fabsf(dot(hit.N, w_i)) / pdf;
+                throughput *= brdf * fabsf(dot(hit.N(), w_i)) / pdf;
 
                 // russian roulette based on throughput
                 /*
@@ -8,67 +8,179 @@
 #include "gi/timer.h"
 #include "gi/color.h"
 
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
 using namespace std;
 using namespace glm;
 
 struct Pathtracer : public Algorithm {
     inline static const std::string name = "Pathtracer";
 
+    void init(Context& context) {
+        num_rays = 0;
+        start = std::chrono::system_clock::now();
+    }
+
     void sample_pixel(Context& context, uint32_t x, uint32_t y, uint32_t samples) {
+        size_t rays = 0;
+        const uint32_t pixel = y * context.fbo.width() + x;
         for (uint32_t i = 0; i < samples; ++i) {
+            const uint32_t sample = context.fbo.num_samples(x, y);
+            RNG::seed(pixel, sample);
             Ray ray = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
-            vec3 L(0), throughput(1);
-            float mis_brdf_pdf = 0.f;
-            bool specular_bounce = true; // initially set to true to disable MIS on view ray light source hits
-            for (uint32_t d = 0; d < context.MAX_CAM_PATH_LENGTH; ++d) {
-                const SurfaceHit& hit = context.scene.intersect(ray);
-                // handle direct frontal light source hits
-                if (hit.is_light()) {
-                    if (hit.valid && dot(hit.Ng, -ray.dir) <= 0.f) break; // no double sided light sources
-                    const float mis_weight = specular_bounce ? 1.f : power_heuristic(mis_brdf_pdf, hit.light->pdf_Li(hit, ray));
-                    L += throughput * mis_weight * (hit.valid ? hit.Le() : hit.light->Le(ray));
-                    break;
-                }
-                // handle escaped ray
-                if (!hit.valid) break;
-
-                // shade using next event estimation
-                const vec3& w_o = -ray.dir;
-                if (!hit.is_type(BRDF_SPECULAR)) {
-                    const auto [light, light_source_pdf] = context.scene.sample_light_source(RNG::uniform<float>());
-                    auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit.P, RNG::uniform<vec2>());
-                    const float light_pdf = light_source_pdf * light_sample_pdf;
-                    const vec3& w_i = shadow_ray.dir;
-                    const float cos_theta = dot(hit.N, w_i);
-                    if (cos_theta > 0.f && light_pdf > 0.f && !context.scene.occluded(shadow_ray)) {
+            Ray shadow_ray;
+            vec3 Ld(0);
+            vec3 L = trace(context, pixel, sample, ray, false, shadow_ray, Ld, rays);
+            if (shadow_ray.tfar > 0.f && !context.scene.occluded(shadow_ray))
+                L += Ld;
+            context.fbo.add_sample(x, y, L);
+        }
+        num_rays += rays;
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+        trace_tile(context, x0, y0, x1, y1, [samples](uint32_t, uint32_t) { return samples; });
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Buffer<uint32_t>& spp) {
+        trace_tile(context, x0, y0, x1, y1, [&spp](uint32_t x, uint32_t y) { return spp(x, y); });
+    }
+
+    /**
+     * @brief Trace count(x, y) samples for each pixel of a tile, one sample per pixel with samples left in each pass
+     */
+    template <typename Count> void trace_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Count& count) {
+        const uint32_t w = x1 - x0, N = w * (y1 - y0);
+        thread_local std::vector<Ray> rays, shadow_rays;
+        thread_local std::vector<vec3> L, Ld;
+        thread_local std::vector<uint32_t> sample, pixels;
+        size_t traced = 0;
+        uint32_t passes = 0;
+        for (uint32_t i = 0; i < N; ++i)
+            passes = std::max(passes, count(x0 + i % w, y0 + i / w));
+        for (uint32_t s = 0; s < passes; ++s) {
+            // gather the tile pixels with samples left
+            pixels.clear();
+            for (uint32_t i = 0; i < N; ++i)
+                if (count(x0 + i % w, y0 + i / w) > s)
+                    pixels.push_back(i);
+            const uint32_t M = pixels.size();
+            rays.resize(M);
+            shadow_rays.resize(M);
+            L.resize(M);
+            Ld.resize(M);
+            sample.resize(M);
+            // setup coherent view rays and intersect them in packets
+            for (uint32_t k = 0; k < M; ++k) {
+                const uint32_t x = x0 + pixels[k] % w, y = y0 + pixels[k] / w;
+                sample[k] = context.fbo.num_samples(x, y);
+                RNG::seed(y * context.fbo.width() + x, sample[k]);
+                rays[k] = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
+            }
+            context.scene.intersect(rays.data(), M);
+            // trace the paths from their first hits, deferring the visibility test of the first shadow rays
+            for (uint32_t k = 0; k < M; ++k) {
+                shadow_rays[k] = Ray();
+                Ld[k] = vec3(0);
+                L[k] = trace(context, (y0 + pixels[k] / w) * context.fbo.width() + x0 + pixels[k] % w, sample[k], rays[k], true, shadow_rays[k], Ld[k], traced);
+            }
+            // trace first shadow rays in packets and add results to framebuffer
+            context.scene.occluded(shadow_rays.data(), M);
+            for (uint32_t k = 0; k < M; ++k)
+                context.fbo.add_sample(x0 + pixels[k] % w, y0 + pixels[k] / w, shadow_rays[k].tfar < 0.f ? L[k] : L[k] + Ld[k]);
+        }
+        num_rays += traced;
+    }
+
+    /**
+     * @brief Trace a camera path and return its contribution, except for the next event estimation at the first vertex:
+     * its shadow ray is not tested but returned along with its unoccluded contribution, so tiles can trace them in packets.
+     *
+     * @param ray Camera ray
+     * @param intersected Was the camera ray already intersected with the scene (e.g. in a packet)?
+     * @param shadow_ray_0 First shadow ray, left untouched if there is none
+     * @param Ld Contribution of the first shadow ray if unoccluded
+     * @param rays Counter of traced rays, including shadow rays
+     */
+    vec3 trace(Context& context, uint32_t pixel, uint32_t sample, Ray ray, bool intersected, Ray& shadow_ray_0, vec3& Ld, size_t& rays) {
+        vec3 L(0), throughput(1);
+        float mis_brdf_pdf = 0.f;
+        vec3 mis_P(0), mis_N(0); // previous path vertex, for the light selection pdf
+        bool specular_bounce = true; // initially set to true to disable MIS on view ray light source hits
+        for (uint32_t d = 0; d < context.MAX_CAM_PATH_LENGTH; ++d) {
+            const SurfaceHit& hit = d == 0 && intersected ? context.scene.surface_hit(ray) : context.scene.intersect(ray);
+            rays++;
+            // handle direct frontal light source hits
+            if (hit.is_light()) {
+                if (hit.valid && dot(hit.Ng(), -ray.dir) <= 0.f) break; // no double sided light sources
+                const float mis_weight = specular_bounce ? 1.f : power_heuristic(mis_brdf_pdf, context.scene.light_source_pdf(mis_P, mis_N, hit) * hit.light->pdf_Li(hit, ray));
+                L += throughput * mis_weight * (hit.valid ? hit.Le() : hit.light->Le(ray));
+                break;
+            }
+            // handle escaped ray
+            if (!hit.valid) break;
+            RNG::seed(pixel, sample, RNG_CAMERA_DIMS + d * RNG_BOUNCE_DIMS);
+
+            // shade using next event estimation (the first shadow ray is tested by the caller)
+            const vec3& w_o = -ray.dir;
+            if (!hit.is_type(BRDF_SPECULAR)) {
+                const auto [light, primID, light_source_pdf] = context.scene.sample_light_source(hit.P, hit.N(), RNG::uniform<float>());
+                auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit.P, primID, RNG::uniform<vec2>());
+                const float light_pdf = light_source_pdf * light_sample_pdf;
+                const vec3& w_i = shadow_ray.dir;
+                const float cos_theta = dot(hit.N(), w_i);
+                if (cos_theta > 0.f && light_pdf > 0.f) {
+                    rays++;
+                    if (d == 0 || !context.scene.occluded(shadow_ray)) {
                         const vec3& brdf = hit.f(w_o, w_i);
                         const float weight = power_heuristic(light_pdf, hit.pdf(w_o, w_i));
-                        L += throughput * weight * Li * brdf * cos_theta / light_pdf;
+                        if (d == 0) {
+                            shadow_ray_0 = shadow_ray;
+                            Ld = throughput * weight * Li * brdf * cos_theta / light_pdf;
+                        } else
+                            L += throughput * weight * Li * brdf * cos_theta / light_pdf;
                     }
                 }
+            }
 
-                // break early if max length reached
-                if (d >= context.MAX_CAM_PATH_LENGTH - 1) break;
-
-                // bounce main ray
-                const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, RNG::uniform<vec2>());
-                if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) break;
-                throughput *= brdf * fabsf(dot(hit.N, w_i)) / brdf_pdf;
-                mis_brdf_pdf = brdf_pdf;
+            // break early if max length reached
+            if (d >= context.MAX_CAM_PATH_LENGTH - 1) break;
 
-                // russian roulette based on throughput
-                if (d > context.RR_MIN_PATH_LENGTH && luma(throughput) < context.RR_THRESHOLD) {
-                    const float prob = fmaxf(.05f, 1 - luma(throughput));
-                    if (RNG::uniform<float>() < prob) break;
-                    throughput /= 1 - prob;
-                }
+            // bounce main ray
+            const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, RNG::uniform<vec2>());
+            if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) break;
+            throughput *= brdf * fabsf(dot(hit.N(), w_i)) / brdf_pdf;
+            mis_brdf_pdf = brdf_pdf;
+            mis_P = hit.P;
+            mis_N = hit.N();
 
-                ray = Ray(hit.P, w_i);
-                specular_bounce = hit.is_type(BRDF_SPECULAR);
+            // russian roulette based on throughput
+            if (d > context.RR_MIN_PATH_LENGTH && luma(throughput) < context.RR_THRESHOLD) {
+                const float prob = fmaxf(.05f, 1 - luma(throughput));
+                if (RNG::uniform<float>() < prob) break;
+                throughput /= 1 - prob;
             }
-            context.fbo.add_sample(x, y, L);
+
+            const Ray parent = ray;
+            ray = Ray(hit.P, w_i);
+            specular_bounce = hit.is_type(BRDF_SPECULAR);
+            if (specular_bounce) ray.continue_cone(parent); // keep filtering textures seen via mirrors and glass
         }
+        return L;
     }
+
+    void post_render() {
+        const double s = std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+        printf("%s: %zu rays, %.2f Mrays/s\n", name.c_str(), size_t(num_rays), num_rays / (1e6 * s));
+    }
+
+    size_t rays_traced() const { return num_rays; }
+
+    // data
+    std::atomic<size_t> num_rays = 0;                       ///< Rays traced since init(), including shadow rays
+    std::chrono::time_point<std::chrono::system_clock> start; ///< Time of init()
 };
 
 static AlgorithmRegistrar<Pathtracer> registrar;
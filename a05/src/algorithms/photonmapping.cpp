@@ -61,7 +61,7 @@ vec3 direct_illum(Context& context, const SurfaceHit& hit, const vec3& w_o) {
     auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit.P, RNG::uniform<vec2>());
     const float pdf = light_source_pdf * light_sample_pdf;
     if (pdf > 0.f && !context.scene.occluded(shadow_ray)) {
-        const float cosTheta = fmaxf(0.f, dot(hit.N, shadow_ray.dir));
+        const float cosTheta = fmaxf(0.f, dot(hit.N(), shadow_ray.dir));
         L += Li * hit.f(w_o, shadow_ray.dir) * cosTheta / pdf;
     }
     return L;
@@ -77,7 +77,7 @@ vec3 radiance_estimate(Context& context, const SurfaceHit& hit, const vec3& w_o,
     // compute cone filtered radiance estimate
     for (size_t i = 0; i < indices.size(); ++i) {
         const PathVertex& photon = photon_map.photons[indices[i]];
-        if (dot(photon.w_o, hit.N) > 0) {
+        if (dot(photon.w_o, hit.N()) > 0) {
             const float w = fmaxf(0.f, 1 - sqrtf(dist_sqr[i]) / (k * radius));
             L += w * photon.throughput * hit.f(w_o, photon.w_o);
         }
@@ -96,7 +96,7 @@ vec3 final_gather(Context& context, const SurfaceHit& hit, const vec3& w_o, cons
     Ray ray = Ray(hit.P, w_i);
     const SurfaceHit& secondary = context.scene.intersect(ray);
     if (secondary.valid) {
-        const float cosTheta = fmaxf(0.f, dot(hit.N, w_i));
+        const float cosTheta = fmaxf(0.f, dot(hit.N(), w_i));
         const vec3 Li = radiance_estimate(context, secondary, -w_i, photon_map, 25);
         L += Li * brdf * cosTheta / pdf;
     }
@@ -28,7 +28,7 @@ struct SimpleRenderer : public Algorithm {
                     auto [Li, shadow_ray, pdf_light_sample] = light->sample_Li(hit.P, RNG::uniform<vec2>());
                     const float pdf = pdf_light_source * pdf_light_sample;
                     if (pdf > 0.f && !context.scene.occluded(shadow_ray))
-                        L = Li * hit.albedo() * fmaxf(0.f, glm::dot(hit.N, shadow_ray.dir)) / pdf;
+                        L = Li * hit.albedo() * fmaxf(0.f, glm::dot(hit.N(), shadow_ray.dir)) / pdf;
                 }
             } else // ray esacped the scene
                 L = context.scene.Le(ray);
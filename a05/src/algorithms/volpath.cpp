@@ -8,6 +8,9 @@
 #include "gi/timer.h"
 #include "gi/color.h"
 
+#include <vector>
+#include <algorithm>
+
 using namespace std;
 using namespace glm;
 
@@ -17,60 +20,179 @@ struct VolumetricPathtracer : public Algorithm {
     void sample_pixel(Context& context, uint32_t x, uint32_t y, uint32_t samples) {
         for (uint32_t i = 0; i < samples; ++i) {
             Ray ray = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
-            vec3 L(0), throughput(1);
-            for (uint32_t d = 0; d < context.MAX_CAM_PATH_LENGTH; ++d) {
-                const SurfaceHit& hit = context.scene.intersect(ray);
-                const VolumeHit& hit_vol = context.scene.intersect_volume(ray);
-                if (hit_vol.valid) {
+            Ray shadow_ray;
+            vec3 Ld(0);
+            vec3 L = trace(context, ray, false, shadow_ray, Ld);
+            if (shadow_ray.tfar > 0.f)
+                L += context.scene.visibility(shadow_ray) * Ld;
+            context.fbo.add_sample(x, y, L);
+        }
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+        trace_tile(context, x0, y0, x1, y1, [samples](uint32_t, uint32_t) { return samples; });
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Buffer<uint32_t>& spp) {
+        trace_tile(context, x0, y0, x1, y1, [&spp](uint32_t x, uint32_t y) { return spp(x, y); });
+    }
+
+    /**
+     * @brief Trace count(x, y) samples for each pixel of a tile, one sample per pixel with samples left in each pass
+     */
+    template <typename Count> void trace_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Count& count) {
+        const uint32_t w = x1 - x0, N = w * (y1 - y0);
+        thread_local std::vector<Ray> rays, shadow_rays;
+        thread_local std::vector<vec3> L, Ld;
+        thread_local std::vector<uint32_t> pixels;
+        uint32_t passes = 0;
+        for (uint32_t i = 0; i < N; ++i)
+            passes = std::max(passes, count(x0 + i % w, y0 + i / w));
+        for (uint32_t s = 0; s < passes; ++s) {
+            // gather the tile pixels with samples left
+            pixels.clear();
+            for (uint32_t i = 0; i < N; ++i)
+                if (count(x0 + i % w, y0 + i / w) > s)
+                    pixels.push_back(i);
+            const uint32_t M = pixels.size();
+            rays.resize(M);
+            shadow_rays.resize(M);
+            L.resize(M);
+            Ld.resize(M);
+            // setup coherent view rays and intersect them with the surfaces in packets
+            for (uint32_t k = 0; k < M; ++k) {
+                const uint32_t x = x0 + pixels[k] % w, y = y0 + pixels[k] / w;
+                RNG::seed(y * context.fbo.width() + x, context.fbo.num_samples(x, y));
+                rays[k] = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
+            }
+            context.scene.intersect(rays.data(), M);
+            // trace the paths from their first surface hits, deferring the visibility test of the first shadow rays
+            for (uint32_t k = 0; k < M; ++k) {
+                const uint32_t x = x0 + pixels[k] % w, y = y0 + pixels[k] / w;
+                RNG::seed(y * context.fbo.width() + x, context.fbo.num_samples(x, y), RNG_CAMERA_DIMS);
+                shadow_rays[k] = Ray();
+                Ld[k] = vec3(0);
+                L[k] = trace(context, rays[k], true, shadow_rays[k], Ld[k]);
+            }
+            // test first shadow rays for opaque occlusion in packets, then only the unoccluded ones for volumetric transmittance
+            context.scene.occluded(shadow_rays.data(), M);
+            for (uint32_t k = 0; k < M; ++k) {
+                if (shadow_rays[k].tfar > 0.f)
+                    L[k] += context.scene.transmittance(shadow_rays[k]) * Ld[k];
+                context.fbo.add_sample(x0 + pixels[k] % w, y0 + pixels[k] / w, L[k]);
+            }
+        }
+    }
 
-                    // TODO: ASSIGNMENT5
-                    // handle volume intersections
-                    // - add weighting by albedo, if not accounted for in the intersection routines
-                    // - shade volume hit using next event estimation
-                    // - scatter ray according to the phase function
+    /**
+     * @brief Trace a camera path and return its contribution, except for the next event estimation at the first vertex:
+     * its shadow ray is not tested but returned along with its unshadowed contribution, so tiles can trace them in packets.
+     *
+     * @param ray Camera ray
+     * @param intersected Was the camera ray already intersected with the surfaces of the scene (e.g. in a packet)?
+     * @param shadow_ray_0 First shadow ray, left untouched if there is none
+     * @param Ld Contribution of the first shadow ray if unoccluded (scale by its visibility)
+     */
+    vec3 trace(Context& context, Ray ray, bool intersected, Ray& shadow_ray_0, vec3& Ld) {
+        const Scene& scene = context.scene;
+        vec3 L(0), throughput(1);
+        float mis_pdf = 0.f;
+        vec3 mis_P(0), mis_N(0); // previous path vertex, for the light selection pdf
+        bool specular_bounce = true; // initially set to true to disable MIS on view ray light source hits
+        for (uint32_t d = 0; d < context.MAX_CAM_PATH_LENGTH; ++d) {
+            const SurfaceHit& hit = d == 0 && intersected ? scene.surface_hit(ray) : scene.intersect(ray);
+            const VolumeHit& hit_vol = scene.intersect_volume(ray);
+            if (hit_vol.valid) {
+                const Volume& volume = *scene.volume;
+                // volume emission: next event estimation covers the segments after diffuse vertices, collisions all others
+                // (absorbed fraction of the collision estimator: sigma_a / sigma_t = 1 - albedo)
+                if (specular_bounce)
+                    L += throughput * (1.f - volume.albedo()) * volume.Le(hit_vol.P);
+                // scattering instead of absorption at the collision
+                throughput *= volume.albedo();
 
-                } else {
-                    // handle direct light source hits
-                    if (hit.is_light()) {
-                        if (hit.valid && dot(hit.Ng, -ray.dir) <= 0.f) break; // no double sided light sources
-                        L += throughput * (hit.valid ? hit.Le() : hit.light->Le(ray));
-                        break;
+                // shade volume hit using next event estimation
+                const vec3& w_o = -ray.dir;
+                const auto [light, primID, light_source_pdf] = scene.sample_light_source(hit_vol.P, vec3(0), RNG::uniform<float>());
+                auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit_vol.P, primID, RNG::uniform<vec2>());
+                const float light_pdf = light_source_pdf * light_sample_pdf;
+                if (light_pdf > 0.f) {
+                    const vec3 w_i = shadow_ray.dir;
+                    const float Tr = d == 0 ? 1.f : scene.visibility(shadow_ray); // the first shadow ray is tested by the caller
+                    if (Tr > 0.f) {
+                        const float weight = light == scene.volume_light ? 1.f : power_heuristic(light_pdf, hit_vol.pdf(w_o, w_i));
+                        if (d == 0) {
+                            shadow_ray_0 = shadow_ray;
+                            Ld = throughput * weight * Li * hit_vol.f(w_o, w_i) / light_pdf;
+                        } else
+                            L += throughput * weight * Tr * Li * hit_vol.f(w_o, w_i) / light_pdf;
                     }
-                    // handle escaped ray
-                    if (!hit.valid) break;
+                }
+
+                // scatter ray according to the phase function
+                const auto [phase, w_i, phase_pdf] = hit_vol.sample(w_o, RNG::uniform<vec2>());
+                if (phase_pdf <= 0.f) break;
+                throughput *= phase / phase_pdf;
+                mis_pdf = phase_pdf;
+                mis_P = hit_vol.P;
+                mis_N = vec3(0);
+                ray = Ray(hit_vol.P, w_i);
+                specular_bounce = false;
+            } else {
+                // handle direct light source hits
+                if (hit.is_light()) {
+                    if (hit.valid && dot(hit.Ng(), -ray.dir) <= 0.f) break; // no double sided light sources
+                    const float mis_weight = specular_bounce ? 1.f : power_heuristic(mis_pdf, scene.light_source_pdf(mis_P, mis_N, hit) * hit.light->pdf_Li(hit, ray));
+                    L += throughput * mis_weight * (hit.valid ? hit.Le() : hit.light->Le(ray));
+                    break;
+                }
+                // handle escaped ray
+                if (!hit.valid) break;
 
-                    // shade surface hit using next event estimation
-                    const vec3& w_o = -ray.dir;
-                    if (!hit.is_type(BRDF_SPECULAR)) {
-                        const auto [light, light_source_pdf] = context.scene.sample_light_source(RNG::uniform<float>());
-                        auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit.P, RNG::uniform<vec2>());
-                        const float light_pdf = light_source_pdf * light_sample_pdf;
-                        const vec3& w_i = shadow_ray.dir;
-                        const float cos_theta = dot(hit.N, w_i);
-                        if (cos_theta > 0.f && light_pdf > 0.f && !context.scene.occluded(shadow_ray)) {
+                // shade surface hit using next event estimation
+                const vec3& w_o = -ray.dir;
+                if (!hit.is_type(BRDF_SPECULAR)) {
+                    const auto [light, primID, light_source_pdf] = scene.sample_light_source(hit.P, hit.N(), RNG::uniform<float>());
+                    auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit.P, primID, RNG::uniform<vec2>());
+                    const float light_pdf = light_source_pdf * light_sample_pdf;
+                    const vec3 w_i = shadow_ray.dir;
+                    const float cos_theta = dot(hit.N(), w_i);
+                    if (cos_theta > 0.f && light_pdf > 0.f) {
+                        // account for shadowing from volumes (the first shadow ray is tested by the caller)
+                        const float Tr = d == 0 ? 1.f : scene.visibility(shadow_ray);
+                        if (Tr > 0.f) {
                             const vec3& brdf = hit.f(w_o, w_i);
-                            // TODO: ASSIGNMENT5
-                            // account for shadowing from volumes when shading surface hits
-                            L += throughput * Li * brdf * cos_theta / light_pdf;
+                            const float weight = light == scene.volume_light ? 1.f : power_heuristic(light_pdf, hit.pdf(w_o, w_i));
+                            if (d == 0) {
+                                shadow_ray_0 = shadow_ray;
+                                Ld = throughput * weight * Li * brdf * cos_theta / light_pdf;
+                            } else
+                                L += throughput * weight * Tr * Li * brdf * cos_theta / light_pdf;
                         }
                     }
-
-                    // scatter surface ray
-                    const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, RNG::uniform<vec2>());
-                    if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) break;
-                    throughput *= brdf * fabsf(dot(hit.N, w_i)) / brdf_pdf;
-                    ray = Ray(hit.P, w_i);
                 }
 
-                // russian roulette based on throughput
-                if (d > context.RR_MIN_PATH_LENGTH && luma(throughput) < context.RR_THRESHOLD) {
-                    const float prob = fmaxf(.05f, 1 - luma(throughput));
-                    if (RNG::uniform<float>() < prob) break;
-                    throughput /= 1 - prob;
-                }
+                // scatter surface ray
+                const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, RNG::uniform<vec2>());
+                if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) break;
+                throughput *= brdf * fabsf(dot(hit.N(), w_i)) / brdf_pdf;
+                mis_pdf = brdf_pdf;
+                mis_P = hit.P;
+                mis_N = hit.N();
+                const Ray parent = ray;
+                ray = Ray(hit.P, w_i);
+                specular_bounce = hit.is_type(BRDF_SPECULAR);
+                if (specular_bounce) ray.continue_cone(parent); // keep filtering textures seen via mirrors and glass
+            }
+
+            // russian roulette based on throughput
+            if (d > context.RR_MIN_PATH_LENGTH && luma(throughput) < context.RR_THRESHOLD) {
+                const float prob = fmaxf(.05f, 1 - luma(throughput));
+                if (RNG::uniform<float>() < prob) break;
+                throughput /= 1 - prob;
             }
-            context.fbo.add_sample(x, y, L);
         }
+        return L;
     }
 };
 
@@ -0,0 +1,231 @@
+#include "driver/context.h"
+#include "gi/algorithm.h"
+#include "gi/random.h"
+#include "gi/ray.h"
+#include "gi/mesh.h"
+#include "gi/material.h"
+#include "gi/light.h"
+#include "gi/timer.h"
+#include "gi/color.h"
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+/**
+ * @brief Breadth-first variant of the Pathtracer: all paths of a tile advance one bounce at a time
+ * through the stages generate, intersect, shade (sorted by material), shadow and accumulate.
+ * Rays of each stage are traced in packets, path state is kept in SoA arrays.
+ */
+struct WavefrontPathtracer : public Algorithm {
+    inline static const std::string name = "WavefrontPathtracer";
+
+    // SoA path state of a tile batch
+    struct PathState {
+        void resize(size_t N) {
+            ray.resize(N);
+            L.resize(N);
+            throughput.resize(N);
+            mis_brdf_pdf.resize(N);
+            mis_P.resize(N);
+            mis_N.resize(N);
+            sample.resize(N);
+            pixel.resize(N);
+            specular_bounce.resize(N);
+            active.reserve(N);
+            next.reserve(N);
+            sorted.reserve(N);
+            hits.reserve(N);
+            shadow_rays.reserve(N);
+            shadow_path.reserve(N);
+            shadow_L.reserve(N);
+        }
+
+        // per path
+        std::vector<Ray> ray;
+        std::vector<vec3> L;
+        std::vector<vec3> throughput;
+        std::vector<float> mis_brdf_pdf;
+        std::vector<vec3> mis_P, mis_N;                     ///< Previous path vertex, for the light selection pdf
+        std::vector<uint8_t> specular_bounce;
+        std::vector<uint32_t> sample;                       ///< Sample index of the path within its pixel
+        std::vector<uint32_t> pixel;                        ///< Tile pixel index of the path
+        // queues
+        std::vector<uint32_t> active;                       ///< Paths to extend in this bounce
+        std::vector<uint32_t> next;                         ///< Paths to extend in the next bounce
+        std::vector<std::pair<const Material*, uint32_t>> sorted; ///< Active paths sorted by material
+        std::vector<Ray> queue;                             ///< Compacted rays to intersect
+        std::vector<SurfaceHit> hits;                       ///< Hits in material order
+        std::vector<Ray> shadow_rays;                       ///< Shadow rays to test
+        std::vector<uint32_t> shadow_path;                  ///< Path index per shadow ray
+        std::vector<vec3> shadow_L;                         ///< Unoccluded contribution per shadow ray
+    };
+
+    inline static uint32_t pixel(const Context& context, uint32_t x, uint32_t y) { return y * context.fbo.width() + x; }
+
+    void init(Context& context) {
+        num_rays = 0;
+        start = std::chrono::system_clock::now();
+    }
+
+    void sample_pixel(Context& context, uint32_t x, uint32_t y, uint32_t samples) {
+        sample_tile(context, x, y, x + 1, y + 1, samples);
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+        trace_tile(context, x0, y0, x1, y1, [samples](uint32_t, uint32_t) { return samples; });
+    }
+
+    void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Buffer<uint32_t>& spp) {
+        trace_tile(context, x0, y0, x1, y1, [&spp](uint32_t x, uint32_t y) { return spp(x, y); });
+    }
+
+    /**
+     * @brief Trace count(x, y) samples for each pixel of a tile, one path per pixel with samples left in each batch
+     */
+    template <typename Count> void trace_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Count& count) {
+        const uint32_t w = x1 - x0, N = w * (y1 - y0);
+        thread_local PathState state;
+        state.resize(N);
+        size_t rays = 0;
+
+        uint32_t passes = 0;
+        for (uint32_t i = 0; i < N; ++i)
+            passes = std::max(passes, count(x0 + i % w, y0 + i / w));
+        for (uint32_t s = 0; s < passes; ++s) {
+            // generate a path for each tile pixel with samples left
+            state.active.clear();
+            uint32_t M = 0;
+            for (uint32_t j = 0; j < N; ++j) {
+                const uint32_t x = x0 + j % w, y = y0 + j / w;
+                if (count(x, y) <= s) continue;
+                const uint32_t i = M++;
+                state.pixel[i] = j;
+                state.sample[i] = context.fbo.num_samples(x, y);
+                RNG::seed(pixel(context, x, y), state.sample[i]);
+                state.ray[i] = context.cam.view_ray(x, y, context.fbo.width(), context.fbo.height(), RNG::uniform<vec2>(), RNG::uniform<vec2>());
+                state.L[i] = vec3(0);
+                state.throughput[i] = vec3(1);
+                state.mis_brdf_pdf[i] = 0.f;
+                state.specular_bounce[i] = true; // initially set to true to disable MIS on view ray light source hits
+                state.active.push_back(i);
+            }
+
+            for (uint32_t d = 0; d < context.MAX_CAM_PATH_LENGTH && !state.active.empty(); ++d) {
+                // intersect
+                state.queue.resize(state.active.size());
+                for (size_t k = 0; k < state.active.size(); ++k)
+                    state.queue[k] = state.ray[state.active[k]];
+                context.scene.intersect(state.queue.data(), state.queue.size());
+                rays += state.queue.size();
+
+                // sort by material to shade coherently, misses go first
+                state.sorted.clear();
+                for (size_t k = 0; k < state.active.size(); ++k) {
+                    const uint32_t i = state.active[k];
+                    state.ray[i] = state.queue[k];
+                    const Mesh* mesh = state.ray[i] ? context.scene.get_mesh(state.ray[i]) : nullptr;
+                    state.sorted.emplace_back(mesh ? mesh->mat.get() : nullptr, i);
+                }
+                std::sort(state.sorted.begin(), state.sorted.end());
+                state.hits.clear();
+                for (const auto& [mat, i] : state.sorted)
+                    state.hits.push_back(context.scene.surface_hit(state.ray[i]));
+
+                // shade
+                state.next.clear();
+                state.shadow_rays.clear();
+                state.shadow_path.clear();
+                state.shadow_L.clear();
+                for (size_t k = 0; k < state.sorted.size(); ++k) {
+                    const uint32_t i = state.sorted[k].second;
+                    const SurfaceHit& hit = state.hits[k];
+                    const Ray& ray = state.ray[i];
+                    vec3& throughput = state.throughput[i];
+                    // handle direct frontal light source hits
+                    if (hit.is_light()) {
+                        if (hit.valid && dot(hit.Ng(), -ray.dir) <= 0.f) continue; // no double sided light sources
+                        const float mis_weight = state.specular_bounce[i] ? 1.f : power_heuristic(state.mis_brdf_pdf[i], context.scene.light_source_pdf(state.mis_P[i], state.mis_N[i], hit) * hit.light->pdf_Li(hit, ray));
+                        state.L[i] += throughput * mis_weight * (hit.valid ? hit.Le() : hit.light->Le(ray));
+                        continue;
+                    }
+                    // handle escaped ray
+                    if (!hit.valid) continue;
+                    // same streams per path vertex as the Pathtracer
+                    RNG::seed(pixel(context, x0 + state.pixel[i] % w, y0 + state.pixel[i] / w), state.sample[i], RNG_CAMERA_DIMS + d * RNG_BOUNCE_DIMS);
+
+                    // next event estimation, visibility is resolved in the shadow stage
+                    const vec3 w_o = -ray.dir;
+                    if (!hit.is_type(BRDF_SPECULAR)) {
+                        const auto [light, primID, light_source_pdf] = context.scene.sample_light_source(hit.P, hit.N(), RNG::uniform<float>());
+                        auto [Li, shadow_ray, light_sample_pdf] = light->sample_Li(hit.P, primID, RNG::uniform<vec2>());
+                        const float light_pdf = light_source_pdf * light_sample_pdf;
+                        const vec3& w_i = shadow_ray.dir;
+                        const float cos_theta = dot(hit.N(), w_i);
+                        if (cos_theta > 0.f && light_pdf > 0.f) {
+                            const vec3& brdf = hit.f(w_o, w_i);
+                            const float weight = power_heuristic(light_pdf, hit.pdf(w_o, w_i));
+                            state.shadow_rays.push_back(shadow_ray);
+                            state.shadow_path.push_back(i);
+                            state.shadow_L.push_back(throughput * weight * Li * brdf * cos_theta / light_pdf);
+                        }
+                    }
+
+                    // terminate if max length reached
+                    if (d >= context.MAX_CAM_PATH_LENGTH - 1) continue;
+
+                    // bounce main ray
+                    const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, RNG::uniform<vec2>());
+                    if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) continue;
+                    throughput *= brdf * fabsf(dot(hit.N(), w_i)) / brdf_pdf;
+                    state.mis_brdf_pdf[i] = brdf_pdf;
+                    state.mis_P[i] = hit.P;
+                    state.mis_N[i] = hit.N();
+
+                    // russian roulette based on throughput
+                    if (d > context.RR_MIN_PATH_LENGTH && luma(throughput) < context.RR_THRESHOLD) {
+                        const float prob = fmaxf(.05f, 1 - luma(throughput));
+                        if (RNG::uniform<float>() < prob) continue;
+                        throughput /= 1 - prob;
+                    }
+
+                    const Ray parent = ray;
+                    state.ray[i] = Ray(hit.P, w_i);
+                    state.specular_bounce[i] = hit.is_type(BRDF_SPECULAR);
+                    if (state.specular_bounce[i]) state.ray[i].continue_cone(parent); // keep filtering textures seen via mirrors and glass
+                    state.next.push_back(i);
+                }
+
+                // shadow
+                context.scene.occluded(state.shadow_rays.data(), state.shadow_rays.size());
+                rays += state.shadow_rays.size();
+                for (size_t k = 0; k < state.shadow_rays.size(); ++k)
+                    if (state.shadow_rays[k].tfar >= 0.f)
+                        state.L[state.shadow_path[k]] += state.shadow_L[k];
+
+                std::swap(state.active, state.next);
+            }
+
+            // accumulate
+            for (uint32_t i = 0; i < M; ++i)
+                context.fbo.add_sample(x0 + state.pixel[i] % w, y0 + state.pixel[i] / w, state.L[i]);
+        }
+        num_rays += rays;
+    }
+
+    void post_render() {
+        const double s = std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+        printf("%s: %zu rays, %.2f Mrays/s\n", name.c_str(), size_t(num_rays), num_rays / (1e6 * s));
+    }
+
+    size_t rays_traced() const { return num_rays; }
+
+    // data
+    std::atomic<size_t> num_rays = 0;                       ///< Rays traced since init(), including shadow rays
+    std::chrono::time_point<std::chrono::system_clock> start; ///< Time of init()
+};
+
+static AlgorithmRegistrar<WavefrontPathtracer> registrar;
@@ -382,7 +382,21 @@ void Context::render_join() {
 void Context::run() {
     if (!window) {
         // no GL context, render offline in main thread
-        render(*this);
+        if (!scene.volume || scene.volume->frames.empty()) {
+            render(*this);
+            return;
+        }
+        // volume sequence: render all frames, the next frame is loaded in the background meanwhile
+        for (uint32_t i = 0; i < scene.volume->frames.size(); ++i) {
+            scene.volume->set_frame(i);
+            scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+            fbo.clear();
+            render(*this);
+            char filename[32];
+            snprintf(filename, sizeof(filename), "output_%04u.png", i);
+            std::error_code ec;
+            std::filesystem::rename("output.png", filename, ec);
+        }
         return;
     }
 
@@ -442,6 +456,11 @@ void Context::run() {
                     ImGui::Separator();
                 }
 
+                if (ImGui::Combo("BVH quality", (int*)&scene.BVH_QUALITY, Scene::BVH_QUALITY_NAMES, IM_ARRAYSIZE(Scene::BVH_QUALITY_NAMES))) {
+                    scene.mark_dirty(Scene::DIRTY_GEOMETRY);
+                    restart = true;
+                }
+
                 if (!scene.meshes.empty() && ImGui::BeginMenu("Lights")) {
                     // iterate over all lights
                     for (uint32_t i = 0; i < scene.lights.size(); ++i) {
@@ -455,10 +474,12 @@ void Context::run() {
                                     restart = true;
                                 }
                                 if (ImGui::DragFloat("power", &l->mesh.mat->emissive_strength, 0.1f, 0.1f, FLT_MAX)) {
+                                    scene.mark_dirty(Scene::DIRTY_EMITTERS);
                                     restart = true;
                                 }
                                 if (ImGui::Button("Extinguish")) {
                                     l->mesh.mat->emissive_strength = 0.f;
+                                    scene.mark_dirty(Scene::DIRTY_EMITTERS);
                                     restart = true;
                                 }
                             }
@@ -467,10 +488,12 @@ void Context::run() {
                                 SkyLight* l = static_cast<SkyLight*>(scene.lights[i].get());
                                 ImGui::Text("Texture: %s", l->texture->path().c_str());
                                 if (ImGui::DragFloat("intensity", &l->intensity, 0.1f, 0.1f, FLT_MAX)) {
+                                    scene.mark_dirty(Scene::DIRTY_EMITTERS);
                                     restart = true;
                                 }
                                 if (ImGui::Button("Extinguish")) {
                                     l->intensity = 0.f;
+                                    scene.mark_dirty(Scene::DIRTY_EMITTERS);
                                     restart = true;
                                 }
                             }
@@ -485,6 +508,7 @@ void Context::run() {
                         if (ImGui::BeginMenu(mat_ptr->name.c_str())) {
                             if (!mat_ptr->albedo_tex) {
                                 if (ImGui::ColorEdit3("albedo", &mat_ptr->albedo_col.x)) {
+                                    scene.mark_dirty(Scene::DIRTY_MATERIALS);
                                     restart = true;
                                 }
                             } else {
@@ -504,16 +528,20 @@ void Context::run() {
                                 ImGui::Text("emissive map: %s", mat_ptr->emissive_tex.src_path.c_str());
                             }
                             if (ImGui::SliderFloat("ior", &mat_ptr->ior, 1.f, 3.f)) {
+                                scene.mark_dirty(Scene::DIRTY_MATERIALS);
                                 restart = true;
                             }
                             if (ImGui::SliderFloat("absorb", &mat_ptr->absorb, 0.f, 3.f)) {
+                                scene.mark_dirty(Scene::DIRTY_MATERIALS);
                                 restart = true;
                             }
                             if (ImGui::SliderFloat("roughness", &mat_ptr->roughness_val, 0.001f, 1.f, "%.3f")) {
+                                scene.mark_dirty(Scene::DIRTY_MATERIALS);
                                 restart = true;
                             }
                             ImGui::Separator();
                             if (ImGui::DragFloat("emissive strength", &mat_ptr->emissive_strength, 1.f)) {
+                                scene.mark_dirty(Scene::DIRTY_EMITTERS);
                                 restart = true;
                             }
 
@@ -639,24 +667,85 @@ void Context::run() {
 
                 if (scene.volume && ImGui::BeginMenu("Volume")) {
                     ImGui::Text("NVDB grid: %s", scene.volume_path.c_str());
+                    if (!scene.volume->frames.empty()) {
+                        int frame = scene.volume->current_frame;
+                        if (ImGui::SliderInt("frame", &frame, 0, scene.volume->frames.size() - 1)) {
+                            render_join();
+                            scene.volume->set_frame(frame);
+                            scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                        }
+                    }
                     if (ImGui::DragFloat("density scale", &scene.volume->grid.density_scale, 0.001f, 0.001f, 1000.f)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
                         restart = true;
                     }
                     if (ImGui::DragFloat("absorption cross section", &scene.volume->absorption_cross_section, 0.0001f, 0.0001f, 100.f)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
                         restart = true;
                     }
                     if (ImGui::DragFloat("scattering cross section", &scene.volume->scattering_cross_section, 0.0001f, 0.0001f, 100.f)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
                         restart = true;
                     }
                     if (ImGui::SliderFloat("henyey greenstein phase g", &scene.volume->phase_g, -0.99f, 0.99f)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
                         restart = true;
                     }
                     if (ImGui::Checkbox("Unbiased estimators", &scene.volume->unbiased_estimators)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
+                        restart = true;
+                    }
+                    if (ImGui::Checkbox("Majorant grid", &scene.volume->majorant_grid)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
                         restart = true;
                     }
                     if (ImGui::DragFloat("raymarch step size", &scene.volume->raymarch_dt, 0.001f, 0.001f, 100.f)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
+                        restart = true;
+                    }
+                    if (ImGui::Checkbox("Step-coherent raymarching", &scene.volume->raymarch_coherent)) {
+                        scene.mark_dirty(Scene::DIRTY_VOLUME);
                         restart = true;
                     }
+                    if (!scene.volume->grids.empty()) {
+                        ImGui::Separator();
+                        ImGui::Text("Emission grid:");
+                        if (ImGui::RadioButton("none", scene.volume->emission_grid_name.empty())) {
+                            render_join();
+                            scene.volume->emission_grid_name.clear();
+                            scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                        }
+                        for (const NVDBGrid& grid : scene.volume->grids) {
+                            if (ImGui::RadioButton(grid.name.c_str(), scene.volume->emission_grid_name == grid.name)) {
+                                render_join();
+                                scene.volume->emission_grid_name = grid.name;
+                                scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                            }
+                        }
+                    }
+                    if (scene.volume->emission_grid()) {
+                        if (ImGui::Checkbox("Blackbody (temperature grid)", &scene.volume->blackbody)) {
+                            scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                            restart = true;
+                        }
+                        if (ImGui::DragFloat("emission scale", &scene.volume->emission_scale, 0.01f, 0.f, 10000.f)) {
+                            scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                            restart = true;
+                        }
+                        if (scene.volume->blackbody) {
+                            if (ImGui::DragFloat("temperature scale", &scene.volume->temperature_scale, 1.f, 0.f, 10000.f)) {
+                                scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                                restart = true;
+                            }
+                            if (ImGui::DragFloat("temperature offset", &scene.volume->temperature_offset, 1.f, 0.f, 10000.f)) {
+                                scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                                restart = true;
+                            }
+                        } else if (ImGui::ColorEdit3("emission color", &scene.volume->emission_color.x)) {
+                            scene.mark_dirty(Scene::DIRTY_VOLUME_EMISSION);
+                            restart = true;
+                        }
+                    }
                     ImGui::EndMenu();
                 }
 
@@ -754,6 +843,13 @@ void Context::run() {
                     restart |= true;
                 if (ImGui::DragFloat("Error", &ERROR_EPS, 0.0001f, 0.001f, 0.5f))
                     restart |= true;
+                if (ImGui::Checkbox("Adaptive sampling?", &ADAPTIVE_SAMPLING))
+                    restart |= true;
+                if (ImGui::InputScalar("Sample budget", ImGuiDataType_U64, &SAMPLE_BUDGET))
+                    restart |= true;
+                if (ImGui::DragFloat("Time budget (s)", &TIME_BUDGET, 1.f, 0.f, 86400.f))
+                    restart |= true;
+                ImGui::Checkbox("Print scheduler stats?", &SCHEDULER_STATS);
 
                 ImGui::Separator();
 
@@ -847,7 +943,11 @@ json11::Json Context::to_json() const {
         { "rr_min_path_length", int(RR_MIN_PATH_LENGTH) },
         { "rr_threshold", RR_THRESHOLD },
         { "beauty_render", BEAUTY_RENDER },
-        { "error_eps", ERROR_EPS }
+        { "error_eps", ERROR_EPS },
+        { "adaptive_sampling", ADAPTIVE_SAMPLING },
+        { "sample_budget", double(SAMPLE_BUDGET) },
+        { "time_budget", TIME_BUDGET },
+        { "scheduler_stats", SCHEDULER_STATS }
     };
 }
 
@@ -861,6 +961,10 @@ void Context::from_json(const json11::Json& cfg) {
         json_set_float(cfg, "rr_threshold", RR_THRESHOLD);
         json_set_bool(cfg, "beauty_render", BEAUTY_RENDER);
         json_set_float(cfg, "error_eps", ERROR_EPS);
+        json_set_bool(cfg, "adaptive_sampling", ADAPTIVE_SAMPLING);
+        json_set_uint64(cfg, "sample_budget", SAMPLE_BUDGET);
+        json_set_float(cfg, "time_budget", TIME_BUDGET);
+        json_set_bool(cfg, "scheduler_stats", SCHEDULER_STATS);
         // parse algorithm, fbo, scene and cam
         if (cfg["algorithm"].is_string()) {
             algorithm = cfg["algorithm"].string_value();
@@ -3,6 +3,7 @@
 #include <memory>
 #include <filesystem>
 #include <thread>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -84,6 +85,10 @@ public:
     float RR_THRESHOLD = 0.25;          ///< Apply russian roulette if luma drops below this
     bool BEAUTY_RENDER = false;         ///< Render until converged and denoise if available?
     float ERROR_EPS = 0.05;             ///< Convergence criterion
+    bool ADAPTIVE_SAMPLING = false;     ///< Distribute samples per pixel by estimated relative error?
+    uint64_t SAMPLE_BUDGET = 0;         ///< Total #samples for adaptive sampling (0: width * height * sppx)
+    float TIME_BUDGET = 0;              ///< Render time budget in seconds for adaptive sampling (0: unlimited)
+    bool SCHEDULER_STATS = false;       ///< Print tile cost and load balance statistics after each render pass?
 
     // data
     RTCDevice device;                   ///< Embree4 device
@@ -93,6 +98,7 @@ public:
     std::string algorithm;              ///< Algorithm to use for rendering
     volatile bool abort = false;        ///< Flag to abort rendering if true
     volatile bool restart = false;      ///< Flag to restart rendering if true
+    std::vector<uint64_t> tile_ns;      ///< Cost per tile in ns of the last render (see TileScheduler::tile_ns, perform_queue_benchmarks())
 
 private:
     // GL viewer stuff
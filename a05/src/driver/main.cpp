@@ -1,15 +1,37 @@
 #include "context.h"
+#include "render.h"
 #include "gi/random.h"
 #include "gi/distribution.h"
+#include "gi/hit.h"
+#include "gi/volume.h"
+
+#include <cstring>
 
 int main(int argc, char** argv) {
 
     // init context
     Context context;
     
-    // attempt to load all provided arguments
-    for (int i = 1; i < argc; ++i)
-        context.load(argv[i]);
+    // attempt to load all provided arguments, except for the --benchmark flag
+    bool benchmark = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            benchmark = true;
+        else
+            context.load(argv[i]);
+    }
+
+    if (benchmark) {
+        // render once in the main thread, then replay its tile costs through the work queues
+        render(context);
+        perform_queue_benchmarks(context.tile_ns);
+        perform_distribution_benchmarks();
+        perform_hit_benchmarks(context.scene);
+        if (context.scene.volume)
+            perform_volume_benchmarks(*context.scene.volume);
+        perform_algorithm_benchmarks(context);
+        return 0;
+    }
 
     // enter main loop
     context.run();
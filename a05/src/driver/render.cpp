@@ -1,5 +1,6 @@
 #include "render.h"
 
+#include "gi/rng.h"
 #include "gi/color.h"
 #include "gi/algorithm.h"
 
@@ -8,12 +9,10 @@
 // ---------------------------------------------------------------------------------
 // helper functions
 
-static constexpr size_t TILESIZE = 32;
-
-inline float block_convergence(const Context& ctx, size_t bx, size_t by) {
+inline float block_convergence(const Context& ctx, const Tile& tile) {
     float mean = 0, m2 = 0, count = 0;
-    for (size_t y = by * TILESIZE; y < glm::min(ctx.fbo.h, (by + 1) * TILESIZE); ++y) {
-        for (size_t x = bx * TILESIZE; x < glm::min(ctx.fbo.w, (bx + 1) * TILESIZE); ++x) {
+    for (size_t y = tile.y0; y < tile.y1; ++y) {
+        for (size_t x = tile.x0; x < tile.x1; ++x) {
             const float err = luma(glm::abs(ctx.fbo.color(x, y) - ctx.fbo.even(x, y))) / fmaxf(1e-5f, luma(ctx.fbo.color(x, y)));
             count += 1;
             const float delta = err - mean;
@@ -22,11 +21,100 @@ inline float block_convergence(const Context& ctx, size_t bx, size_t by) {
             m2 += delta * delta2;
         }
     }
-    const float f = fmaxf(0.f, 1 - ctx.fbo.num_samples(bx*TILESIZE, by*TILESIZE) / float(1 << 13));
+    const float f = fmaxf(0.f, 1 - ctx.fbo.num_samples(tile.x0, tile.y0) / float(1 << 13));
     const float var_crit = f * (m2 / (count - 1)) / fmaxf(1e-5f, sqrtf(mean));
     return (2 * var_crit * mean) / (var_crit + mean);
 }
 
+// ---------------------------------------------------------------------------------
+// per-pixel adaptive sampling
+
+static constexpr uint32_t ADAPTIVE_MIN_SPP = 4;     ///< Uniform sppx before the error estimate is used
+static constexpr uint32_t ADAPTIVE_MAX_SPP = 64;    ///< Max sppx per pass, keeps fireflies from draining a pass
+
+inline float pixel_error(const Framebuffer& fbo, size_t x, size_t y) {
+    // relative error of the even-sample estimate, averaged over 3x3 pixels for stability
+    float err = 0, count = 0;
+    for (size_t j = y > 0 ? y - 1 : 0; j <= std::min(y + 1, fbo.height() - 1); ++j) {
+        for (size_t i = x > 0 ? x - 1 : 0; i <= std::min(x + 1, fbo.width() - 1); ++i) {
+            err += luma(glm::abs(fbo.color(i, j) - fbo.even(i, j))) / fmaxf(1e-5f, luma(fbo.color(i, j)));
+            count += 1;
+        }
+    }
+    return err / count;
+}
+
+/**
+ * @brief Distribute the remaining sample (or time) budget over pixels in proportion to their estimated relative error
+ *
+ * @param ctx Current context
+ * @param algo Algorithm used for sampling
+ * @param scheduler Tile scheduler
+ * @param start Start time of the render, used for the time budget
+ */
+static void render_adaptive(Context& ctx, Algorithm& algo, TileScheduler& scheduler, const std::chrono::system_clock::time_point& start) {
+    const size_t w = ctx.fbo.width(), h = ctx.fbo.height(), sppx = ctx.fbo.samples();
+    const auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count(); };
+
+    // uniform samples until the error estimate becomes meaningful (one is already present)
+    const size_t spp_min = std::min(sppx, size_t(ADAPTIVE_MIN_SPP));
+    if (spp_min > 1) {
+        scheduler.run([&](const Tile& tile) {
+            algo.sample_tile(ctx, tile.x0, tile.y0, tile.x1, tile.y1, spp_min - 1);
+        }, ctx.abort);
+    }
+
+    // without a sample budget, a time budget alone bounds the render
+    const size_t total = ctx.SAMPLE_BUDGET > 0 ? size_t(std::min<uint64_t>(ctx.SAMPLE_BUDGET, SIZE_MAX)) : ctx.TIME_BUDGET > 0 ? SIZE_MAX : w * h * sppx;
+    size_t spent = w * h * spp_min;
+    uint32_t passes = 0;
+    Buffer<float> error(w, h);
+    Buffer<uint32_t> spp(w, h);
+    while (!ctx.abort && spent < total) {
+        size_t remaining = total - spent;
+        if (ctx.TIME_BUDGET > 0) {
+            const double t = elapsed();
+            if (t >= ctx.TIME_BUDGET) break;
+            // extrapolate from the sample rate so far
+            remaining = std::min(remaining, size_t(spent / t * (ctx.TIME_BUDGET - t)));
+        }
+        // spend a quarter of the remainder per pass (at least 1 sppx on average) to refine the estimate often
+        const size_t budget = std::min(remaining, std::max(w * h, remaining / 4));
+
+        // estimate per-pixel error
+        double err_sum = 0;
+        #pragma omp parallel for reduction(+ : err_sum)
+        for (int y = 0; y < int(h); ++y) {
+            for (size_t x = 0; x < w; ++x) {
+                error(x, y) = pixel_error(ctx.fbo, x, y);
+                err_sum += error(x, y);
+            }
+        }
+        if (err_sum <= 0) break;
+
+        // allocate budget in proportion to error, stochastic rounding keeps the total unbiased
+        const double scale = budget / err_sum;
+        size_t assigned = 0;
+        #pragma omp parallel for reduction(+ : assigned)
+        for (int y = 0; y < int(h); ++y) {
+            for (size_t x = 0; x < w; ++x) {
+                const float n = fminf(float(ADAPTIVE_MAX_SPP), float(error(x, y) * scale));
+                RNG::seed(y * w + x, UINT32_MAX - passes); // sample indices from the top, disjoint from the pixel samples
+                spp(x, y) = uint32_t(n) + (RNG::uniform<float>() < n - floorf(n) ? 1 : 0);
+                assigned += spp(x, y);
+            }
+        }
+        if (assigned == 0) break;
+
+        scheduler.run([&](const Tile& tile) {
+            algo.sample_tile(ctx, tile.x0, tile.y0, tile.x1, tile.y1, spp);
+        }, ctx.abort);
+        spent += assigned;
+        passes++;
+    }
+    printf("Adaptive sampling: %u passes, %zu samples (avg sppx: %.1f), %.1fs\n", passes, spent, spent / double(w * h), elapsed());
+}
+
 // ---------------------------------------------------------------------------------
 // main rendering "loop"
 
@@ -58,15 +146,13 @@ void render(Context &ctx) {
     timings.start("render");
     const size_t w = ctx.fbo.width(), h = ctx.fbo.height(), sppx = ctx.fbo.samples();
 
+    TileScheduler scheduler(w, h);
+
     // push 1sppx quickly
     const auto start = std::chrono::system_clock::now();
-    #pragma omp parallel for
-    for (int y = 0; y < int(h); ++y) {
-        for (int x = 0; x < int(w); ++x) {
-            if (ctx.abort) break;
-            algo->sample_pixel(ctx, x, y, 1);
-        }
-    }
+    scheduler.run([&](const Tile& tile) {
+        algo->sample_tile(ctx, tile.x0, tile.y0, tile.x1, tile.y1, 1);
+    }, ctx.abort);
     const auto end = std::chrono::system_clock::now();
     const size_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 
@@ -78,30 +164,29 @@ void render(Context &ctx) {
     );
 
     // render rest of samples
-    #pragma omp parallel for
-    for (int y = 0; y < int(h); ++y) {
-        for (int x = 0; x < int(w); ++x) {
-            if (ctx.abort) break;
-            algo->sample_pixel(ctx, x, y, sppx - 1);
-        }
+    if (ctx.ADAPTIVE_SAMPLING)
+        render_adaptive(ctx, *algo, scheduler, start);
+    else {
+        scheduler.run([&](const Tile& tile) {
+            algo->sample_tile(ctx, tile.x0, tile.y0, tile.x1, tile.y1, sppx - 1);
+        }, ctx.abort);
     }
     timings.stop("render");
+    if (ctx.SCHEDULER_STATS) scheduler.print_stats("render");
+    ctx.tile_ns = scheduler.tile_ns;
 
     if (ctx.abort) return;
 
     if (ctx.BEAUTY_RENDER) {
         timings.start("convergence");
+        scheduler.clear_stats();
         // init data structure
-        MutexPrioQueue unconverged;
-        const int TILES_W = (ctx.fbo.w + TILESIZE - 1) / TILESIZE;
-        const int TILES_H = (ctx.fbo.h + TILESIZE - 1) / TILESIZE;
+        MultiPrioQueue unconverged;
         #pragma omp parallel for
-        for (int by = 0; by < TILES_H; ++by) {
-            for (int bx = 0; bx < TILES_W; ++bx) {
-                const float conv = block_convergence(ctx, bx, by);
-                if (conv > ctx.ERROR_EPS)
-                    unconverged.push(by * TILES_W + bx, conv);
-            }
+        for (int id = 0; id < int(scheduler.size()); ++id) {
+            const float conv = block_convergence(ctx, scheduler[id]);
+            if (conv > ctx.ERROR_EPS)
+                unconverged.push(id, conv);
         }
         // render until converged
         printf("Rendering until error < %.3f...\n", ctx.ERROR_EPS);
@@ -109,22 +194,22 @@ void render(Context &ctx) {
         {
             size_t id;
             while (unconverged.pop(id) && !ctx.abort) {
-                const uint32_t bx = id % TILES_W, by = id / TILES_W;
-                for (uint32_t y = by * TILESIZE; y < glm::min(ctx.fbo.h, (by + 1) * TILESIZE); ++y)
-                    for (uint32_t x = bx * TILESIZE; x < glm::min(ctx.fbo.w, (bx + 1) * TILESIZE); ++x)
-                        algo->sample_pixel(ctx, x, y, 32);
-                const float conv = block_convergence(ctx, bx, by);
+                scheduler.process(id, [&](const Tile& tile) {
+                    algo->sample_tile(ctx, tile.x0, tile.y0, tile.x1, tile.y1, 32);
+                });
+                const float conv = block_convergence(ctx, scheduler[id]);
                 if (conv > ctx.ERROR_EPS) {
-                    unconverged.push(by * TILES_W + bx, conv);
+                    unconverged.push(id, conv);
                 }
                 if (omp_get_thread_num() == 0) {
-                    printf("error: %3.3f, #blocks: %4zu\r", conv, unconverged.queue.size());
+                    printf("error: %3.3f, #blocks: %4zu\r", conv, unconverged.size());
                     fflush(stdout);
                 }
             }
         }
         printf("\n");
         timings.stop("convergence");
+        if (ctx.SCHEDULER_STATS) scheduler.print_stats("convergence");
     }
 
     if (ctx.abort) return;
@@ -143,3 +228,54 @@ void render(Context &ctx) {
 
     algo->post_render();
 }
+
+// ---------------------------------------------------------------------------------
+// benchmarks
+
+void perform_algorithm_benchmarks(Context& ctx, const std::string& reference, const std::string& candidate) {
+    ctx.scene.commit();
+    ctx.cam.commit();
+    if (ctx.scene.lights.empty()) {
+        std::cerr << "Error: Trying to render scene without light sources." << std::endl;
+        return;
+    }
+    const size_t w = ctx.fbo.width(), h = ctx.fbo.height(), sppx = ctx.fbo.samples();
+    printf("Algorithm benchmarks: %zux%zu, %zu sppx\n", w, h, sppx);
+
+    // render the full image with one algorithm and keep a copy of its color buffer
+    const auto run = [&](const std::string& name, std::vector<glm::vec3>& image) {
+        const std::shared_ptr<Algorithm> algo = Algorithm::algorithms.count(name) ? Algorithm::algorithms[name] : nullptr;
+        if (!algo) {
+            std::cerr << "Warning: algorithm " << name << " not found, skipping comparison" << std::endl;
+            return false;
+        }
+        ctx.fbo.clear();
+        algo->init(ctx);
+        TileScheduler scheduler(w, h);
+        const auto start = std::chrono::system_clock::now();
+        scheduler.run([&](const Tile& tile) {
+            algo->sample_tile(ctx, tile.x0, tile.y0, tile.x1, tile.y1, sppx);
+        }, ctx.abort);
+        const double s = std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+        printf("%-20s %.3fs, %zu rays, %.2f Mrays/s\n", (name + ":").c_str(), s, algo->rays_traced(), algo->rays_traced() / (1e6 * s));
+        image.resize(w * h);
+        for (size_t y = 0; y < h; ++y)
+            for (size_t x = 0; x < w; ++x)
+                image[y * w + x] = ctx.fbo.color(x, y);
+        return true;
+    };
+    std::vector<glm::vec3> ref, cand;
+    if (!run(reference, ref) || !run(candidate, cand)) return;
+
+    // per-pixel relative difference in luminance
+    double sum_sq = 0, max_diff = 0;
+    size_t differ = 0;
+    for (size_t i = 0; i < ref.size(); ++i) {
+        const double diff = luma(glm::abs(ref[i] - cand[i])) / fmaxf(1e-5f, luma(ref[i]));
+        sum_sq += diff * diff;
+        max_diff = std::max(max_diff, diff);
+        if (diff > 1e-4) differ++;
+    }
+    printf("%s vs %s: relative RMSE %.3g, max %.3g, %zu of %zu pixels differ by more than 1e-4\n",
+        reference.c_str(), candidate.c_str(), std::sqrt(sum_sq / ref.size()), max_diff, differ, ref.size());
+}
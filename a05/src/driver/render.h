@@ -1,38 +1,19 @@
 #pragma once
-#include <queue>
-#include <mutex>
-
 #include "context.h"
-
-// ---------------------------------------------------------------------------------
-// scheduling helper structures
-
-struct Block {
-    Block(size_t id, float convergence = 0) : id(id), conv(convergence) {}
-
-    size_t id;
-    float conv;
-};
-inline bool operator<(const Block& A, const Block& B) { return A.conv < B.conv; }
-
-struct MutexPrioQueue {
-    inline void push(size_t id, float conv = 0) {
-        std::lock_guard<std::mutex> lock(mutex);
-        queue.emplace(id, conv);
-    }
-    inline bool pop(size_t& id) {
-        std::lock_guard<std::mutex> lock(mutex);
-        if (queue.empty()) return false;
-        id = queue.top().id;
-        queue.pop();
-        return true;
-    }
-
-    std::mutex mutex;
-    std::priority_queue<Block> queue;
-};
+#include "scheduler.h"
 
 // ---------------------------------------------------------------------------------
 // actual main rendering call
 
 void render(Context& ctx);
+
+/**
+ * @brief Render the committed scene with two algorithms at the configured sppx, report their ray throughput and the
+ * difference of the resulting images. With the counter-based RNG, algorithms that consume the same random streams
+ * per path vertex (e.g. Pathtracer and WavefrontPathtracer) should agree up to floating point round-off.
+ *
+ * @param ctx Current context, the framebuffer holds the image of candidate afterwards
+ * @param reference Name of the reference algorithm
+ * @param candidate Name of the algorithm to compare against the reference
+ */
+void perform_algorithm_benchmarks(Context& ctx, const std::string& reference = "Pathtracer", const std::string& candidate = "WavefrontPathtracer");
@@ -0,0 +1,197 @@
+#include "scheduler.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+
+// ---------------------------------------------------------------------------------
+// TileScheduler
+
+TileScheduler::TileScheduler(size_t w, size_t h, size_t tilesize) : queues(omp_get_max_threads()) {
+    const uint32_t tiles_w = (w + tilesize - 1) / tilesize;
+    const uint32_t tiles_h = (h + tilesize - 1) / tilesize;
+    // collect tiles and sort along the morton curve
+    std::vector<std::pair<uint32_t, Tile>> sorted;
+    sorted.reserve(tiles_w * tiles_h);
+    for (uint32_t ty = 0; ty < tiles_h; ++ty) {
+        for (uint32_t tx = 0; tx < tiles_w; ++tx) {
+            const Tile tile = { uint32_t(tx * tilesize), uint32_t(ty * tilesize),
+                uint32_t(std::min(w, (tx + 1) * tilesize)), uint32_t(std::min(h, (ty + 1) * tilesize)) };
+            sorted.emplace_back(morton2D(tx, ty), tile);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    tiles.reserve(sorted.size());
+    for (const auto& [code, tile] : sorted)
+        tiles.push_back(tile);
+    tile_ns.resize(tiles.size(), 0);
+}
+
+bool TileScheduler::pop(WorkQueue& queue, uint32_t& id) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.ids.empty()) return false;
+    id = queue.ids.front();
+    queue.ids.pop_front();
+    return true;
+}
+
+bool TileScheduler::steal(int thread, uint32_t& id) {
+    // visit victims round robin, take from the back to stay clear of the owner
+    for (size_t i = 1; i < queues.size(); ++i) {
+        WorkQueue& victim = queues[(thread + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.ids.empty()) continue;
+        id = victim.ids.back();
+        victim.ids.pop_back();
+        queues[thread].num_steals++;
+        return true;
+    }
+    return false;
+}
+
+void TileScheduler::clear_stats() {
+    std::fill(tile_ns.begin(), tile_ns.end(), 0);
+    for (auto& queue : queues) {
+        queue.busy_ns = 0;
+        queue.num_tiles = 0;
+        queue.num_steals = 0;
+    }
+}
+
+void TileScheduler::print_stats(const char* name) const {
+    if (tiles.empty()) return;
+    // per tile cost
+    uint64_t tile_min = UINT64_MAX, tile_max = 0, tile_sum = 0, tile_count = 0;
+    for (const uint64_t ns : tile_ns) {
+        if (ns == 0) continue;
+        tile_min = std::min(tile_min, ns);
+        tile_max = std::max(tile_max, ns);
+        tile_sum += ns;
+        tile_count++;
+    }
+    if (tile_count == 0) return;
+    // per thread load
+    uint64_t busy_min = UINT64_MAX, busy_max = 0, busy_sum = 0, steals = 0;
+    for (const auto& queue : queues) {
+        busy_min = std::min(busy_min, queue.busy_ns);
+        busy_max = std::max(busy_max, queue.busy_ns);
+        busy_sum += queue.busy_ns;
+        steals += queue.num_steals;
+    }
+    const double busy_avg = busy_sum / double(queues.size());
+    printf("Tiles (%s): %zu tiles, cost min/avg/max: %.2f/%.2f/%.2f ms, %zu threads, busy min/max: %.1f/%.1f ms, imbalance: %.3f, steals: %zu\n",
+        name, size_t(tile_count), tile_min / 1e6, tile_sum / (1e6 * tile_count), tile_max / 1e6,
+        queues.size(), busy_min / 1e6, busy_max / 1e6, busy_avg > 0 ? busy_max / busy_avg : 1.0, size_t(steals));
+}
+
+// ---------------------------------------------------------------------------------
+// MultiPrioQueue
+
+MultiPrioQueue::MultiPrioQueue(size_t num_shards) : shards(std::max(size_t(2), num_shards)) {}
+
+size_t MultiPrioQueue::random_shard() {
+    // xorshift32, seeded per thread
+    thread_local uint32_t state = 0x9e3779b9u * uint32_t(omp_get_thread_num() + 1);
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % shards.size();
+}
+
+void MultiPrioQueue::push(size_t id, float conv) {
+    for (uint32_t attempt = 0;; ++attempt) {
+        Shard& shard = shards[random_shard()];
+        std::unique_lock<std::mutex> lock(shard.mutex, std::defer_lock);
+        // only block after a number of contended attempts
+        if (attempt < shards.size()) {
+            if (!lock.try_lock()) continue;
+        } else
+            lock.lock();
+        shard.queue.emplace(id, conv);
+        shard.top.store(shard.queue.top().conv, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_release);
+        return;
+    }
+}
+
+bool MultiPrioQueue::pop_locked(Shard& shard, size_t& id) {
+    if (shard.queue.empty()) return false;
+    id = shard.queue.top().id;
+    shard.queue.pop();
+    shard.top.store(shard.queue.empty() ? -FLT_MAX : shard.queue.top().conv, std::memory_order_relaxed);
+    count.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool MultiPrioQueue::pop(size_t& id) {
+    for (uint32_t attempt = 0; count.load(std::memory_order_acquire) > 0; ++attempt) {
+        if (attempt < 2 * shards.size()) {
+            // take the better of two random shards
+            Shard& a = shards[random_shard()];
+            Shard& b = shards[random_shard()];
+            Shard& best = a.top.load(std::memory_order_relaxed) >= b.top.load(std::memory_order_relaxed) ? a : b;
+            std::unique_lock<std::mutex> lock(best.mutex, std::try_to_lock);
+            if (lock.owns_lock() && pop_locked(best, id)) return true;
+        } else {
+            // (almost) empty: sweep all shards before giving up
+            for (auto& shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (pop_locked(shard, id)) return true;
+            }
+            attempt = 0;
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------
+// benchmarks
+
+template <typename Queue> static double benchmark_queue(int num_threads, const std::vector<uint64_t>& tile_ns, size_t& num_pops) {
+    const float eps = 0.02f;
+    Queue queue;
+    std::vector<float> conv(tile_ns.size());
+    for (size_t id = 0; id < conv.size(); ++id) {
+        conv[id] = 0.1f + 0.9f * float((id * 2654435761u) % 1024) / 1024.f;
+        queue.push(id, conv[id]);
+    }
+    std::atomic<size_t> pops = 0;
+    const auto start = std::chrono::steady_clock::now();
+    #pragma omp parallel num_threads(num_threads)
+    {
+        size_t id;
+        while (queue.pop(id)) {
+            // emulate rendering the block by spinning for its cost
+            const auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(tile_ns[id]);
+            while (std::chrono::steady_clock::now() < until);
+            // each pass reduces the error of the block
+            conv[id] *= 0.7f;
+            if (conv[id] > eps)
+                queue.push(id, conv[id]);
+            pops.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    num_pops = pops;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void perform_queue_benchmarks(const std::vector<uint64_t>& tile_ns) {
+    // default: 1024x1024 image in 32x32 blocks with a skewed cost per block (20us to 1ms, few expensive blocks),
+    // short enough for queue contention to show and uneven like a real render
+    std::vector<uint64_t> costs = tile_ns;
+    if (costs.empty()) {
+        costs.resize(1024);
+        for (size_t id = 0; id < costs.size(); ++id) {
+            const float h = float((id * 2246822519u) % 1024) / 1024.f;
+            costs[id] = 20000 + uint64_t(980000 * h * h * h * h);
+        }
+    }
+    printf("Queue benchmarks: %zu blocks, %d cores\n", costs.size(), omp_get_num_procs());
+    for (int num_threads : { 8, 32, 128 }) {
+        size_t pops_mutex, pops_multi;
+        const double t_mutex = benchmark_queue<MutexPrioQueue>(num_threads, costs, pops_mutex);
+        const double t_multi = benchmark_queue<MultiPrioQueue>(num_threads, costs, pops_multi);
+        printf("%3d threads: MutexPrioQueue: %.3fs (%.0f blocks/s), MultiPrioQueue: %.3fs (%.0f blocks/s), speedup: %.2f\n",
+            num_threads, t_mutex, pops_mutex / t_mutex, t_multi, pops_multi / t_multi, t_mutex / t_multi);
+    }
+}
@@ -0,0 +1,220 @@
+#pragma once
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <omp.h>
+
+// ---------------------------------------------------------------------------------
+// image tiles
+
+static constexpr uint32_t TILESIZE = 32;
+
+/**
+ * @brief Rectangular image region [x0, x1) x [y0, y1)
+ */
+struct Tile {
+    uint32_t x0, y0, x1, y1;
+};
+
+/**
+ * @brief Interleave the lower 16 bits of x and y (2D morton code)
+ */
+inline uint32_t morton2D(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+// ---------------------------------------------------------------------------------
+// work-stealing tile scheduler
+
+/**
+ * @brief Distributes the image tiles (in morton order) over per-thread deques.
+ * Each thread works on its own contiguous range of tiles front to back and steals from the
+ * back of other threads' deques once it runs dry. Per-tile and per-thread costs are recorded.
+ */
+class TileScheduler {
+public:
+    /**
+     * @brief Construct tiles covering an image of the given resolution
+     *
+     * @param w Image width
+     * @param h Image height
+     * @param tilesize Tile edge length in pixels
+     */
+    TileScheduler(size_t w, size_t h, size_t tilesize = TILESIZE);
+
+    TileScheduler(const TileScheduler&)            = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+
+    /**
+     * @brief Process all tiles once in parallel, returns early if abort is set
+     * @note Tile costs accumulate over runs, call clear_stats() to start a new phase
+     *
+     * @param func Callback invoked as func(const Tile&)
+     * @param abort Abort flag, checked before each tile
+     */
+    template <typename F> void run(F&& func, const volatile bool& abort);
+
+    /**
+     * @brief Process a single tile on the calling thread and record its cost
+     *
+     * @param id Tile index into tiles
+     * @param func Callback invoked as func(const Tile&)
+     */
+    template <typename F> void process(uint32_t id, F&& func);
+
+    /**
+     * @brief Reset all gathered tile and thread costs
+     */
+    void clear_stats();
+
+    /**
+     * @brief Print tile cost and thread load balance gathered since the last clear_stats()
+     *
+     * @param name Name of the pass
+     */
+    void print_stats(const char* name) const;
+
+    inline size_t size() const { return tiles.size(); }
+    inline const Tile& operator[](size_t id) const { return tiles[id]; }
+
+private:
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<uint32_t> ids;
+        uint64_t busy_ns = 0;
+        uint32_t num_tiles = 0;
+        uint32_t num_steals = 0;
+    };
+
+    bool pop(WorkQueue& queue, uint32_t& id);
+    bool steal(int thread, uint32_t& id);
+
+public:
+    // data
+    std::vector<Tile> tiles;                ///< All tiles in morton order
+    std::vector<uint64_t> tile_ns;          ///< Accumulated cost per tile in ns
+    std::vector<WorkQueue> queues;          ///< One work deque per thread
+};
+
+// ---------------------------------------------------------------------------------
+// scheduling helper structures for unconverged blocks
+
+struct Block {
+    Block(size_t id, float convergence = 0) : id(id), conv(convergence) {}
+
+    size_t id;
+    float conv;
+};
+inline bool operator<(const Block& A, const Block& B) { return A.conv < B.conv; }
+
+/**
+ * @brief Exact priority queue guarded by a single lock, serializes all threads (kept as reference)
+ */
+struct MutexPrioQueue {
+    inline void push(size_t id, float conv = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace(id, conv);
+    }
+    inline bool pop(size_t& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty()) return false;
+        id = queue.top().id;
+        queue.pop();
+        return true;
+    }
+    inline size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    std::mutex mutex;
+    std::priority_queue<Block> queue;
+};
+
+/**
+ * @brief Relaxed concurrent priority queue (MultiQueue).
+ * Blocks are spread over several independently locked shards. Pushes go to a random shard,
+ * pops compare the cached top priority of two random shards and take the better one.
+ * Only try_lock is used on the fast path, so threads never wait on each other; the worst
+ * blocks are still processed first with high probability.
+ */
+class MultiPrioQueue {
+public:
+    /**
+     * @param num_shards Number of shards, defaults to 4 per thread
+     */
+    MultiPrioQueue(size_t num_shards = 4 * omp_get_max_threads());
+
+    MultiPrioQueue(const MultiPrioQueue&)            = delete;
+    MultiPrioQueue& operator=(const MultiPrioQueue&) = delete;
+
+    void push(size_t id, float conv = 0);
+    bool pop(size_t& id);
+    inline size_t size() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::priority_queue<Block> queue;
+        std::atomic<float> top = { -FLT_MAX };  ///< Cached priority of the top element, -FLT_MAX if empty
+    };
+
+    bool pop_locked(Shard& shard, size_t& id);
+    size_t random_shard();
+
+    // data
+    std::vector<Shard> shards;
+    std::atomic<size_t> count = { 0 };          ///< Number of queued blocks over all shards
+};
+
+/**
+ * @brief Compare MutexPrioQueue and MultiPrioQueue throughput under a simulated convergence workload at 8, 32 and 128 threads
+ *
+ * @param tile_ns Optional per-block cost in ns (e.g. TileScheduler::tile_ns of a real render), skewed 20us to 1ms otherwise
+ */
+void perform_queue_benchmarks(const std::vector<uint64_t>& tile_ns = {});
+
+// ---------------------------------------------------------------------------------
+// template implementations
+
+template <typename F> void TileScheduler::run(F&& func, const volatile bool& abort) {
+    // hand each thread a contiguous range of tiles to preserve locality
+    const size_t N = tiles.size(), T = queues.size();
+    for (size_t t = 0; t < T; ++t)
+        for (size_t i = t * N / T; i < (t + 1) * N / T; ++i)
+            queues[t].ids.push_back(i);
+    #pragma omp parallel
+    {
+        const int thread = omp_get_thread_num();
+        uint32_t id;
+        while (!abort && (pop(queues[thread], id) || steal(thread, id)))
+            process(id, func);
+    }
+    // drop leftovers on abort
+    for (auto& queue : queues)
+        queue.ids.clear();
+}
+
+template <typename F> void TileScheduler::process(uint32_t id, F&& func) {
+    const auto start = std::chrono::steady_clock::now();
+    func(tiles[id]);
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    // a tile is only ever processed by a single thread at once
+    tile_ns[id] += ns;
+    WorkQueue& queue = queues[omp_get_thread_num() % queues.size()];
+    queue.busy_ns += ns;
+    queue.num_tiles++;
+}
@@ -0,0 +1,22 @@
+#include "algorithm.h"
+#include "driver/context.h"
+#include "rng.h"
+
+void Algorithm::sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            RNG::seed(y * context.fbo.width() + x, context.fbo.num_samples(x, y));
+            sample_pixel(context, x, y, samples);
+        }
+    }
+}
+
+void Algorithm::sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Buffer<uint32_t>& spp) {
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            if (spp(x, y) == 0) continue;
+            RNG::seed(y * context.fbo.width() + x, context.fbo.num_samples(x, y));
+            sample_pixel(context, x, y, spp(x, y));
+        }
+    }
+}
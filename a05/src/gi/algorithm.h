@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include "json11.h"
+#include "buffer.h"
 
 // forward declare context
 class Context;
@@ -33,11 +34,35 @@ public:
      */
     virtual void sample_pixel(Context& context, uint32_t x, uint32_t y, uint32_t samples) = 0;
 
+    /**
+     * @brief Render callback for a whole image tile [x0, x1) x [y0, y1), called by the tile scheduler
+     * @note Defaults to seeding the RNG with (pixel, #samples) and calling sample_pixel() per pixel,
+     * override to trace coherent rays of a tile in batches.
+     *
+     * @param context reference to the Context
+     */
+    virtual void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples);
+
+    /**
+     * @brief Render callback for a whole image tile with a varying number of samples per pixel, used by adaptive sampling
+     * @note Defaults to seeding the RNG with (pixel, #samples) and calling sample_pixel() per pixel with samples,
+     * pixels with zero samples are skipped.
+     *
+     * @param context reference to the Context
+     * @param spp number of samples per pixel, indexed by image coordinates
+     */
+    virtual void sample_tile(Context& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const Buffer<uint32_t>& spp);
+
     /**
      * @brief Called after rendering to allow algorithm to clean up data structures
      */
     virtual void post_render() {}
 
+    /**
+     * @brief Number of rays traced since init(), including shadow rays, or 0 if the algorithm does not count them
+     */
+    virtual size_t rays_traced() const { return 0; }
+
     /**
      * @brief Static algorithm management (populated via AlgorithmRegistrar)
      */
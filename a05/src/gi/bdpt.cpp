@@ -21,7 +21,7 @@ void trace_cam_path(const Context& context, uint32_t x, uint32_t y, std::vector<
         // handle direct light source hits
         if (hit.is_light()) {
             if (hit.valid) {
-                if (d == 0 && dot(hit.N, -ray.dir) > 0) {
+                if (d == 0 && dot(hit.N(), -ray.dir) > 0) {
                     cam_path.emplace_back(hit, throughput * hit.Le());
                 }
             } else {
@@ -45,7 +45,7 @@ void trace_cam_path(const Context& context, uint32_t x, uint32_t y, std::vector<
         // bounce main ray
         const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, walk.bounce_sampler.next());
         if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) break;
-        throughput *= brdf * abs(dot(hit.N, w_i)) / brdf_pdf;
+        throughput *= brdf * abs(dot(hit.N(), w_i)) / brdf_pdf;
 
         // russian roulette based on throughput
         const float rr_val = luma(throughput);
@@ -92,11 +92,11 @@ void trace_light_path(const Context& context, std::vector<PathVertex>& light_pat
         // bounce light ray
         const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, walk.bounce_sampler.next());
         if (brdf_pdf <= 0.f || luma(brdf) <= 0.f) break;
-        throughput *= brdf * abs(dot(hit.N, w_i)) / brdf_pdf;
+        throughput *= brdf * abs(dot(hit.N(), w_i)) / brdf_pdf;
 
         // correct shading normal
-        const float num = abs(dot(w_o, hit.N)) * abs(dot(w_i, hit.Ng));
-        const float denom = abs(dot(w_o, hit.Ng)) * abs(dot(w_i, hit.N));
+        const float num = abs(dot(w_o, hit.N())) * abs(dot(w_i, hit.Ng()));
+        const float denom = abs(dot(w_o, hit.Ng())) * abs(dot(w_i, hit.N()));
         if (denom <= 0.f) break;
         throughput *= num / denom;
 
@@ -138,6 +138,8 @@ void trace_photons(const Context& context, int N, std::vector<PathVertex>& photo
     photons.reserve(N * 3); // guesstimate #photons per path
     #pragma omp parallel for
     for (int p = 0; p < N; ++p) {
+        // one stream per photon path, the pixel index UINT32_MAX is never used by the camera
+        RNG::seed(UINT32_MAX, p);
         // select light source
         const auto [light, light_source_pdf] = scene.sample_light_source(light_sampler[p]);
         if (light_source_pdf <= 0.f) continue;
@@ -159,10 +161,10 @@ void trace_photons(const Context& context, int N, std::vector<PathVertex>& photo
             // bounce light ray
             const auto [brdf, w_i, brdf_pdf] = hit.sample(w_o, RNG::uniform<glm::vec2>());
             if (luma(brdf) <= 0.f || brdf_pdf <= 0.f) break;
-            throughput *= brdf * abs(dot(hit.N, w_i)) / brdf_pdf;
+            throughput *= brdf * abs(dot(hit.N(), w_i)) / brdf_pdf;
             // correct shading normal
-            const float num = abs(dot(w_o, hit.N)) * abs(dot(w_i, hit.Ng));
-            const float denom = abs(dot(w_o, hit.Ng)) * abs(dot(w_i, hit.N));
+            const float num = abs(dot(w_o, hit.N())) * abs(dot(w_i, hit.Ng()));
+            const float denom = abs(dot(w_o, hit.Ng())) * abs(dot(w_i, hit.N()));
             if (denom <= 0.f) break;
             throughput *= num / denom;
             // russian roulette based on throughput
@@ -12,18 +12,18 @@ using namespace glm;
 // Diffuse lambertian reflection
 
 vec3 LambertianReflection::f(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    if (dot(hit.N, w_o) <= 0 || dot(hit.N, w_i) <= 0) return vec3(0);
+    if (dot(hit.N(), w_o) <= 0 || dot(hit.N(), w_i) <= 0) return vec3(0);
     return hit.albedo() * INVPI;
 }
 
 std::tuple<vec3, vec3, float> LambertianReflection::sample(const SurfaceHit& hit, const vec3& w_o, const vec2& sample) const {
     vec3 w_i = hit.to_world(cosine_sample_hemisphere(sample));
-    if (dot(hit.N, w_i) < 0.f) w_i *= -1.f;
+    if (dot(hit.N(), w_i) < 0.f) w_i *= -1.f;
     return { f(hit, w_o, w_i), w_i, pdf(hit, w_o, w_i) };
 }
 
 float LambertianReflection::pdf(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    return max(0.f, dot(hit.N, w_i)) * INVPI;
+    return max(0.f, dot(hit.N(), w_i)) * INVPI;
 }
 
 // ----------------------------------------------------------------------------------------------
@@ -35,12 +35,12 @@ vec3 LambertianTransmission::f(const SurfaceHit &hit, const vec3 &w_o, const vec
 
 std::tuple<vec3, vec3, float> LambertianTransmission::sample(const SurfaceHit& hit, const vec3& w_o, const vec2& sample) const {
     vec3 w_i = hit.to_world(cosine_sample_hemisphere(sample));
-    if (dot(hit.N, w_o) > 0.f) w_i *= -1.f;
+    if (dot(hit.N(), w_o) > 0.f) w_i *= -1.f;
     return { f(hit, w_o, w_i), w_i, pdf(hit, w_o, w_i) };
 }
 
 float LambertianTransmission::pdf(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    return abs(dot(hit.N, w_i)) * INVPI;
+    return abs(dot(hit.N(), w_i)) * INVPI;
 }
 
 // ----------------------------------------------------------------------------------------------
@@ -51,8 +51,8 @@ vec3 SpecularReflection::f(const SurfaceHit &hit, const vec3 &w_o, const vec3 &w
 }
 
 std::tuple<vec3, vec3, float> SpecularReflection::sample(const SurfaceHit& hit, const vec3& w_o, const vec2& sample) const {
-    const vec3 w_i = reflect(-w_o, hit.N);
-    const vec3 brdf = fresnel_dielectric(dot(hit.N, w_i), 1.f, hit.mat->ior) * hit.albedo() / abs(dot(hit.N, w_i));
+    const vec3 w_i = reflect(-w_o, hit.N());
+    const vec3 brdf = fresnel_dielectric(dot(hit.N(), w_i), 1.f, hit.mat->ior) * hit.albedo() / abs(dot(hit.N(), w_i));
     return { brdf, w_i, 1.f };
 }
 
@@ -68,9 +68,9 @@ vec3 SpecularTransmission::f(const SurfaceHit &hit, const vec3 &w_o, const vec3
 }
 
 std::tuple<vec3, vec3, float> SpecularTransmission::sample(const SurfaceHit& hit, const vec3& w_o, const vec2& sample) const {
-    const auto [valid, w_i] = refract(-w_o, hit.N, hit.mat->ior);
+    const auto [valid, w_i] = refract(-w_o, hit.N(), hit.mat->ior);
     if (!valid) return { vec3(0), w_i, 0.f };
-    const vec3 brdf = (1.f - fresnel_dielectric(dot(hit.N, w_i), 1.f, hit.mat->ior)) * hit.albedo() / abs(dot(hit.N, w_i));
+    const vec3 brdf = (1.f - fresnel_dielectric(dot(hit.N(), w_i), 1.f, hit.mat->ior)) * hit.albedo() / abs(dot(hit.N(), w_i));
     // TODO: account for non-symmetric transport
     return { brdf, w_i, 1.f };
 }
@@ -87,15 +87,15 @@ vec3 SpecularFresnel::f(const SurfaceHit &hit, const vec3 &w_o, const vec3 &w_i)
 }
 
 std::tuple<vec3, vec3, float> SpecularFresnel::sample(const SurfaceHit& hit, const vec3& w_o, const vec2& sample) const {
-    const float p_r = fresnel_dielectric(dot(hit.N, w_o), 1.f, hit.mat->ior);
+    const float p_r = fresnel_dielectric(dot(hit.N(), w_o), 1.f, hit.mat->ior);
     if (sample.x < p_r) {   // sample reflection
-        const vec3 w_i = reflect(-w_o, hit.N);
-        const vec3 brdf = fresnel_dielectric(dot(hit.N, w_i), 1.f, hit.mat->ior) * hit.albedo() / abs(dot(hit.N, w_i));
+        const vec3 w_i = reflect(-w_o, hit.N());
+        const vec3 brdf = fresnel_dielectric(dot(hit.N(), w_i), 1.f, hit.mat->ior) * hit.albedo() / abs(dot(hit.N(), w_i));
         return { brdf, w_i, p_r };
     } else {                // sample refraction
-        const auto [valid, w_i] = refract(-w_o, hit.N, hit.mat->ior);
+        const auto [valid, w_i] = refract(-w_o, hit.N(), hit.mat->ior);
         if (!valid) return { vec3(0), w_i, 0.f }; // TIR
-        const vec3 brdf = (1.f - fresnel_dielectric(dot(hit.N, w_i), 1.f, hit.mat->ior)) * hit.albedo() / abs(dot(hit.N, w_i));
+        const vec3 brdf = (1.f - fresnel_dielectric(dot(hit.N(), w_i), 1.f, hit.mat->ior)) * hit.albedo() / abs(dot(hit.N(), w_i));
         // TODO: account for non-symmetric transport
         return { brdf, w_i, 1 - p_r };
     }
@@ -109,11 +109,11 @@ float SpecularFresnel::pdf(const SurfaceHit& hit, const vec3& w_o, const vec3& w
 // Phong
 
 vec3 SpecularPhong::f(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    if (!same_hemisphere(hit.N, w_i)) return vec3(0);
+    if (!same_hemisphere(hit.N(), w_i)) return vec3(0);
     const float exponent = Material::exponent_from_roughness(hit.roughness());
-    const float NdotH = fmaxf(0.f, dot(hit.N, normalize(w_o + w_i)));
+    const float NdotH = fmaxf(0.f, dot(hit.N(), normalize(w_o + w_i)));
     const float norm_f = (exponent + 1) * INV2PI;
-    const float F = fresnel_dielectric(dot(hit.N, w_i), 1.f, hit.mat->ior);
+    const float F = fresnel_dielectric(dot(hit.N(), w_i), 1.f, hit.mat->ior);
     return F * hit.albedo() * powf(NdotH, exponent) * norm_f;
 }
 
@@ -161,13 +161,13 @@ inline float GGX_pdf(float D, float NdotH, float HdotV) {
 // Microfacet reflection
 
 vec3 MicrofacetReflection::f(const SurfaceHit &hit, const vec3 &w_o, const vec3 &w_i) const {
-    const float NdotV = abs(dot(hit.N, w_o));
-    const float NdotL = abs(dot(hit.N, w_i));
+    const float NdotV = abs(dot(hit.N(), w_o));
+    const float NdotL = abs(dot(hit.N(), w_i));
     if (NdotV == 0.f || NdotL == 0.f) return vec3(0);
     const vec3 H = normalize(w_o + w_i);
     const float roughness = hit.roughness();
     const float F = fresnel_dielectric(dot(H, w_i), 1.f, hit.mat->ior);
-    const float D = GGX_D(abs(dot(hit.N, H)), roughness);
+    const float D = GGX_D(abs(dot(hit.N(), H)), roughness);
     const float G = GGX_G1(NdotV, roughness) * GGX_G1(NdotL, roughness);
     const float microfacet = (F * D * G) / (4 * NdotV * NdotL);
     return coated ? vec3(microfacet) : hit.albedo() * microfacet;
@@ -177,7 +177,7 @@ std::tuple<vec3, vec3, float> MicrofacetReflection::sample(const SurfaceHit& hit
     // reflect around sampled macro normal w_h
     const vec3 w_h = hit.to_world(GGX_sample(sample, hit.roughness()));
     const vec3 w_i = reflect(-w_o, w_h);
-    if (!same_hemisphere(hit.Ng, w_i)) return { vec3(0), w_i, 0.f };
+    if (!same_hemisphere(hit.Ng(), w_i)) return { vec3(0), w_i, 0.f };
     const float sample_pdf = pdf(hit, w_o, w_i);
     assert(std::isfinite(sample_pdf));
     return { f(hit, w_o, w_i), w_i, sample_pdf };
@@ -185,7 +185,7 @@ std::tuple<vec3, vec3, float> MicrofacetReflection::sample(const SurfaceHit& hit
 
 float MicrofacetReflection::pdf(const SurfaceHit &hit, const vec3 &w_o, const vec3 &w_i) const {
     const vec3 H = normalize(w_o + w_i);
-    const float NdotH = dot(hit.N, H);
+    const float NdotH = dot(hit.N(), H);
     const float HdotV = dot(H, w_o);
     const float D = GGX_D(NdotH, hit.roughness());
     return GGX_pdf(D, NdotH, HdotV);
@@ -210,32 +210,32 @@ float MicrofacetTransmission::pdf(const SurfaceHit& hit, const vec3& w_o, const
 // Layered
 
 vec3 LayeredSurface::f(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    const float F = fresnel_dielectric(dot(hit.N, w_o), 1.f, hit.mat->ior);
+    const float F = fresnel_dielectric(dot(hit.N(), w_o), 1.f, hit.mat->ior);
     return mix(diff.f(hit, w_o, w_i), spec.f(hit, w_o, w_i), F);
 }
 
 std::tuple<vec3, vec3, float> LayeredSurface::sample(const SurfaceHit& hit, const vec3& w_o, const vec2& sample) const {
-    const float F = fresnel_dielectric(dot(hit.N, w_o), 1.f, hit.mat->ior);
+    const float F = fresnel_dielectric(dot(hit.N(), w_o), 1.f, hit.mat->ior);
     vec3 brdf;
     if (sample.x < F) {
         // sample specular
         const vec2 sample_mapped = vec2((F - sample.x) / F, sample.y);
         const auto [specular, w_i, sample_pdf] = spec.sample(hit, w_o, sample_mapped);
-        if (!same_hemisphere(hit.Ng, w_i)) return { vec3(0), w_i, 0.f };
+        if (!same_hemisphere(hit.Ng(), w_i)) return { vec3(0), w_i, 0.f };
         assert(std::isfinite(sample_pdf));
         return { mix(diff.f(hit, w_o, w_i), specular, F), w_i, mix(diff.pdf(hit, w_o, w_i), sample_pdf, F) };
     } else {
         // sample diffuse
         const vec2 sample_mapped = vec2((sample.x - F) / (1 - F), sample.y);
         const auto [diffuse, w_i, sample_pdf] = diff.sample(hit, w_o, sample_mapped);
-        if (!same_hemisphere(hit.Ng, w_i)) return { vec3(0), w_i, 0.f };
+        if (!same_hemisphere(hit.Ng(), w_i)) return { vec3(0), w_i, 0.f };
         assert(std::isfinite(sample_pdf));
         return { mix(diffuse, spec.f(hit, w_o, w_i), F), w_i, mix(sample_pdf, spec.pdf(hit, w_o, w_i), F) };
     }
 }
 
 float LayeredSurface::pdf(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    const float F = fresnel_dielectric(dot(hit.N, w_o), 1.f, hit.mat->ior);
+    const float F = fresnel_dielectric(dot(hit.N(), w_o), 1.f, hit.mat->ior);
     return mix(diff.pdf(hit, w_o, w_i), spec.pdf(hit, w_o, w_i), F);
 }
 
@@ -243,11 +243,11 @@ float LayeredSurface::pdf(const SurfaceHit& hit, const vec3& w_o, const vec3& w_
 // Metal
 
 vec3 MetallicSurface::f(const SurfaceHit& hit, const vec3& w_o, const vec3& w_i) const {
-    const float NdotV = dot(hit.N, w_o);
-    const float NdotL = dot(hit.N, w_i);
+    const float NdotV = dot(hit.N(), w_o);
+    const float NdotL = dot(hit.N(), w_i);
     if (NdotV <= 0.f || NdotL <= 0.f) return vec3(0);
     const vec3 H = normalize(w_o + w_i);
-    const float NdotH = dot(hit.N, H);
+    const float NdotH = dot(hit.N(), H);
     const float HdotL = dot(H, w_i);
     const float roughness = hit.roughness();
     const float F = fresnel_conductor(HdotL, hit.mat->ior, hit.mat->absorb);
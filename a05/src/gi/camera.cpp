@@ -32,13 +32,18 @@ Ray Camera::perspective_view_ray(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
     const glm::vec2 pixel = glm::vec2(x, y) + pixel_sample;
     const glm::vec2 ndch = (pixel - glm::vec2(w * .5f, h * .5f)) / glm::vec2(h);
     const float z = -.5f / tanf(.5f * M_PI * fov / 180.f);
-    return Ray(pos, eye_to_world * glm::normalize(glm::vec3(ndch.x, ndch.y, z)));
+    Ray ray(pos, eye_to_world * glm::normalize(glm::vec3(ndch.x, ndch.y, z)));
+    // ray cone spanning one pixel for filtered texture lookups
+    ray.cone_spread = 1.f / (-z * h);
+    return ray;
 }
 
 Ray Camera::environment_view_ray(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const glm::vec2& pixel_sample) const {
     const float theta = M_PI * (y + pixel_sample.y) / float(h);
     const float phi = 2 * M_PI * (x + pixel_sample.x) / float(w);
-    return Ray(pos, glm::vec3(sinf(theta) * cosf(phi), -cosf(theta), sinf(theta) * sinf(phi)));
+    Ray ray(pos, glm::vec3(sinf(theta) * cosf(phi), -cosf(theta), sinf(theta) * sinf(phi)));
+    ray.cone_spread = M_PI / h;
+    return ray;
 }
 
 void Camera::apply_DOF(Ray& ray, const glm::vec2& lens_sample) const {
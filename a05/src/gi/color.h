@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cmath>
+#include <vector>
+#include <algorithm>
 #include <glm/glm.hpp>
 
 // ---------------------------------------------
@@ -52,6 +55,51 @@ inline glm::vec3 srgb_to_xyz(const glm::vec3& srgb) {
     return rgb_to_xyz(srgb_to_rgb(srgb));
 }
 
+// ---------------------------------------------
+// blackbody radiation
+
+// spectral radiance of a blackbody via Planck's law (wavelength in nm, temperature in K, result in W / (m^2 sr nm))
+inline double planck(double lambda, double T) {
+    const double c = 299792458.0, h = 6.62607015e-34, kb = 1.380649e-23;
+    const double l = lambda * 1e-9;
+    return 2 * h * c * c / (l * l * l * l * l * (exp(h * c / (l * kb * T)) - 1)) * 1e-9;
+}
+
+// CIE 1931 color matching functions (multi-lobe fit from Wyman et al., "Simple Analytic Approximations to the CIE XYZ Color Matching Functions")
+inline glm::vec3 cie_xyz(float lambda) {
+    const auto g = [lambda](float mu, float s1, float s2) { const float t = (lambda - mu) / (lambda < mu ? s1 : s2); return expf(-.5f * t * t); };
+    return glm::vec3(1.056f * g(599.8f, 37.9f, 31.0f) + 0.362f * g(442.0f, 16.0f, 26.7f) - 0.065f * g(501.1f, 20.4f, 26.2f),
+                     0.821f * g(568.8f, 46.9f, 40.5f) + 0.286f * g(530.9f, 16.3f, 31.1f),
+                     1.217f * g(437.0f, 11.8f, 36.0f) + 0.681f * g(459.0f, 26.0f, 13.8f));
+}
+
+// linear RGB radiance of a blackbody at temperature T (in K), normalized such that a constant spectrum of 1 yields luma 1
+inline glm::vec3 blackbody_spectral(float T) {
+    if (T < 100.f) return glm::vec3(0); // no visible emission (and exp overflows)
+    glm::vec3 xyz(0);
+    for (float lambda = 380.f; lambda <= 780.f; lambda += 5.f)
+        xyz += float(planck(lambda, T)) * cie_xyz(lambda) * 5.f;
+    return glm::max(xyz_to_rgb(xyz / 106.856895f), glm::vec3(0)); // integral of the y matching function
+}
+
+// blackbody_spectral() from a table over log-spaced temperatures in [100K, 100000K], built once on first use
+// (linear interpolation, relative error below 0.1% above 1000K; temperatures above the table are integrated directly)
+inline glm::vec3 blackbody(float T) {
+    constexpr int N = 4096;
+    constexpr float T_min = 100.f, T_max = 100000.f;
+    if (T < T_min) return glm::vec3(0);
+    if (T >= T_max) return blackbody_spectral(T);
+    static const std::vector<glm::vec3> table = []() {
+        std::vector<glm::vec3> table(N);
+        for (int i = 0; i < N; ++i)
+            table[i] = blackbody_spectral(T_min * powf(T_max / T_min, i / float(N - 1)));
+        return table;
+    }();
+    const float x = logf(T / T_min) / logf(T_max / T_min) * (N - 1);
+    const int i = std::min(int(x), N - 2);
+    return glm::mix(table[i], table[i + 1], x - i);
+}
+
 // ---------------------------------------------
 // tonemapping
 
@@ -3,15 +3,54 @@
 #include "texture.h"
 #include "random.h"
 #include "color.h"
+#include "timer.h"
 #include <iostream>
 
+// ----------------------------------------------------
+// Alias table
+
+void build_alias_table(const float* f, uint32_t N, double integral, AliasBin* table) {
+    // split bins into under- and overfull ones and pair them up (Vose), scratch memory is reused per thread
+    thread_local std::vector<uint32_t> small, large;
+    thread_local std::vector<double> p;
+    small.clear();
+    large.clear();
+    p.resize(N);
+    for (uint32_t i = 0; i < N; ++i) {
+        p[i] = integral > 0 ? f[i] * N / integral : 1.0;
+        (p[i] < 1.0 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        const uint32_t s = small.back(), l = large.back();
+        small.pop_back();
+        table[s] = { float(p[s]), l };
+        p[l] = (p[l] + p[s]) - 1.0;
+        if (p[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // leftovers are full bins up to round off
+    for (const uint32_t i : large) table[i] = { 1.f, i };
+    for (const uint32_t i : small) table[i] = { 1.f, i };
+}
+
 // ----------------------------------------------------
 // Distribution1D
 
 Distribution1D::Distribution1D() : f_integral(0) {}
 
-Distribution1D::Distribution1D(const float* f, uint32_t N) : func(f, f + N), cdf(N + 1) {
+Distribution1D::Distribution1D(const float* f, uint32_t N, bool alias_table) : func(f, f + N) {
+    f_integral = 0;
+    for (uint32_t i = 0; i < N; ++i)
+        f_integral += func[i];
+    if (alias_table) {
+        alias.resize(N);
+        build_alias_table(func.data(), N, f_integral, alias.data());
+        return;
+    }
     // build non-normalized cdf in [0, N)
+    cdf.resize(N + 1);
     cdf[0] = 0;
     for (uint32_t i = 1; i < N + 1; ++i)
         cdf[i] = cdf[i - 1] + func[i - 1];
@@ -43,7 +82,17 @@ float Distribution1D::pdf(size_t index) const {
 }
 
 std::tuple<float, float> Distribution1D::sample_01(float sample) const {
+    const auto [offset, du, pdf] = sample_bin(sample);
+    return { (offset + du) / float(func.size()), pdf };
+}
+
+std::tuple<uint32_t, float, float> Distribution1D::sample_bin(float sample) const {
     assert(sample >= 0 && sample < 1);
+    if (is_alias()) {
+        const auto [offset, du] = sample_alias_table(alias.data(), alias.size(), sample);
+        const float pdf = f_integral > 0 ? func[offset] / unit_integral() : 0.f;
+        return { offset, du, pdf };
+    }
     const uint32_t offset = glm::max(0, int(std::lower_bound(cdf.begin(), cdf.end(), sample) - cdf.begin()) - 1);
     assert(offset <= size());
     assert(sample <= cdf[offset+1]);
@@ -52,11 +101,15 @@ std::tuple<float, float> Distribution1D::sample_01(float sample) const {
         du /= (cdf[offset + 1] - cdf[offset]);
     const float pdf = f_integral > 0 ? func[offset] / unit_integral() : 0.f;
     assert(std::isfinite(pdf));
-    return { (offset + du) / float(func.size()), pdf };
+    return { offset, du, pdf };
 }
 
 std::tuple<uint32_t, float> Distribution1D::sample_index(float sample) const {
     assert(sample >= 0 && sample < 1);
+    if (is_alias()) {
+        const uint32_t offset = std::get<0>(sample_alias_table(alias.data(), alias.size(), sample));
+        return { offset, f_integral > 0 ? func[offset] / integral() : 0.f };
+    }
     const uint32_t offset = glm::max(0, int(std::lower_bound(cdf.begin(), cdf.end(), sample) - cdf.begin()) - 1);
     assert(offset <= size());
     assert(sample <= cdf[offset+1]);
@@ -68,14 +121,19 @@ std::tuple<uint32_t, float> Distribution1D::sample_index(float sample) const {
 // ----------------------------------------------------
 // Distribution2D
 
-Distribution2D::Distribution2D(const float* f, uint32_t w, uint32_t h) {
-    for (uint32_t y = 0; y < h; ++y)
-        conditional.push_back(Distribution1D(&f[y * w], w));
-    std::vector<float> marginal_func;
-    marginal_func.reserve(h);
-    for (uint32_t y = 0; y < h; ++y)
-        marginal_func.push_back(conditional[y].integral());
-    marginal = Distribution1D(marginal_func.data(), h);
+Distribution2D::Distribution2D(const float* f, uint32_t w, uint32_t h) : w(w), h(h), func(f, f + size_t(w) * h), conditional(size_t(w) * h) {
+    // build row alias tables in parallel
+    std::vector<float> row_integral(h);
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int y = 0; y < int(h); ++y) {
+        const float* row = &func[size_t(y) * w];
+        double integral = 0;
+        for (uint32_t x = 0; x < w; ++x)
+            integral += row[x];
+        build_alias_table(row, w, integral, &conditional[size_t(y) * w]);
+        row_integral[y] = integral;
+    }
+    marginal = Distribution1D(row_integral.data(), h, true);
 }
 
 Distribution2D::~Distribution2D() {}
@@ -85,23 +143,27 @@ double Distribution2D::integral() const {
 }
 
 double Distribution2D::unit_integral() const {
-    return marginal.integral() / (marginal.size() * conditional[0].size());
+    return marginal.integral() / (double(w) * h);
 }
 
 std::tuple<glm::vec2, float> Distribution2D::sample_01(const glm::vec2& sample) const {
     assert(sample.x >= 0 && sample.x < 1); assert(sample.y >= 0 && sample.y < 1);
-    const auto [y, pdf_y] = marginal.sample_01(sample.y);
-    const auto [x, pdf_x] = conditional[uint32_t(y * marginal.size())].sample_01(sample.x);
+    // take the row from the discrete marginal index, (row + dv) / h may round into the next row
+    const auto [row, dv, pdf_y] = marginal.sample_bin(sample.y);
+    const auto [x, du] = sample_alias_table(&conditional[size_t(row) * w], w, sample.x);
+    const double row_integral = marginal.f(row);
+    const float pdf_x = row_integral > 0 ? func[size_t(row) * w + x] * w / row_integral : 0.f;
     const float pdf = pdf_y * pdf_x;
     assert(std::isfinite(pdf));
-    return { glm::vec2(x, y), pdf };
+    return { glm::vec2((x + du) / float(w), (row + dv) / float(h)), pdf };
 }
 
 float Distribution2D::pdf(const glm::vec2& sample) const {
     assert(sample.x >= 0 && sample.x < 1); assert(sample.y >= 0 && sample.y < 1);
-    const int x = glm::clamp(int(sample.x * conditional[0].size()), 0, int(conditional[0].size()) - 1);
-    const int y = glm::clamp(int(sample.y * marginal.size()), 0, int(marginal.size()) - 1);
-    return conditional[y].f(x) / marginal.integral();
+    const int x = glm::clamp(int(sample.x * w), 0, int(w) - 1);
+    const int y = glm::clamp(int(sample.y * h), 0, int(h) - 1);
+    const double integral = unit_integral();
+    return integral > 0 ? func[size_t(y) * w + x] / integral : 0.f;
 }
 
 // ----------------------------------------------------
@@ -219,3 +281,29 @@ void debug_distributions() {
         plot_heatmap(dist, W, H);
     }
 }
+
+void perform_distribution_benchmarks() {
+    const uint32_t num_samples = 10000000;
+    for (uint32_t N : { 16u, 1024u, 65536u, 1048576u }) {
+        // random function values, e.g. triangle areas or light source powers
+        std::vector<float> values(N);
+        for (uint32_t i = 0; i < N; ++i)
+            values[i] = RNG::uniform<float>() * RNG::uniform<float>();
+        std::vector<float> samples(num_samples);
+        for (uint32_t i = 0; i < num_samples; ++i)
+            samples[i] = RNG::uniform<float>();
+        for (const bool alias : { false, true }) {
+            Timer timer;
+            timer.start("build");
+            const Distribution1D dist(values.data(), N, alias);
+            timer.stop("build");
+            timer.start("sample");
+            uint64_t sum = 0;
+            for (uint32_t i = 0; i < num_samples; ++i)
+                sum += std::get<0>(dist.sample_index(samples[i]));
+            timer.stop("sample");
+            printf("Distribution1D (%s), N = %7u: build: %.3fms, sample_index: %.2fns (checksum: %lu)\n",
+                alias ? "alias" : "cdf  ", N, timer.get_ms("build"), timer.get_ns("sample") / double(num_samples), sum);
+        }
+    }
+}
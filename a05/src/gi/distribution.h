@@ -4,8 +4,51 @@
 #include <vector>
 #include <memory>
 #include <cstdint>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
 #include <glm/glm.hpp>
 
+/**
+ * @brief Entry of an alias table (Vose's alias method)
+ */
+struct AliasBin {
+    float q;            ///< Probability to keep this bin
+    uint32_t alias;     ///< Bin to select otherwise
+};
+
+/**
+ * @brief Build an alias table over N function values
+ *
+ * @param f function values
+ * @param N function length
+ * @param integral Sum over all function values
+ * @param table Output array of N alias bins
+ */
+void build_alias_table(const float* f, uint32_t N, double integral, AliasBin* table);
+
+/**
+ * @brief Select a bin from an alias table in O(1)
+ *
+ * @param table Alias table
+ * @param N Number of bins
+ * @param sample Uniform random sample in [0, 1)
+ *
+ * @return Tuple consisting of:
+ *      - Selected bin (uint)
+ *      - Remapped uniform random sample in [0, 1) (float)
+ */
+inline std::tuple<uint32_t, float> sample_alias_table(const AliasBin* table, uint32_t N, float sample) {
+    const float x = sample * N;
+    const uint32_t i = std::min(uint32_t(x), N - 1);
+    const float u = x - i;
+    const AliasBin& bin = table[i];
+    // reuse the fraction within the bin as new uniform sample
+    if (u < bin.q)
+        return { i, u / bin.q };
+    return { bin.alias, fminf((u - bin.q) / (1.f - bin.q), 0.99999f) };
+}
+
 /**
  * @brief 1D distribution for importance sampling an arbitrary discrete 1D function
  */
@@ -18,13 +61,15 @@ public:
      *
      * @param f function values
      * @param n function length
+     * @param alias Build an alias table (Vose) for O(1) sampling instead of a CDF for binary search
      */
-    Distribution1D(const float *f, uint32_t N);
+    Distribution1D(const float *f, uint32_t N, bool alias = false);
 
     virtual ~Distribution1D();
 
     inline float f(size_t i) const { assert(i < size()); return func[i]; }
     inline uint32_t size() const { return func.size(); }
+    inline bool is_alias() const { return !alias.empty(); }
 
     /**
      * @brief Compute absolute integral over the discrete function
@@ -60,6 +105,7 @@ public:
 
     /**
      * @brief Compute an importance sampled coordinate in [0, 1) from an uniform sample
+     * @note In alias mode, the mapping from sample to coordinate is not monotonic.
      *
      * @param sample Uniform random sample in [0, 1)
      *
@@ -80,14 +126,29 @@ public:
      */
     std::tuple<uint32_t, float> sample_index(float sample) const;
 
+    /**
+     * @brief Compute an importance sampled index in [0, N) and the position within its bin from an uniform sample
+     * @note sample_01() returns (index + position) / N, this keeps the index exact for nested sampling.
+     *
+     * @param sample Uniform random sample in [0, 1)
+     *
+     * @return Tuple consisting of:
+     *      - Importance sampled index in [0, N) (uint)
+     *      - Remapped uniform sample within the bin in [0, 1) (float)
+     *      - PDF of the sampled coordinate in [0, 1) (float)
+     */
+    std::tuple<uint32_t, float, float> sample_bin(float sample) const;
+
 private:
     // data
     std::vector<float> func, cdf;
+    std::vector<AliasBin> alias;
     double f_integral;
 };
 
 /**
  * @brief 2D distribution for importance sampling an arbitrary discrete 2D function
+ * @note All rows share one flat alias table, which is built in parallel. Sampling is O(1) in both dimensions.
  */
 class Distribution2D {
 public:
@@ -129,15 +190,21 @@ public:
      */
     float pdf(const glm::vec2& sample) const;
 
+    inline uint32_t width() const { return w; }
+    inline uint32_t height() const { return h; }
+
 private:
     // data
-    std::vector<Distribution1D> conditional;
-    Distribution1D marginal;
+    uint32_t w, h;                      ///< Function dimensions
+    std::vector<float> func;            ///< Function values (w * h)
+    std::vector<AliasBin> conditional;  ///< Per-row alias tables (w * h)
+    Distribution1D marginal;            ///< Alias distribution over row integrals
 };
 
 // ----------------------------------------------------
 // Debug utilities
 
 void debug_distributions();
+void perform_distribution_benchmarks();
 void plot_histogram(const Distribution1D& dist);
 void plot_heatmap(const Distribution2D& dist, uint32_t w, uint32_t h);
@@ -1,62 +1,70 @@
 #include "hit.h"
 #include "brdf.h"
+#include "instance.h"
+#include "scene.h"
+#include "rng.h"
 #include "timer.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
 
 // ---------------------------------------------------------
 // SurfaceHit
 
-SurfaceHit::SurfaceHit(const SkyLight* sky) : Hit(false), light(sky) {}
+SurfaceHit::SurfaceHit(const SkyLight* sky) : Hit(false), P(0), uv(0), primID(0), mesh(0), mat(0), light(sky), instance(0), cone_dir(0), cone_width(0), texture_lod(-FLT_MAX), has_lod(true), geometry_N(0), tex_coord(0), shading_N(0), has_Ng(true), has_TC(true), has_N(true) {}
 
-SurfaceHit::SurfaceHit(const Ray& ray, const Mesh* mesh) : Hit(true), mesh(mesh), mat(mesh->mat.get()), light(0) {
+SurfaceHit::SurfaceHit(const Ray& ray, const Mesh* mesh, const Instance* instance)
+    : Hit(true), P(ray.org + ray.tfar * ray.dir), uv(ray.u, ray.v), primID(ray.primID), mesh(mesh), mat(mesh->mat.get()),
+    light(mesh->is_light() && !instance ? mesh->area_light.get() : 0), instance(instance), cone_dir(ray.dir),
+    cone_width(ray.cone_width + ray.cone_spread * ray.tfar), texture_lod(-FLT_MAX), has_lod(cone_width <= 0.f || mesh->uv_areas.empty()),
+    has_Ng(false), has_TC(false), has_N(false) {
     assert(mesh); assert(mat);
-    STAT("hit point lerp");
-    // fetch indices and baryzentric coords
-    const glm::uvec3& tri = mesh->ibo[ray.primID];
-    const float u = ray.u;
-    const float v = ray.v;
-    const float w = 1.f - u - v;
-    // compute position
-    P = ray.org + ray.tfar * ray.dir;
-    // interpolate normal
-    Ng = w * mesh->normals[tri[0]] + u * mesh->normals[tri[1]] + v * mesh->normals[tri[2]];
-    // interpolate texcoord
-    if (!mesh->tcs.empty())
-        TC = w * mesh->tcs[tri[0]] + u * mesh->tcs[tri[1]] + v * mesh->tcs[tri[2]];
-    // compute hit primitive area
-    area = 0.5 * glm::length(glm::cross(mesh->vbo[tri[1]] - mesh->vbo[tri[0]], mesh->vbo[tri[2]] - mesh->vbo[tri[0]]));
-    // apply normalmapping
-    N = mat->normalmap(Ng, TC);
-    // light source hit?
-    if (mesh->is_light())
-        light = mesh->area_light.get();
 }
 
-SurfaceHit::SurfaceHit(const glm::vec2& sample, uint32_t primID, const Mesh* mesh) : Hit(true), mesh(mesh), mat(mesh->mat.get()), light(0) {
+SurfaceHit::SurfaceHit(const glm::vec2& sample, uint32_t primID, const Mesh* mesh)
+    : Hit(true), uv(uniform_sample_triangle(sample)), primID(primID), mesh(mesh), mat(mesh->mat.get()),
+    light(mesh->is_light() ? mesh->area_light.get() : 0), instance(0), cone_dir(0), cone_width(0), texture_lod(-FLT_MAX), has_lod(true),
+    has_Ng(false), has_TC(false), has_N(false) {
     assert(mesh); assert(mat);
     STAT("mesh surface sample");
-    // fetch indices and baryzentric coords
-    const glm::uvec3& tri = mesh->ibo[primID];
-    const glm::vec2 uv = uniform_sample_triangle(sample);
-    const float u = uv.x;
-    const float v = uv.y;
-    const float w = 1.f - u - v;
     // interpolate position
-    P = w * mesh->vbo[tri[0]] + u * mesh->vbo[tri[1]] + v * mesh->vbo[tri[2]];
-    // interpolate normal
-    Ng = w * mesh->normals[tri[0]] + u * mesh->normals[tri[1]] + v * mesh->normals[tri[2]];
-    // interpolate texcoord
-    if (!mesh->tcs.empty())
-        TC = w * mesh->tcs[tri[0]] + u * mesh->tcs[tri[1]] + v * mesh->tcs[tri[2]];
-    // compute hit primitive area
-    area = 0.5 * glm::length(glm::cross(mesh->vbo[tri[1]] - mesh->vbo[tri[0]], mesh->vbo[tri[2]] - mesh->vbo[tri[0]]));
-    // apply normalmapping
-    N = mat->normalmap(Ng, TC);
-    // light source hit?
-    if (mesh->is_light())
-        light = mesh->area_light.get();
+    const glm::uvec3& tri = mesh->ibo[primID];
+    P = (1.f - uv.x - uv.y) * mesh->vbo[tri[0]] + uv.x * mesh->vbo[tri[1]] + uv.y * mesh->vbo[tri[2]];
 }
 
-SurfaceHit::SurfaceHit(const glm::vec3& position, const glm::vec3& normal) : Hit(true), P(position), Ng(normal), N(normal), TC(0), area(0), mesh(0), mat(0), light(0) {}
+SurfaceHit::SurfaceHit(const glm::vec3& position, const glm::vec3& normal)
+    : Hit(true), P(position), uv(0), primID(0), mesh(0), mat(0), light(0), instance(0), cone_dir(0), cone_width(0), texture_lod(-FLT_MAX), has_lod(true),
+    geometry_N(normal), tex_coord(0), shading_N(normal), has_Ng(true), has_TC(true), has_N(true) {}
+
+glm::vec3 SurfaceHit::interpolate_Ng() const {
+    STAT("hit normal lerp");
+    const glm::uvec3& tri = mesh->ibo[primID];
+    const glm::vec3 Ng = (1.f - uv.x - uv.y) * mesh->normal(tri[0]) + uv.x * mesh->normal(tri[1]) + uv.y * mesh->normal(tri[2]);
+    // transform from object to world space for instanced geometry
+    return instance ? glm::normalize(instance->normal_matrix * Ng) : Ng;
+}
+
+glm::vec2 SurfaceHit::interpolate_TC() const {
+    if (!mesh->has_tcs()) return glm::vec2(0);
+    const glm::uvec3& tri = mesh->ibo[primID];
+    return (1.f - uv.x - uv.y) * mesh->tc(tri[0]) + uv.x * mesh->tc(tri[1]) + uv.y * mesh->tc(tri[2]);
+}
+
+float SurfaceHit::area() const {
+    if (!mesh) return 0.f;
+    if (!instance) return mesh->areas[primID];
+    // transform from object to world space for instanced geometry
+    return mesh->areas[primID] * fabsf(instance->det) * glm::length(instance->normal_matrix * mesh->face_normals[primID]);
+}
+
+float SurfaceHit::cone_lod() const {
+    // texture footprint from the ray cone width at the hit point (Akenine-Moeller et al., "Improved Shader and Texture Level of Detail Using Ray Cones")
+    const float A = area();
+    if (A <= 0.f || mesh->uv_areas[primID] <= 0.f) return -FLT_MAX;
+    const glm::vec3 N = instance ? glm::normalize(instance->normal_matrix * mesh->face_normals[primID]) : mesh->face_normals[primID];
+    const float cos_t = fmaxf(fabsf(glm::dot(N, cone_dir)), 1e-2f);
+    return .5f * log2f(mesh->uv_areas[primID] / A) + log2f(cone_width / cos_t);
+}
 
 glm::vec3 SurfaceHit::f(const glm::vec3& w_o, const glm::vec3& w_i) const {
     assert(mat);
@@ -106,3 +114,43 @@ float VolumeHit::pdf(const glm::vec3& w_o, const glm::vec3& w_i) const {
     STAT("Phase pdf");
     return phase_henyey_greenstein(glm::dot(w_o, w_i), volume->phase_g);
 }
+
+// ---------------------------------------------------------
+// benchmarks
+
+void perform_hit_benchmarks(const Scene& scene, uint32_t num_rays) {
+    // random rays from the bounding sphere towards the scene center, traversed once up front
+    std::vector<Ray> rays;
+    for (uint32_t i = 0; i < num_rays; ++i) {
+        const glm::vec3 org = scene.center + scene.radius * uniform_sample_sphere(RNG::uniform<glm::vec2>());
+        const glm::vec3 dir = glm::normalize(scene.center + .5f * scene.radius * uniform_sample_sphere(RNG::uniform<glm::vec2>()) - org);
+        rays.emplace_back(org, dir);
+    }
+    scene.intersect(rays.data(), rays.size());
+    rays.erase(std::remove_if(rays.begin(), rays.end(), [](const Ray& ray) { return !ray; }), rays.end());
+    if (rays.empty()) {
+        std::cerr << "Warning: no hits for hit benchmarks" << std::endl;
+        return;
+    }
+
+    // time hit construction with increasing attribute access, the last case matches the former eager interpolation
+    const auto run = [&](const char* label, int attributes) {
+        Timer timer;
+        timer.start("hit");
+        float sum = 0.f;
+        for (const Ray& ray : rays) {
+            const SurfaceHit hit = scene.surface_hit(ray);
+            sum += hit.P.x;
+            if (attributes > 0) sum += hit.N().x;
+            if (attributes > 1) sum += hit.TC().x + hit.area();
+            if (attributes > 2) sum += hit.Ng().x + hit.TC().y + hit.albedo().x; // Ng and TC are cached by now
+        }
+        timer.stop("hit");
+        printf("SurfaceHit %-20s %.2fns/hit (checksum: %f)\n", label, timer.get_ns("hit") / double(rays.size()), sum);
+    };
+    printf("Hit benchmarks: %zu hits, sizeof(SurfaceHit) = %zu bytes\n", rays.size(), sizeof(SurfaceHit));
+    run("(construct):", 0);
+    run("(+ N):", 1);
+    run("(+ N, TC, area):", 2);
+    run("(+ Ng, TC, albedo):", 3);
+}
@@ -10,6 +10,9 @@
 #include "material.h"
 #include "sampling.h"
 
+class Instance;
+class Scene;
+
 // ---------------------------------------------------------
 // The Hit interface provides an abstraction layer over surface and volume interactions.
 
@@ -58,14 +61,17 @@ public:
 
 // ---------------------------------------------------------
 // The SurfaceHit class provides an abstraction layer over surface interactions and materials.
+// Only the hit record (position, primitive and barycentrics) is stored, surface attributes are interpolated on demand,
+// so that misses, light hits and terminated paths do not pay for normals, texcoords or normalmapping.
 
 class SurfaceHit : public Hit {
 public:
     // Default construct as invalid surface interaction with an optional sky light contribution on miss
     SurfaceHit(const SkyLight* sky = 0);
 
-    // Construct as ray surface interaction and perform hit point interpolation
-    SurfaceHit(const Ray& ray, const Mesh* mesh);
+    // Construct as ray surface interaction (attributes are interpolated lazily)
+    // For hits on instanced geometry, normals and area are transformed to world space (instanced meshes are never light sources)
+    SurfaceHit(const Ray& ray, const Mesh* mesh, const Instance* instance = 0);
 
     // Construct as mesh sample, for example when sampling a mesh light source
     SurfaceHit(const glm::vec2& sample, uint32_t primID, const Mesh* mesh);
@@ -105,16 +111,56 @@ public:
      */
     float pdf(const glm::vec3& w_o, const glm::vec3& w_i) const;
 
+    // World space (interpolated) geometry normal, computed on first access
+    inline const glm::vec3& Ng() const {
+        if (!has_Ng) {
+            geometry_N = interpolate_Ng();
+            has_Ng = true;
+        }
+        return geometry_N;
+    }
+
+    // World space shading normal (including normalmapping), computed on first access
+    inline const glm::vec3& N() const {
+        if (!has_N) {
+            assert(mat);
+            shading_N = mat->normalmap(Ng(), TC(), lod());
+            has_N = true;
+        }
+        return shading_N;
+    }
+
+    // Texture coordinates, or glm::vec2(0) if none available, computed on first access
+    inline const glm::vec2& TC() const {
+        if (!has_TC) {
+            tex_coord = interpolate_TC();
+            has_TC = true;
+        }
+        return tex_coord;
+    }
+
+    // Hit primitive surface area
+    float area() const;
+
+    // Log2 of the ray cone footprint in texture coordinates for filtered texture lookups, computed on first access
+    inline float lod() const {
+        if (!has_lod) {
+            texture_lod = cone_lod();
+            has_lod = true;
+        }
+        return texture_lod;
+    }
+
     // Compute surface color (albedo)
     inline glm::vec3 albedo() const {
         assert(mat);
-        return mat->albedo(TC);
+        return mat->albedo(TC(), lod());
     }
 
     // Compute surface roughness
     inline float roughness() const {
         assert(mat);
-        return mat->roughness(TC);
+        return mat->roughness(TC(), lod());
     }
 
     // Check whether hit is light source
@@ -123,7 +169,7 @@ public:
     // Query emitted light of emissive material
     inline glm::vec3 Le() const {
         assert(mat);
-        return mat->emissive(TC);
+        return mat->emissive(TC(), lod());
     }
 
     // Check type of surface interaction (based on underlying BRDF type)
@@ -135,27 +181,49 @@ public:
     // Convert direction from world to tangent space at this surface interaction
     inline glm::vec3 to_tangent(const glm::vec3& world_dir) const {
         assert(valid);
-        return world_to_tangent(N, world_dir);
+        return world_to_tangent(N(), world_dir);
     }
 
     // Convert direction from tangent to world space at this surface interaction
     inline glm::vec3 to_world(const glm::vec3& tangent_dir) const     {
         assert(valid);
-        return tangent_to_world(N, tangent_dir);
+        return tangent_to_world(N(), tangent_dir);
     }
 
     // data
     // const bool valid;       ///< Use this to check for a valid surface of volume interaction
-    glm::vec3 P;            ///< World space position
-    glm::vec3 Ng;           ///< World space geometry normal
-    glm::vec3 N;            ///< World space shading normal (including normalmapping)
-    glm::vec2 TC;           ///< Texture coordinates, or glm::vec2(0) if none available
-    float area;             ///< Hit primitive surface area
-    const Mesh* mesh;       ///< Mesh pointer, may be 0 for abstract surfaces
-    const Material* mat;    ///< Material pointer, may be 0 for abstract surfaces
-    const Light* light;     ///< Light source pointer, set if a light source was hit (type is: valid ? AreaLight : SkyLight)
+    glm::vec3 P;                ///< World space position
+    glm::vec2 uv;               ///< Barycentric coordinates of P in the hit primitive
+    uint32_t primID;            ///< Hit primitive (triangle) of the mesh
+    const Mesh* mesh;           ///< Mesh pointer, may be 0 for abstract surfaces
+    const Material* mat;        ///< Material pointer, may be 0 for abstract surfaces
+    const Light* light;         ///< Light source pointer, set if a light source was hit (type is: valid ? AreaLight : SkyLight)
+    const Instance* instance;   ///< Instance pointer, set for hits on instanced geometry
+private:
+    glm::vec3 interpolate_Ng() const;
+    glm::vec2 interpolate_TC() const;
+    float cone_lod() const;
+
+    glm::vec3 cone_dir;             ///< Direction of the hitting ray
+    float cone_width;               ///< Ray cone width at P, <= 0 disables texture filtering
+    mutable float texture_lod;      ///< Cached texture footprint, see lod()
+    mutable bool has_lod;           ///< Is texture_lod valid?
+    mutable glm::vec3 geometry_N;   ///< Cached geometry normal, or normal of abstract surfaces
+    mutable glm::vec2 tex_coord;    ///< Cached texture coordinates
+    mutable glm::vec3 shading_N;    ///< Cached shading normal, or normal of abstract surfaces
+    mutable bool has_Ng;            ///< Is geometry_N valid?
+    mutable bool has_TC;            ///< Is tex_coord valid?
+    mutable bool has_N;             ///< Is shading_N valid?
 };
 
+/**
+ * @brief Measure the cost of ray surface hit construction and lazy attribute access
+ *
+ * @param scene Committed scene to cast random rays into
+ * @param num_rays Number of rays
+ */
+void perform_hit_benchmarks(const Scene& scene, uint32_t num_rays = 1000000);
+
 // ---------------------------------------------------------
 // The VolumeHit class provides an abstraction layer over volume interactions and materials.
 
@@ -0,0 +1,66 @@
+#include "instance.h"
+#include "mesh.h"
+
+#include <cfloat>
+
+// ---------------------------------------------------------
+// Prototype
+
+Prototype::Prototype(RTCDevice& device, const std::filesystem::path& path)
+    : path(path), scene(rtcNewScene(device)), bb_min(FLT_MAX), bb_max(-FLT_MAX), build_quality(RTCBuildQuality(-1)), num_attached(0) {}
+
+Prototype::~Prototype() {
+    // meshes detach from the prototype scene, so release them first
+    meshes.clear();
+    rtcReleaseScene(scene);
+}
+
+void Prototype::commit(RTCBuildQuality quality) {
+    // nothing to rebuild, e.g. if only other geometry of the scene changed
+    if (quality == build_quality && num_attached == meshes.size()) return;
+    for (auto& mesh : meshes) {
+        if (mesh->geomID == uint32_t(-1)) {
+            mesh->attach();
+            bb_min = glm::min(bb_min, mesh->bb_min);
+            bb_max = glm::max(bb_max, mesh->bb_max);
+        }
+        if (mesh->build_quality != quality)
+            mesh->commit(quality);
+    }
+    rtcSetSceneBuildQuality(scene, quality == RTC_BUILD_QUALITY_REFIT ? RTC_BUILD_QUALITY_LOW : quality);
+    rtcCommitScene(scene);
+    build_quality = quality;
+    num_attached = meshes.size();
+}
+
+Mesh* Prototype::get_mesh(uint32_t geomID) const {
+    assert(geomID != RTC_INVALID_GEOMETRY_ID);
+    return (Mesh*) rtcGetGeometryUserData(rtcGetGeometry(scene, geomID));
+}
+
+// ---------------------------------------------------------
+// Instance
+
+Instance::Instance(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Prototype>& prototype, const glm::mat4& transform)
+    : geom(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_INSTANCE)), instID(-1), scene(scene), prototype(prototype), transform(transform),
+    normal_matrix(glm::transpose(glm::inverse(glm::mat3(transform)))), det(glm::determinant(glm::mat3(transform))), bb_min(FLT_MAX), bb_max(-FLT_MAX) {
+    // world space AABB from the transformed corners of the prototype AABB
+    for (uint32_t i = 0; i < 8; ++i) {
+        const glm::vec3 corner((i & 1) ? prototype->bb_max.x : prototype->bb_min.x, (i & 2) ? prototype->bb_max.y : prototype->bb_min.y, (i & 4) ? prototype->bb_max.z : prototype->bb_min.z);
+        const glm::vec3 world = glm::vec3(transform * glm::vec4(corner, 1.f));
+        bb_min = glm::min(bb_min, world);
+        bb_max = glm::max(bb_max, world);
+    }
+    // tell embree about the instance
+    rtcSetGeometryInstancedScene(geom, prototype->scene);
+    rtcSetGeometryTimeStepCount(geom, 1);
+    rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, &this->transform[0][0]);
+    rtcSetGeometryUserData(geom, this);
+    rtcCommitGeometry(geom);
+    instID = rtcAttachGeometry(scene, geom);
+}
+
+Instance::~Instance() {
+    rtcDetachGeometry(scene, instID);
+    rtcReleaseGeometry(geom);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <embree4/rtcore.h>
+#include <glm/glm.hpp>
+
+class Mesh;
+
+/**
+ * @brief Shared geometry of an instanced mesh file, kept in its own embree scene
+ */
+class Prototype {
+public:
+    Prototype(RTCDevice& device, const std::filesystem::path& path);
+    ~Prototype();
+
+    Prototype(const Prototype&)            = delete;
+    Prototype& operator=(const Prototype&) = delete;
+
+    /**
+     * @brief Attach all meshes and build the BVH of the prototype scene
+     * @note Returns early if neither the quality nor the set of meshes changed since the last commit
+     *
+     * @param quality Embree build quality (REFIT uses a LOW quality scene build, see Scene::BVH_QUALITY)
+     */
+    void commit(RTCBuildQuality quality);
+
+    /**
+     * @brief Translate a geometry ID of the prototype scene into a mesh pointer
+     *
+     * @param geomID Geometry ID to translate, e.g. Ray::geomID of an instance hit
+     *
+     * @return Mesh pointer
+     */
+    Mesh* get_mesh(uint32_t geomID) const;
+
+    // data
+    std::filesystem::path path;                         ///< File path of the mesh file (as given)
+    RTCScene scene;                                     ///< Embree scene of the prototype
+    std::vector<std::shared_ptr<Mesh>> meshes;          ///< Meshes of the prototype (in object space)
+    glm::vec3 bb_min;                                   ///< AABB in object space (lower left corner)
+    glm::vec3 bb_max;                                   ///< AABB in object space (upper right corner)
+    RTCBuildQuality build_quality;                      ///< Embree build quality of the last commit, invalid before the first
+    size_t num_attached;                                ///< Number of meshes attached on the last commit
+};
+
+/**
+ * @brief Placement of a prototype in the scene via an embree instance geometry
+ */
+class Instance {
+public:
+    Instance(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Prototype>& prototype, const glm::mat4& transform);
+    ~Instance();
+
+    Instance(const Instance&)            = delete;
+    Instance& operator=(const Instance&) = delete;
+
+    // data
+    RTCGeometry geom;                                   ///< Embree instance geometry
+    uint32_t instID;                                    ///< Embree geometry ID in the top level scene, i.e. Ray::instID
+    RTCScene& scene;                                    ///< Embree top level scene
+    std::shared_ptr<Prototype> prototype;               ///< Instanced geometry
+    glm::mat4 transform;                                ///< Object to world transform
+    glm::mat3 normal_matrix;                            ///< Object to world transform for normals
+    float det;                                          ///< Determinant of the linear part of the transform
+    glm::vec3 bb_min;                                   ///< AABB in world space (lower left corner)
+    glm::vec3 bb_max;                                   ///< AABB in world space (upper right corner)
+};
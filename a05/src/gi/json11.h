@@ -237,6 +237,9 @@ protected:
 
 #include <fstream>
 #include <sstream>
+#include <cmath>
+#include <limits>
+#include <cstdint>
 #include <glm/glm.hpp>
 
 // -----------------------------------------
@@ -275,9 +278,19 @@ inline void json_set_uint(const json11::Json& cfg, const char* key, uint32_t& va
     if (cfg[key].is_number())
         value = uint32_t(cfg[key].int_value());
 }
+// convert to an unsigned integer type, clamping to its range (converting a negative or out-of-range double is undefined)
+template <typename T> inline T json_clamp_unsigned(double value) {
+    // 2^digits is exact as a double, while the maximum of 64 bit types is not (it rounds up to 2^64)
+    if (value >= std::ldexp(1.0, std::numeric_limits<T>::digits)) return std::numeric_limits<T>::max();
+    return value > 0.0 ? T(value) : T(0);
+}
 inline void json_set_size(const json11::Json& cfg, const char* key, size_t& value) {
     if (cfg[key].is_number())
-        value = size_t(cfg[key].int_value());
+        value = json_clamp_unsigned<size_t>(cfg[key].number_value());
+}
+inline void json_set_uint64(const json11::Json& cfg, const char* key, uint64_t& value) {
+    if (cfg[key].is_number())
+        value = json_clamp_unsigned<uint64_t>(cfg[key].number_value());
 }
 inline void json_set_float(const json11::Json& cfg, const char* key, float& value) {
     if (cfg[key].is_number())
@@ -9,7 +9,9 @@
 #include "distribution.h"
 #include "timer.h"
 #include "color.h"
+#include "volume.h"
 #include <iostream>
+#include <algorithm>
 
 // ------------------------------------------------
 // Mesh area light
@@ -25,18 +27,34 @@ std::tuple<glm::vec3, Ray, float> AreaLight::sample_Li(const glm::vec3& position
     glm::vec3 l = light.P - position;
     const float r = length(l);
     l = normalize(l);
-    const float cos_t_light = dot(light.N, -l);
+    const float cos_t_light = dot(light.N(), -l);
     if (cos_t_light <= 0.f) return { glm::vec3(0.f), Ray(), 0.f };
-    const float pdf = sample_pdf * (r * r) / (cos_t_light * light.area);
+    const float pdf = sample_pdf * (r * r) / (cos_t_light * light.area());
+    assert(std::isfinite(pdf));
+    return { light.Le(), Ray(position, l, r), pdf };
+}
+
+std::tuple<glm::vec3, Ray, float> AreaLight::sample_Li(const glm::vec3& position, uint32_t primID, const glm::vec2& sample) const {
+    assert(sample.x >= 0 && sample.x < 1); assert(sample.y >= 0 && sample.y < 1);
+    STAT("sampleLi");
+    // uniformly sample the given triangle
+    const SurfaceHit light(sample, primID, &mesh);
+    if (light.area() <= 0.f) return { glm::vec3(0.f), Ray(), 0.f };
+    glm::vec3 l = light.P - position;
+    const float r = length(l);
+    l = normalize(l);
+    const float cos_t_light = dot(light.N(), -l);
+    if (cos_t_light <= 0.f) return { glm::vec3(0.f), Ray(), 0.f };
+    const float pdf = (r * r) / (cos_t_light * light.area());
     assert(std::isfinite(pdf));
     return { light.Le(), Ray(position, l, r), pdf };
 }
 
 float AreaLight::pdf_Li(const SurfaceHit& light, const Ray& ray) const {
-    assert(light.valid && light.mesh && light.area > 0);
-    const float cos_t = dot(light.N, -ray.dir);
+    assert(light.valid && light.mesh && light.area() > 0);
+    const float cos_t = dot(light.N(), -ray.dir);
     if (cos_t <= 0.f) return 0.f;
-    return (ray.tfar * ray.tfar) / (cos_t * light.area);
+    return (ray.tfar * ray.tfar) / (cos_t * light.area());
 }
 
 std::tuple<glm::vec3, Ray, glm::vec3, float, float> AreaLight::sample_Le(const glm::vec2& sample_pos, const glm::vec2& sample_dir) const {
@@ -44,10 +62,10 @@ std::tuple<glm::vec3, Ray, glm::vec3, float, float> AreaLight::sample_Le(const g
     const auto [light, pdf_sample] = mesh.sample(sample_pos);
     if (pdf_sample <= 0.f) return { glm::vec3(0), Ray(), glm::vec3(0), 0.f, 0.f };
     const glm::vec3 dir = light.to_world(cosine_sample_hemisphere(sample_dir));
-    const float pdf_pos = pdf_sample / light.area;
-    const float pdf_dir = cosine_hemisphere_pdf(glm::dot(light.N, dir));
+    const float pdf_pos = pdf_sample / light.area();
+    const float pdf_dir = cosine_hemisphere_pdf(glm::dot(light.N(), dir));
     assert(std::isfinite(pdf_pos) && std::isfinite(pdf_dir));
-    return { light.Le(), Ray(light.P, dir), light.N, pdf_pos, pdf_dir };
+    return { light.Le(), Ray(light.P, dir), light.N(), pdf_pos, pdf_dir };
 }
 
 std::tuple<float, float> AreaLight::pdf_Le(const SurfaceHit& light, const glm::vec3& dir) const {
@@ -71,20 +89,25 @@ void SkyLight::load(const std::filesystem::path& path, const glm::vec3& scene_ce
     // init variables and load texture from disk
     const std::filesystem::path resolved_path = std::filesystem::exists(path) ? path : std::filesystem::path(GI_DATA_DIR) / path;
     std::cout << "loading: " << path << " (" << resolved_path << ")..." << std::endl;
-    texture = std::make_shared<Texture>(resolved_path);
+    // decode the texture and its luma in one pass, the latter directly feeds the importance map
+    std::vector<float> texel_luma;
+    texture = std::make_shared<Texture>();
+    texture->load(resolved_path, true, &texel_luma);
     this->intensity = intensity;
     this->scene_center = scene_center;
     this->scene_radius = scene_radius;
+    build_distribution(texel_luma.data());
 }
 
-void SkyLight::build_distribution() {
+void SkyLight::build_distribution(const float* texel_luma) {
     // init distribution for importance sampling
     Buffer<float> importance(texture->w, texture->h);
-    for (size_t y = 0; y < texture->h; ++y) {
+    #pragma omp parallel for
+    for (int y = 0; y < int(texture->h); ++y) {
         // counteract distortion
         float sin_theta = sinf(PI * float(y + .5f) / float(texture->h));
         for (size_t x = 0; x < texture->w; ++x)
-            importance(x, y) = luma(texture->operator()(static_cast<uint64_t>(x), static_cast<uint64_t>(y))) * sin_theta;
+            importance(x, y) = (texel_luma ? texel_luma[y * texture->w + x] : luma(texture->operator()(static_cast<uint64_t>(x), static_cast<uint64_t>(y)))) * sin_theta;
     }
     distribution = std::make_shared<Distribution2D>(importance.data(), importance.width(), importance.height());
 }
@@ -175,8 +198,126 @@ void SkyLight::from_json(const json11::Json& cfg) {
         json_set_float(cfg, "scene_radius", scene_radius);
         if (cfg["envmap"].is_string())
             load(cfg["envmap"].string_value(), scene_center, scene_radius, intensity);
-        else
+        else {
             texture = std::make_shared<Texture>(glm::vec3(1));
-        build_distribution();
+            build_distribution();
+        }
     }
 }
+
+// ------------------------------------------------
+// Volume light
+
+VolumeLight::VolumeLight(const Volume& volume) : volume(volume), grid(*volume.emission_grid()),
+    voxel_volume(fabsf(glm::determinant(glm::mat3(volume.emission_index_to_world_mat)))), unit_power(0) {
+    const auto& tree = grid.nvdb->tree();
+    const uint32_t N = tree.nodeCount(0);
+    if (N == 0 || volume.grid.density_scale <= 0.f) return;
+    // density at the centers of all emissive voxels, power from the absorption coefficient at the voxel centers
+    std::vector<float> leaf_emission(N), leaf_density(N);
+    std::vector<uint32_t> leaf_voxels(N);
+    std::vector<glm::vec3> leaf_power(N);
+    voxel_cdf.resize(size_t(N) * 512);
+    #pragma omp parallel for
+    for (int i = 0; i < int(N); ++i) {
+        const auto& leaf = tree.getFirstLeaf()[i];
+        const NVDBGrid::Accessor acc = volume.grid.accessor();
+        glm::vec3 power(0);
+        for (uint32_t v = 0; v < 512; ++v) {
+            float& density = voxel_cdf[size_t(i) * 512 + v];
+            density = 0.f;
+            const glm::vec3 emission = volume.Le(leaf.getValue(v));
+            if (luma(emission) <= 0.f) continue;
+            const nanovdb::Coord ijk = leaf.offsetToGlobalCoord(v);
+            const glm::vec3 P = glm::vec3(volume.emission_index_to_world_mat * glm::vec4(ijk[0] + .5f, ijk[1] + .5f, ijk[2] + .5f, 1.f));
+            density = volume.grid.lookup_density_trilinear(acc, volume.world_to_index(glm::vec4(P, 1.f)));
+            power += emission * density;
+            leaf_density[i] += density;
+            leaf_voxels[i]++;
+        }
+        leaf_power[i] = power;
+    }
+    // the emitted radiance is sigma_a * Le, so sample voxels proportional to density * luma(Le),
+    // with a small density floor to keep emissive voxels samplable whose center density is zero (the density varies within a voxel)
+    double density_sum = 0.0, voxel_count = 0.0;
+    for (uint32_t i = 0; i < N; ++i) {
+        density_sum += leaf_density[i];
+        voxel_count += leaf_voxels[i];
+    }
+    const float density_floor = density_sum > 0.0 ? .01f * float(density_sum / voxel_count) : 1.f;
+    #pragma omp parallel for
+    for (int i = 0; i < int(N); ++i) {
+        const auto& leaf = tree.getFirstLeaf()[i];
+        float sum = 0.f;
+        for (uint32_t v = 0; v < 512; ++v) {
+            float& cdf = voxel_cdf[size_t(i) * 512 + v];
+            const float lum = luma(volume.Le(leaf.getValue(v)));
+            if (lum > 0.f)
+                sum += lum * (cdf + density_floor);
+            cdf = sum;
+        }
+        leaf_emission[i] = sum;
+    }
+    for (const glm::vec3& power : leaf_power)
+        unit_power += power;
+    unit_power *= 4 * PI * voxel_volume / volume.grid.density_scale;
+    leaf_distribution = std::make_shared<Distribution1D>(leaf_emission.data(), N, true);
+}
+
+// split a uniform sample into three 8 bit strata, for a position within a voxel without drawing further random numbers
+inline glm::vec3 voxel_jitter(float sample) {
+    const uint32_t bits = std::min(uint32_t(sample * 16777216.f), 16777215u);
+    return (glm::vec3((bits >> 16) & 255u, (bits >> 8) & 255u, bits & 255u) + .5f) / 256.f;
+}
+
+glm::vec3 VolumeLight::power() const {
+    // density and absorption only scale the power, so they can change without rebuilding the distribution
+    return unit_power * volume.absorption_cross_section * volume.grid.density_scale;
+}
+
+std::tuple<glm::vec3, glm::vec3, float> VolumeLight::sample_position(float sample, const glm::vec3& jitter) const {
+    if (!leaf_distribution || leaf_distribution->integral() <= 0.f) return { glm::vec3(0), glm::vec3(0), 0.f };
+    // select a leaf, reuse the fraction within its bin to select a voxel
+    const auto [u, pdf_u] = leaf_distribution->sample_01(sample);
+    const float x = u * leaf_distribution->size();
+    const uint32_t i = std::min(uint32_t(x), leaf_distribution->size() - 1);
+    const float* cdf = &voxel_cdf[size_t(i) * 512];
+    const float target = fminf(x - i, 0.99999f) * cdf[511];
+    const uint32_t v = std::min(uint32_t(std::upper_bound(cdf, cdf + 512, target) - cdf), 511u);
+    const float weight = cdf[v] - (v > 0 ? cdf[v - 1] : 0.f);
+    if (weight <= 0.f) return { glm::vec3(0), glm::vec3(0), 0.f };
+    // uniform position within the voxel
+    const auto& leaf = grid.nvdb->tree().getFirstLeaf()[i];
+    const nanovdb::Coord ijk = leaf.offsetToGlobalCoord(v);
+    const glm::vec3 P = glm::vec3(volume.emission_index_to_world_mat * glm::vec4(glm::vec3(ijk[0], ijk[1], ijk[2]) + jitter, 1.f));
+    const float sigma_a = volume.absorption_cross_section * volume.grid.lookup_density_trilinear(volume.world_to_index(glm::vec4(P, 1.f)));
+    const float pdf = weight / (leaf_distribution->integral() * voxel_volume);
+    assert(std::isfinite(pdf));
+    return { P, sigma_a * volume.Le(leaf.getValue(v)), pdf };
+}
+
+std::tuple<glm::vec3, Ray, float> VolumeLight::sample_Li(const glm::vec3& position, const glm::vec2& sample) const {
+    assert(sample.x >= 0 && sample.x < 1); assert(sample.y >= 0 && sample.y < 1);
+    STAT("sampleLi");
+    const auto [P, emission, pdf_volume] = sample_position(sample.x, voxel_jitter(sample.y));
+    if (pdf_volume <= 0.f) return { glm::vec3(0.f), Ray(), 0.f };
+    glm::vec3 l = P - position;
+    const float r = length(l);
+    if (r <= 0.f) return { glm::vec3(0.f), Ray(), 0.f };
+    l /= r;
+    // dV = r^2 dw dt, so the pdf per unit volume converts to a pdf per solid angle and unit length along the shadow ray
+    return { emission, Ray(position, l, r), pdf_volume * r * r };
+}
+
+std::tuple<glm::vec3, Ray, glm::vec3, float, float> VolumeLight::sample_Le(const glm::vec2& sample_pos, const glm::vec2& sample_dir) const {
+    STAT("sampleLe");
+    const auto [P, emission, pdf_pos] = sample_position(sample_pos.x, voxel_jitter(sample_pos.y));
+    if (pdf_pos <= 0.f) return { glm::vec3(0), Ray(), glm::vec3(0), 0.f, 0.f };
+    // isotropic emission
+    const glm::vec3 dir = uniform_sample_sphere(sample_dir);
+    return { emission, Ray(P, dir), dir, pdf_pos, uniform_sphere_pdf() };
+}
+
+std::tuple<float, float> VolumeLight::pdf_Le(const SurfaceHit& light, const glm::vec3& dir) const {
+    throw std::runtime_error("Function not implemented: " + std::string(__FILE__) + ", line: " + std::to_string(__LINE__));
+}
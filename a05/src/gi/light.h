@@ -5,12 +5,15 @@
 #include "distribution.h"
 #include <tuple>
 #include <string>
+#include <vector>
 #include <memory>
 #include <filesystem>
 
 class Ray;
 class Mesh;
 class Scene;
+class Volume;
+class NVDBGrid;
 class SurfaceHit;
 
 /**
@@ -36,6 +39,24 @@ public:
      */
     virtual std::tuple<glm::vec3, Ray, float> sample_Li(const glm::vec3& position, const glm::vec2& sample) const = 0;
 
+    /**
+     * @brief Compute incoming irradiance at point p_world from a given primitive of the light source
+     * @note Used together with Scene::sample_light_source(P, N, sample), which already selected the primitive.
+     * Defaults to sample_Li(position, sample) for light sources without primitives.
+     *
+     * @param position Position to compute incident light for
+     * @param primID Primitive of the light source to sample
+     * @param sample Random samples in [0, 1) used to sample the primitive
+     *
+     * @return Tuple consisting of:
+     *      - Incoming irradiance at point p_world (vec3)
+     *      - Shadow ray to sampled position on light source (Ray)
+     *      - PDF of the sample on the primitive in terms of solid angle (float)
+     */
+    virtual std::tuple<glm::vec3, Ray, float> sample_Li(const glm::vec3& position, uint32_t primID, const glm::vec2& sample) const {
+        return sample_Li(position, sample);
+    }
+
     /**
      * @brief Compute PDF for a given ray pointing to a light source sample
      *
@@ -104,6 +125,7 @@ public:
     AreaLight(const Mesh& mesh);
 
     std::tuple<glm::vec3, Ray, float> sample_Li(const glm::vec3& position, const glm::vec2& sample) const;
+    std::tuple<glm::vec3, Ray, float> sample_Li(const glm::vec3& position, uint32_t primID, const glm::vec2& sample) const;
     float pdf_Li(const SurfaceHit& light, const Ray& ray) const;
 
     std::tuple<glm::vec3, Ray, glm::vec3, float, float> sample_Le(const glm::vec2& sample_pos, const glm::vec2& sample_dir) const;
@@ -130,8 +152,9 @@ public:
     SkyLight(const std::filesystem::path& path, const Scene& scene, float intensity = 1.f);
 
     void load(const std::filesystem::path& path, const glm::vec3& scene_center, float scene_radius, float intensity = 1.f);
-    void build_distribution(); // compute intensity distribution for importance sampling during rendering
+    void build_distribution(const float* texel_luma = nullptr); // compute intensity distribution for importance sampling during rendering (from the given luma per texel, if present)
 
+    using Light::sample_Li;
     std::tuple<glm::vec3, Ray, float> sample_Li(const glm::vec3& position, const glm::vec2& sample) const;
     float pdf_Li(const SurfaceHit& light, const Ray& ray) const;
 
@@ -152,3 +175,45 @@ public:
     glm::vec3 scene_center;                         ///< Center of disk approximation of scene
     float scene_radius;                             ///< Radius of disk approximation of scene
 };
+
+/**
+ * @brief Emissive volume, emitting from the voxels of the emission grid of a Volume
+ *
+ * Samples select a leaf node of the emission grid according to its total emission (precomputed distribution over all
+ * leaf nodes), then a voxel within the leaf according to its emission and a uniform position within the voxel.
+ * Sampled radiance is the emission coefficient (absorption coefficient times emitted radiance) at the sampled point and
+ * the PDF is given per solid angle and unit length along the shadow ray, so the usual estimator integrates the emission
+ * along all directions. Volume emission is never hit as a surface, so there is no MIS for this light source.
+ * @note Holds references into the volume, rebuilt on each Scene::commit() with DIRTY_VOLUME.
+ */
+class VolumeLight : public Light {
+public:
+    VolumeLight(const Volume& volume);
+
+    using Light::sample_Li;
+    std::tuple<glm::vec3, Ray, float> sample_Li(const glm::vec3& position, const glm::vec2& sample) const;
+    float pdf_Li(const SurfaceHit& light, const Ray& ray) const { return 0.f; }
+
+    std::tuple<glm::vec3, Ray, glm::vec3, float, float> sample_Le(const glm::vec2& sample_pos, const glm::vec2& sample_dir) const;
+    std::tuple<float, float> pdf_Le(const SurfaceHit& light, const glm::vec3& dir) const;
+
+    glm::vec3 Le(const Ray& ray) const { return glm::vec3(0); }
+    glm::vec3 power() const;
+    bool is_infinite() const { return false; }
+
+    // empty json import/export since this is implicitly built from the volume settings
+    json11::Json to_json() const { return json11::Json(); }
+    void from_json(const json11::Json& cfg) {}
+
+    // sample a world-space position within the volume (jitter: position within the selected voxel in [0, 1)^3),
+    // returns: <position, emission coefficient, pdf per unit volume>
+    std::tuple<glm::vec3, glm::vec3, float> sample_position(float sample, const glm::vec3& jitter) const;
+
+    // data
+    const Volume& volume;                               ///< Volume holding the emission grid
+    const NVDBGrid& grid;                               ///< Emission grid
+    std::shared_ptr<Distribution1D> leaf_distribution;  ///< Total emission (luma * density at the voxel centers) per leaf node
+    std::vector<float> voxel_cdf;                       ///< Unnormalized CDF over the 8^3 voxels of each leaf node (luma * density)
+    float voxel_volume;                                 ///< World-space volume of one voxel
+    glm::vec3 unit_power;                               ///< Approximate power per unit absorption cross section and density scale, from the densities at the voxel centers
+};
@@ -0,0 +1,198 @@
+#include "light_bvh.h"
+#include "mesh.h"
+#include "sampling.h"
+
+#include <cfloat>
+#include <algorithm>
+
+// ---------------------------------------------------------
+// orientation cone helpers (see Conty Estevez and Kulla 2018, "Importance Sampling of Many Lights with Adaptive Tree Splitting")
+
+inline float safe_sqrt(float x) { return sqrtf(fmaxf(0.f, x)); }
+
+// cos(max(0, a - b)) for angles given by sine and cosine
+inline float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+    return cos_a > cos_b ? 1.f : cos_a * cos_b + sin_a * sin_b;
+}
+
+// sin(max(0, a - b)) for angles given by sine and cosine
+inline float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+    return cos_a > cos_b ? 0.f : sin_a * cos_b - cos_a * sin_b;
+}
+
+// rotate v around the (normalized) axis by the given angle
+inline glm::vec3 rotate(const glm::vec3& v, const glm::vec3& axis, float angle) {
+    const float c = cosf(angle), s = sinf(angle);
+    return v * c + glm::cross(axis, v) * s + axis * glm::dot(axis, v) * (1.f - c);
+}
+
+// smallest cone containing both cones (a and b)
+inline std::tuple<glm::vec3, float> cone_union(const glm::vec3& axis_a, float cos_a, const glm::vec3& axis_b, float cos_b) {
+    const float theta_a = acosf(glm::clamp(cos_a, -1.f, 1.f));
+    const float theta_b = acosf(glm::clamp(cos_b, -1.f, 1.f));
+    const float theta_d = acosf(glm::clamp(glm::dot(axis_a, axis_b), -1.f, 1.f));
+    // one cone contains the other
+    if (fminf(theta_d + theta_b, PI) <= theta_a) return { axis_a, cos_a };
+    if (fminf(theta_d + theta_a, PI) <= theta_b) return { axis_b, cos_b };
+    // spread of the merged cone
+    const float theta_o = (theta_a + theta_d + theta_b) / 2;
+    if (theta_o >= PI) return { axis_a, -1.f };
+    const glm::vec3 w_r = glm::cross(axis_a, axis_b);
+    if (glm::dot(w_r, w_r) < 1e-12f) return { axis_a, -1.f };
+    return { rotate(axis_a, glm::normalize(w_r), theta_o - theta_a), cosf(theta_o) };
+}
+
+// ---------------------------------------------------------
+// LightBVH
+
+LightBVH::LightBVH(const std::vector<std::shared_ptr<Mesh>>& meshes) {
+    // collect emissive triangles with their bounds, orientation and power
+    std::vector<Node> leaves;
+    for (const auto& mesh : meshes) {
+        if (!mesh->is_light()) continue;
+        mesh_offset[mesh.get()] = emitters.size();
+        for (uint32_t i = 0; i < mesh->num_triangles(); ++i) {
+            const glm::uvec3& tri = mesh->ibo[i];
+            const glm::vec3& A = mesh->vbo[tri[0]], &B = mesh->vbo[tri[1]], &C = mesh->vbo[tri[2]];
+            Node leaf;
+            leaf.bb_min = glm::min(A, glm::min(B, C));
+            leaf.bb_max = glm::max(A, glm::max(B, C));
+            leaf.power = mesh->mat->emissive_strength * mesh->areas[i] * PI;
+            leaf.axis = mesh->face_normals[i]; // emission happens on the side of the vertex normals only
+            leaf.cos_theta_o = 1.f;
+            leaf.cos_theta_e = 0.f; // cos(pi / 2)
+            leaves.push_back(leaf);
+            emitters.push_back({ mesh.get(), i, 0 });
+        }
+    }
+    if (emitters.empty()) return;
+    // build tree
+    std::vector<uint32_t> ids(emitters.size());
+    for (uint32_t i = 0; i < ids.size(); ++i)
+        ids[i] = i;
+    nodes.reserve(2 * emitters.size() - 1);
+    build(ids.data(), ids.size(), UINT32_MAX, leaves);
+}
+
+uint32_t LightBVH::build(uint32_t* ids, uint32_t count, uint32_t parent, const std::vector<Node>& leaves) {
+    const uint32_t index = nodes.size();
+    if (count == 1) {
+        nodes.push_back(leaves[ids[0]]);
+        nodes[index].parent = parent;
+        nodes[index].child = ids[0];
+        nodes[index].is_leaf = 1;
+        emitters[ids[0]].node = index;
+        return index;
+    }
+    nodes.emplace_back();
+    // split at the median along the largest extent of the centroids
+    glm::vec3 c_min(FLT_MAX), c_max(-FLT_MAX);
+    for (uint32_t i = 0; i < count; ++i) {
+        const glm::vec3 c = 0.5f * (leaves[ids[i]].bb_min + leaves[ids[i]].bb_max);
+        c_min = glm::min(c_min, c);
+        c_max = glm::max(c_max, c);
+    }
+    const glm::vec3 extent = c_max - c_min;
+    const int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+    const uint32_t mid = count / 2;
+    std::nth_element(ids, ids + mid, ids + count, [&](uint32_t a, uint32_t b) {
+        return leaves[a].bb_min[axis] + leaves[a].bb_max[axis] < leaves[b].bb_min[axis] + leaves[b].bb_max[axis];
+    });
+    const uint32_t left = build(ids, mid, index, leaves);
+    const uint32_t right = build(ids + mid, count - mid, index, leaves);
+    // merge children
+    const Node& L = nodes[left];
+    const Node& R = nodes[right];
+    Node& node = nodes[index];
+    node.bb_min = glm::min(L.bb_min, R.bb_min);
+    node.bb_max = glm::max(L.bb_max, R.bb_max);
+    node.power = L.power + R.power;
+    if (L.power <= 0.f || R.power <= 0.f) {
+        // ignore orientation of children without any emission
+        const Node& E = L.power > 0.f ? L : R;
+        node.axis = E.axis;
+        node.cos_theta_o = E.cos_theta_o;
+    } else
+        std::tie(node.axis, node.cos_theta_o) = cone_union(L.axis, L.cos_theta_o, R.axis, R.cos_theta_o);
+    node.cos_theta_e = fminf(L.cos_theta_e, R.cos_theta_e);
+    node.parent = parent;
+    node.child = right;
+    node.is_leaf = 0;
+    return index;
+}
+
+float LightBVH::importance(const Node& node, const glm::vec3& P, const glm::vec3& N) const {
+    if (node.power <= 0.f) return 0.f;
+    // distance to the bounds center, clamped to avoid the singularity within the bounds
+    const glm::vec3 center = 0.5f * (node.bb_min + node.bb_max);
+    const glm::vec3 diag = node.bb_max - node.bb_min;
+    const float dist2 = fmaxf(glm::dot(P - center, P - center), 0.5f * glm::length(diag));
+    // angle between the cone axis and the direction to P
+    const glm::vec3 w_i = glm::normalize(P - center);
+    const float cos_w = glm::dot(node.axis, w_i);
+    const float sin_w = safe_sqrt(1.f - cos_w * cos_w);
+    // bound the angle subtended by the bounds as seen from P
+    float cos_b = -1.f;
+    if (glm::any(glm::lessThan(P, node.bb_min)) || glm::any(glm::greaterThan(P, node.bb_max))) {
+        const float sin2_b = 0.25f * glm::dot(diag, diag) / glm::dot(P - center, P - center);
+        cos_b = sin2_b < 1.f ? safe_sqrt(1.f - sin2_b) : -1.f;
+    }
+    const float sin_b = safe_sqrt(1.f - cos_b * cos_b);
+    // minimal angle to the emission cone: max(0, theta_w - theta_o - theta_b)
+    const float sin_o = safe_sqrt(1.f - node.cos_theta_o * node.cos_theta_o);
+    const float cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, node.cos_theta_o);
+    const float sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, node.cos_theta_o);
+    const float cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+    if (cos_p <= node.cos_theta_e) return 0.f;
+    float importance = node.power * cos_p / dist2;
+    // bound the cosine at the receiver
+    if (N != glm::vec3(0)) {
+        const float cos_i = fabsf(glm::dot(w_i, N));
+        const float sin_i = safe_sqrt(1.f - cos_i * cos_i);
+        importance *= cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+    }
+    return fmaxf(importance, 0.f);
+}
+
+std::tuple<const Mesh*, uint32_t, float> LightBVH::sample(const glm::vec3& P, const glm::vec3& N, float sample) const {
+    if (nodes.empty()) return { nullptr, 0, 0.f };
+    uint32_t index = 0;
+    float pdf = 1.f;
+    while (!nodes[index].is_leaf) {
+        const uint32_t left = index + 1, right = nodes[index].child;
+        const float imp_l = importance(nodes[left], P, N);
+        const float imp_r = importance(nodes[right], P, N);
+        if (imp_l + imp_r <= 0.f) return { nullptr, 0, 0.f };
+        // descend and remap sample
+        const float p_l = imp_l / (imp_l + imp_r);
+        if (sample < p_l) {
+            sample = fminf(sample / p_l, 0.99999f);
+            pdf *= p_l;
+            index = left;
+        } else {
+            sample = fminf((sample - p_l) / (1.f - p_l), 0.99999f);
+            pdf *= 1.f - p_l;
+            index = right;
+        }
+    }
+    const Emitter& emitter = emitters[nodes[index].child];
+    return { emitter.mesh, emitter.primID, pdf };
+}
+
+float LightBVH::pdf(const glm::vec3& P, const glm::vec3& N, const Mesh* mesh, uint32_t primID) const {
+    const auto it = mesh_offset.find(mesh);
+    if (it == mesh_offset.end()) return 0.f;
+    // walk up from the leaf and multiply the probabilities of each decision
+    uint32_t index = emitters[it->second + primID].node;
+    float pdf = 1.f;
+    while (nodes[index].parent != UINT32_MAX) {
+        const uint32_t parent = nodes[index].parent;
+        const uint32_t sibling = index == parent + 1 ? nodes[parent].child : parent + 1;
+        const float imp = importance(nodes[index], P, N);
+        const float imp_sibling = importance(nodes[sibling], P, N);
+        if (imp <= 0.f) return 0.f;
+        pdf *= imp / (imp + imp_sibling);
+        index = parent;
+    }
+    return pdf;
+}
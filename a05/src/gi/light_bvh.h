@@ -0,0 +1,88 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+class Mesh;
+
+/**
+ * @brief Bounding volume hierarchy over all emissive triangles for many-light importance sampling.
+ *
+ * Each node stores the spatial bounds, an orientation cone bounding the emission directions and the
+ * emitted power of all triangles below it. Sampling descends the tree stochastically, choosing a child
+ * according to a conservative estimate of its contribution to a given shading point and normal.
+ */
+class LightBVH {
+public:
+    /**
+     * @brief Build over all emissive triangles of the given meshes
+     *
+     * @param meshes Meshes of the scene, non-emissive ones are skipped
+     */
+    LightBVH(const std::vector<std::shared_ptr<Mesh>>& meshes);
+
+    LightBVH(const LightBVH&)            = delete;
+    LightBVH& operator=(const LightBVH&) = delete;
+
+    inline bool empty() const { return nodes.empty(); }
+    inline size_t num_emitters() const { return emitters.size(); }
+    inline float power() const { return nodes.empty() ? 0.f : nodes[0].power; }
+
+    /**
+     * @brief Importance sample an emissive triangle for a shading point
+     *
+     * @param P Shading position
+     * @param N Shading normal, or vec3(0) for points in a volume
+     * @param sample Random sample in [0, 1)
+     *
+     * @return Tuple consisting of:
+     *      - Emissive mesh of the sampled triangle, or nullptr on failure (const Mesh*)
+     *      - Sampled triangle (uint)
+     *      - Discrete PDF of the sampled triangle (float)
+     */
+    std::tuple<const Mesh*, uint32_t, float> sample(const glm::vec3& P, const glm::vec3& N, float sample) const;
+
+    /**
+     * @brief Compute the discrete PDF of sampling a given emissive triangle for a shading point
+     *
+     * @param P Shading position
+     * @param N Shading normal, or vec3(0) for points in a volume
+     * @param mesh Emissive mesh
+     * @param primID Triangle of the mesh
+     *
+     * @return PDF of selecting the triangle via sample()
+     */
+    float pdf(const glm::vec3& P, const glm::vec3& N, const Mesh* mesh, uint32_t primID) const;
+
+    struct Node {
+        glm::vec3 bb_min;       ///< AABB (lower left corner)
+        float power;            ///< Summed power of all emitters below
+        glm::vec3 bb_max;       ///< AABB (upper right corner)
+        float cos_theta_o;      ///< Cosine of the orientation cone's spread around axis
+        glm::vec3 axis;         ///< Orientation cone axis
+        float cos_theta_e;      ///< Cosine of the emission spread relative to the cone
+        uint32_t parent;        ///< Parent node, UINT32_MAX for the root
+        uint32_t child;         ///< Right child (left child is the next node), or emitter index for leaves
+        uint32_t is_leaf;       ///< Leaf flag
+    };
+
+    struct Emitter {
+        const Mesh* mesh;       ///< Emissive mesh
+        uint32_t primID;        ///< Triangle of the mesh
+        uint32_t node;          ///< Leaf node holding this emitter
+    };
+
+private:
+    uint32_t build(uint32_t* ids, uint32_t count, uint32_t parent, const std::vector<Node>& leaves);
+    float importance(const Node& node, const glm::vec3& P, const glm::vec3& N) const;
+
+public:
+    // data
+    std::vector<Node> nodes;                                ///< Nodes in depth first order
+    std::vector<Emitter> emitters;                          ///< All emissive triangles, grouped per mesh
+    std::unordered_map<const Mesh*, uint32_t> mesh_offset;  ///< Index of the first emitter per mesh
+};
@@ -2,8 +2,10 @@
 #include "sampling.h"
 #include "light.h"
 #include "color.h"
+#include "texture_cache.h"
 
 #include <mutex>
+#include <iostream>
 
 #include <assimp/material.h>
 
@@ -12,7 +14,7 @@ std::vector<Material *> Material::instances;
 
 Material::Material() : name("default"), type(name) {}
 
-Material::Material(const aiMaterial *material_ai, const std::filesystem::path& base_path) {
+MaterialRecord::MaterialRecord(const aiMaterial *material_ai) {
     aiColor3D diff, spec, emis;
     material_ai->Get(AI_MATKEY_COLOR_DIFFUSE, diff);
     material_ai->Get(AI_MATKEY_COLOR_SPECULAR, spec);
@@ -27,55 +29,92 @@ Material::Material(const aiMaterial *material_ai, const std::filesystem::path& b
     // convert exponent to roughness
     float exponent;
     material_ai->Get(AI_MATKEY_SHININESS, exponent);
-    roughness_val = roughness_from_exponent(exponent);
+    roughness_val = Material::roughness_from_exponent(exponent);
 
     // fetch name
     aiString name_ai;
     material_ai->Get(AI_MATKEY_NAME, name_ai);
     name = name_ai.C_Str();
-    {
-        // add material to global instance map
-        std::lock_guard<std::mutex> guard(mat_mutex);
-        instances.push_back(this);
-    }
+
+    // fetch texture paths
+    const auto fetch = [&](aiTextureType type, aiTextureType type_path, uint32_t slot) {
+        if (material_ai->GetTextureCount(type) > 0) {
+            aiString path_ai;
+            material_ai->GetTexture(type_path, 0, &path_ai);
+            textures[slot] = path_ai.C_Str();
+        }
+    };
+    fetch(aiTextureType_DIFFUSE, aiTextureType_DIFFUSE, ALBEDO);
+    fetch(aiTextureType_HEIGHT, aiTextureType_HEIGHT, NORMAL);
+    fetch(aiTextureType_OPACITY, aiTextureType_OPACITY, ALPHA);
+    fetch(aiTextureType_SHININESS, aiTextureType_OPACITY, ROUGHNESS);
+    fetch(aiTextureType_EMISSIVE, aiTextureType_EMISSIVE, EMISSIVE);
+}
+
+Material::Material(const aiMaterial *material_ai, const std::filesystem::path& base_path) : Material(MaterialRecord(material_ai), base_path) {}
+
+Material::Material(const MaterialRecord& record, const std::filesystem::path& base_path, bool register_instance) {
+    name = record.name;
+    albedo_col = record.albedo_col;
+    emissive_strength = record.emissive_strength;
+    ior = record.ior;
+    roughness_val = record.roughness_val;
+    if (register_instance)
+        add_instance(this);
+
+    // load and prepare a filtered texture, via its tiled file if the texture cache is enabled
+    const bool tiled = TextureCache::global().enabled();
+    const auto load = [&](Texture& tex, const std::string& file, bool sRGB, bool single_channel) {
+        if (file.empty()) return;
+        const std::filesystem::path path = base_path / file;
+        const uint32_t load_flags = (sRGB ? 1 : 0) | (single_channel ? 2 : 0);
+        if (tiled) {
+            if (const auto tiled_tex = TiledTexture::open(path, load_flags)) {
+                tex.load(tiled_tex);
+                return;
+            }
+        }
+        tex.load(path, sRGB);
+        // single channel maps only need one byte per texel
+        if (single_channel) tex.convert(TEXEL_R8);
+        // build mipmaps for filtered lookups
+        tex.build_mipmaps();
+        // convert to a tiled file on first load and drop the decoded texels
+        if (tiled) {
+            const auto tiled_tex = TiledTexture::write(path, load_flags, tex) ? TiledTexture::open(path, load_flags) : nullptr;
+            if (tiled_tex)
+                tex.load(tiled_tex);
+            else
+                std::cerr << "Warning: failed to write tiled texture " << TiledTexture::cache_path(path, load_flags) << std::endl;
+        }
+    };
 
     // fetch diffuse (albedo) tex
-    if (material_ai->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-        aiString path_ai;
-        material_ai->GetTexture(aiTextureType_DIFFUSE, 0, &path_ai);
-        albedo_tex.load(base_path / path_ai.C_Str());
-    }
+    load(albedo_tex, record.textures[MaterialRecord::ALBEDO], true, false);
     // fetch normal tex
-    if (material_ai->GetTextureCount(aiTextureType_HEIGHT) > 0) {
-        aiString path_ai;
-        material_ai->GetTexture(aiTextureType_HEIGHT, 0, &path_ai);
-        normal_tex.load(base_path / path_ai.C_Str(), false);
-    }
-    // fetch alpha tex (or alpha channel from diffuse tex)
-    if (material_ai->GetTextureCount(aiTextureType_OPACITY) > 0) {
-        aiString path_ai;
-        material_ai->GetTexture(aiTextureType_OPACITY, 0, &path_ai);
-        alpha_tex.load(base_path / path_ai.C_Str());
-    } else if (albedo_tex.has_alpha)
+    load(normal_tex, record.textures[MaterialRecord::NORMAL], false, false);
+    // fetch alpha tex (or alpha channel from diffuse tex), alpha tests are unfiltered and always kept in memory
+    if (!record.textures[MaterialRecord::ALPHA].empty())
+        alpha_tex.load(base_path / record.textures[MaterialRecord::ALPHA]);
+    else if (albedo_tex.has_alpha)
         alpha_tex.load_alpha(albedo_tex.path());
+    if (alpha_tex) alpha_tex.convert(TEXEL_R8);
     // fetch roughness tex
-    if (material_ai->GetTextureCount(aiTextureType_SHININESS) > 0) {
-        aiString path_ai;
-        material_ai->GetTexture(aiTextureType_OPACITY, 0, &path_ai);
-        roughness_tex.load(base_path / path_ai.C_Str());
-    }
+    load(roughness_tex, record.textures[MaterialRecord::ROUGHNESS], true, true);
     // fetch emissive tex
-    if (material_ai->GetTextureCount(aiTextureType_EMISSIVE) > 0) {
-        aiString path_ai;
-        material_ai->GetTexture(aiTextureType_EMISSIVE, 0, &path_ai);
-        emissive_tex.load(base_path / path_ai.C_Str());
-    }
+    load(emissive_tex, record.textures[MaterialRecord::EMISSIVE], true, false);
 
     // material preset selection hack
     type = name;
     set_to(type);
 }
 
+void Material::add_instance(Material* mat) {
+    // add material to global instance map
+    std::lock_guard<std::mutex> guard(mat_mutex);
+    instances.push_back(mat);
+}
+
 Material::~Material() {
     // delete from global instance map
     std::lock_guard<std::mutex> guard(mat_mutex);
@@ -87,21 +126,21 @@ Material::~Material() {
     }
 }
 
-glm::vec3 Material::albedo(const glm::vec2& TC) const {
-    return albedo_tex ? albedo_tex(TC) : albedo_col;
+glm::vec3 Material::albedo(const glm::vec2& TC, float lod) const {
+    return albedo_tex ? albedo_tex(TC, lod) : albedo_col;
 }
 
-glm::vec3 Material::emissive(const glm::vec2& TC) const {
+glm::vec3 Material::emissive(const glm::vec2& TC, float lod) const {
     if (emissive_strength <= 0) return glm::vec3(0);
-    return emissive_tex ? emissive_tex(TC) * emissive_strength : albedo(TC) * emissive_strength;
+    return emissive_tex ? emissive_tex(TC, lod) * emissive_strength : albedo(TC, lod) * emissive_strength;
 }
 
-float Material::roughness(const glm::vec2& TC) const {
-    return roughness_tex ? luma(roughness_tex(TC)) : roughness_val;
+float Material::roughness(const glm::vec2& TC, float lod) const {
+    return roughness_tex ? luma(roughness_tex(TC, lod)) : roughness_val;
 }
 
-glm::vec3 Material::normalmap(const glm::vec3 &N, const glm::vec2 &TC) const {
-    return normal_tex ? tangent_to_world(N, normalize(normal_tex(TC) * 2.f - 1.f)) : N;
+glm::vec3 Material::normalmap(const glm::vec3 &N, const glm::vec2 &TC, float lod) const {
+    return normal_tex ? tangent_to_world(N, normalize(normal_tex(TC, lod) * 2.f - 1.f)) : N;
 }
 
 float Material::alphamap(const glm::vec2& TC) const {
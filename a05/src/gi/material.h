@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cfloat>
 #include <string>
 #include <vector>
 #include <filesystem>
@@ -10,6 +11,24 @@
 
 class aiMaterial;
 
+/**
+ * @brief Imported material parameters before preset selection, e.g. from an assimp material or a mesh cache
+ */
+struct MaterialRecord {
+    enum { ALBEDO, NORMAL, ALPHA, ROUGHNESS, EMISSIVE, NUM_TEXTURES };
+
+    MaterialRecord() {}
+    MaterialRecord(const aiMaterial *material_ai);
+
+    // data
+    std::string name;                       ///< Material name string
+    glm::vec3 albedo_col = glm::vec3(1);    ///< Diffuse (or specular) color
+    float emissive_strength = 0;            ///< Luma of emissive color
+    float ior = 1.3f;                       ///< Index of refraction
+    float roughness_val = 0.1;              ///< Roughness converted from phong exponent
+    std::string textures[NUM_TEXTURES];     ///< Texture paths relative to the mesh file (empty if none)
+};
+
 /**
  * @brief Material class, describing a surface
  */
@@ -17,13 +36,17 @@ class Material {
 public:
     Material();
     Material(const aiMaterial *material_ai, const std::filesystem::path& base_path);
+    Material(const MaterialRecord& record, const std::filesystem::path& base_path, bool register_instance = true);
     virtual ~Material();
 
-    // material lookups (texture or static)
-    glm::vec3 albedo(const glm::vec2& TC) const;
-    float roughness(const glm::vec2& TC) const;
-    glm::vec3 emissive(const glm::vec2& TC) const;
-    glm::vec3 normalmap(const glm::vec3& N, const glm::vec2& TC) const;
+    // add material to the global instances (thread-safe), done by the constructors unless deferred to keep a deterministic order
+    static void add_instance(Material* mat);
+
+    // material lookups (texture or static), lod selects the filter footprint (see Texture::trilin), default: unfiltered
+    glm::vec3 albedo(const glm::vec2& TC, float lod = -FLT_MAX) const;
+    float roughness(const glm::vec2& TC, float lod = -FLT_MAX) const;
+    glm::vec3 emissive(const glm::vec2& TC, float lod = -FLT_MAX) const;
+    glm::vec3 normalmap(const glm::vec3& N, const glm::vec2& TC, float lod = -FLT_MAX) const;
     float alphamap(const glm::vec2& TC) const;
 
     // (lossy) translatation between phong exponent and roughness
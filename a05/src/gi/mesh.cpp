@@ -14,25 +14,23 @@ void alphamapFilter(const RTCFilterFunctionNArguments* args) {
     STAT("alpha filter");
     if (!args->context || !args->geometryUserPtr) return;
     Mesh* mesh = (Mesh*)args->geometryUserPtr;
-    if (!mesh->mat->alpha_tex || mesh->tcs.empty()) return;
+    if (!mesh->mat->alpha_tex || !mesh->has_tcs()) return;
 
     for (uint32_t i = 0; i < args->N; ++i) {
         if (args->valid[i] != -1) continue;
         const glm::uvec3& tri = mesh->ibo[RTCHitN_primID(args->hit, args->N, i)];
         const float u = RTCHitN_u(args->hit, args->N, i);
         const float v = RTCHitN_v(args->hit, args->N, i);
-        const glm::vec2& TC = (1 - u - v) * mesh->tcs[tri[0]] + u * mesh->tcs[tri[1]] + v * mesh->tcs[tri[2]];
+        const glm::vec2 TC = (1 - u - v) * mesh->tc(tri[0]) + u * mesh->tc(tri[1]) + v * mesh->tc(tri[2]);
         // perform alpha test
         if (mesh->mat->alphamap(TC) < .1f)
             args->valid[i] = 0; // reject hit
     }
 }
 
-Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const aiMesh* ai_mesh)
-    : geom(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)), geomID(-1), mat(mat),
+Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const aiMesh* ai_mesh, bool alias)
+    : geom(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)), geomID(-1), build_quality(RTC_BUILD_QUALITY_HIGH), mat(mat),
     bb_min(FLT_MAX), bb_max(FLT_MIN), center(0.f), radius(FLT_MIN), scene(scene) {
-    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_HIGH);
-
     // allocate buffers
     const size_t numVertices = ai_mesh->mNumVertices;
     bool has_tcs = ai_mesh->HasTextureCoords(0);
@@ -48,9 +46,6 @@ Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>&
         // vertices
         const aiVector3D &v = ai_mesh->mVertices[i];
         vbo.emplace_back(v.x, v.y, v.z);
-        // compute AABB
-        bb_min = min(bb_min, vbo[i]);
-        bb_max = max(bb_max, vbo[i]);
         // normals
         const aiVector3D &n = ai_mesh->mNormals[i];
         normals.emplace_back(n.x, n.y, n.z);
@@ -61,58 +56,18 @@ Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>&
         }
     }
 
-    // compute radius of disk approximation
-    center = (bb_min + bb_max) * .5f;
-    for (uint32_t i = 0; i < numVertices; ++i)
-        radius = fmaxf(radius, length(vbo[i] - center));
-
     // extract indices
     for (uint32_t i = 0; i < numTriangles; ++i) {
         const aiFace f = ai_mesh->mFaces[i];
         ibo.emplace_back(f.mIndices[0], f.mIndices[1], f.mIndices[2]);
     }
 
-    // tell embree about the mesh
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, vbo.data(), 0, sizeof(glm::vec3), vbo.size());
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, ibo.data(), 0, sizeof(glm::uvec3), ibo.size());
-    rtcSetGeometryVertexAttributeCount(geom, has_tcs ? 2 : 1);
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, RTC_FORMAT_FLOAT3, normals.data(), 0, sizeof(glm::vec3), normals.size());
-    if (has_tcs)
-        rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 1, RTC_FORMAT_FLOAT2, tcs.data(), 0, sizeof(glm::vec2), tcs.size());
-
-    // set user data pointer
-    rtcSetGeometryUserData(geom, this);
-
-    // set intersection filter function if material has alphamap
-    if (mat->alpha_tex) {
-        rtcSetGeometryIntersectFilterFunction(geom, alphamapFilter);
-        rtcSetGeometryOccludedFilterFunction(geom, alphamapFilter);
-    }
-
-    // commit and attach geometry
-    rtcCommitGeometry(geom);
-    geomID = rtcAttachGeometry(scene, geom);
-
-    // build distribution over triangle area for importance sampling
-    std::vector<float> f(ibo.size());
-    for (uint32_t i = 0; i < ibo.size(); ++i) {
-        const glm::uvec3& tri = ibo[i];
-        const glm::vec3 AB = vbo[tri[1]] - vbo[tri[0]];
-        const glm::vec3 AC = vbo[tri[2]] - vbo[tri[0]];
-        f[i] = 0.5f * length(cross(AB, AC));
-
-    }
-    area_distribution = std::make_shared<Distribution1D>(f.data(), f.size());
-
-    // build area light
-    area_light = std::make_shared<AreaLight>(*this);
+    init(alias);
 }
 
-Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const par_shapes_mesh* par_mesh)
-    : geom(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)), geomID(-1), mat(mat),
+Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const par_shapes_mesh* par_mesh, bool alias)
+    : geom(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)), geomID(-1), build_quality(RTC_BUILD_QUALITY_HIGH), mat(mat),
     bb_min(FLT_MAX), bb_max(FLT_MIN), center(0.f), radius(FLT_MIN), scene(scene) {
-    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_HIGH);
-
     // allocate buffers
     const size_t numVertices = par_mesh->npoints;
     bool has_tcs = par_mesh->tcoords != 0;
@@ -132,27 +87,41 @@ Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>&
         // tex coords
         if (has_tcs)
             tcs.emplace_back(par_mesh->tcoords[2*i+0], par_mesh->tcoords[2*i+1]);
-        // compute AABB
-        bb_min = min(bb_min, vbo[i]);
-        bb_max = max(bb_max, vbo[i]);
     }
 
-    // compute radius of disk approximation
-    center = (bb_min + bb_max) * .5f;
-    for (uint32_t i = 0; i < numVertices; ++i)
-        radius = fmaxf(radius, length(vbo[i] - center));
-
     // extract indices TODO check if 3*numTriangles
     for (uint32_t i = 0; i < numTriangles; ++i)
         ibo.emplace_back(par_mesh->triangles[3*i+0], par_mesh->triangles[3*i+1], par_mesh->triangles[3*i+2]);
 
-    // tell embree about the mesh
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, vbo.data(), 0, sizeof(glm::vec3), vbo.size());
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, ibo.data(), 0, sizeof(glm::uvec3), ibo.size());
+    init(alias);
+}
+
+Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat,
+        MeshArray<glm::vec3>&& vbo, MeshArray<glm::uvec3>&& ibo, MeshArray<glm::vec3>&& normals, MeshArray<glm::vec2>&& tcs, bool alias)
+    : geom(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)), geomID(-1), build_quality(RTC_BUILD_QUALITY_HIGH), vbo(std::move(vbo)), ibo(std::move(ibo)),
+    normals(std::move(normals)), tcs(std::move(tcs)), mat(mat), bb_min(FLT_MAX), bb_max(FLT_MIN), center(0.f), radius(FLT_MIN), scene(scene) {
+    assert(this->normals.size() == this->vbo.size() && (this->tcs.empty() || this->tcs.size() == this->vbo.size()));
+    init(alias);
+}
+
+void Mesh::init(bool alias) {
+    // compute AABB and radius of disk approximation
+    for (const glm::vec3& v : vbo) {
+        bb_min = min(bb_min, v);
+        bb_max = max(bb_max, v);
+    }
+    center = (bb_min + bb_max) * .5f;
+    for (const glm::vec3& v : vbo)
+        radius = fmaxf(radius, length(v - center));
+
+    // tell embree about the mesh (buffers are shared, not copied, and only read by embree)
+    const bool has_tcs = !tcs.empty();
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, (void*)vbo.data(), 0, sizeof(glm::vec3), vbo.size());
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, (void*)ibo.data(), 0, sizeof(glm::uvec3), ibo.size());
     rtcSetGeometryVertexAttributeCount(geom, has_tcs ? 2 : 1);
-    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, RTC_FORMAT_FLOAT3, normals.data(), 0, sizeof(glm::vec3), normals.size());
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, RTC_FORMAT_FLOAT3, (void*)normals.data(), 0, sizeof(glm::vec3), normals.size());
     if (has_tcs)
-        rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 1, RTC_FORMAT_FLOAT2, tcs.data(), 0, sizeof(glm::vec2), tcs.size());
+        rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 1, RTC_FORMAT_FLOAT2, (void*)tcs.data(), 0, sizeof(glm::vec2), tcs.size());
 
     // set user data pointer
     rtcSetGeometryUserData(geom, this);
@@ -163,30 +132,68 @@ Mesh::Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>&
         rtcSetGeometryOccludedFilterFunction(geom, alphamapFilter);
     }
 
-    // commit and attach geometry
-    rtcCommitGeometry(geom);
-    geomID = rtcAttachGeometry(scene, geom);
-
-    // build distribution over triangle area for importance sampling
-    std::vector<float> f(ibo.size());
+    // precompute triangle areas and face normals, build distribution over the areas for importance sampling
+    areas.resize(ibo.size());
+    face_normals.resize(ibo.size());
     for (uint32_t i = 0; i < ibo.size(); ++i) {
         const glm::uvec3& tri = ibo[i];
         const glm::vec3 AB = vbo[tri[1]] - vbo[tri[0]];
         const glm::vec3 AC = vbo[tri[2]] - vbo[tri[0]];
-        f[i] = 0.5f * length(cross(AB, AC));
-
+        const glm::vec3 N = cross(AB, AC);
+        areas[i] = 0.5f * length(N);
+        face_normals[i] = areas[i] > 0.f ? N / (2 * areas[i]) : glm::vec3(0, 1, 0);
+        if (dot(face_normals[i], normals[tri[0]] + normals[tri[1]] + normals[tri[2]]) < 0.f)
+            face_normals[i] = -face_normals[i];
+    }
+    // precompute texture space areas for texture filtering with ray cones (see SurfaceHit::lod)
+    if (!tcs.empty()) {
+        uv_areas.resize(ibo.size());
+        for (uint32_t i = 0; i < ibo.size(); ++i) {
+            const glm::uvec3& tri = ibo[i];
+            const glm::vec2 AB = tcs[tri[1]] - tcs[tri[0]];
+            const glm::vec2 AC = tcs[tri[2]] - tcs[tri[0]];
+            uv_areas[i] = 0.5f * fabsf(AB.x * AC.y - AB.y * AC.x);
+        }
     }
-    area_distribution.reset(new Distribution1D(f.data(), f.size()));
+    area_distribution = std::make_shared<Distribution1D>(areas.data(), areas.size(), alias);
 
     // build area light
-    area_light.reset(new AreaLight(*this));
+    area_light = std::make_shared<AreaLight>(*this);
 }
 
 Mesh::~Mesh() {
-    rtcDetachGeometry(scene, geomID);
+    if (geomID != uint32_t(-1))
+        rtcDetachGeometry(scene, geomID);
     rtcReleaseGeometry(geom);
 }
 
+void Mesh::commit(RTCBuildQuality quality) {
+    build_quality = quality;
+    rtcSetGeometryBuildQuality(geom, quality);
+    rtcCommitGeometry(geom);
+}
+
+void Mesh::compress() {
+    if (is_compressed()) return;
+    // embree does not read the attributes, drop them before releasing the buffers
+    rtcSetGeometryVertexAttributeCount(geom, 0);
+    normals_oct.reserve(normals.size());
+    for (const glm::vec3& n : normals)
+        normals_oct.push_back(encode_octahedral(n));
+    normals = MeshArray<glm::vec3>();
+    tcs_half.reserve(tcs.size());
+    for (const glm::vec2& tc : tcs)
+        tcs_half.push_back(glm::packHalf2x16(tc));
+    tcs = MeshArray<glm::vec2>();
+    // cheap for triangle geometry, the BVH is built on scene commit
+    rtcCommitGeometry(geom);
+}
+
+void Mesh::attach() {
+    assert(geomID == uint32_t(-1));
+    geomID = rtcAttachGeometry(scene, geom);
+}
+
 std::tuple<SurfaceHit, float> Mesh::sample(const glm::vec2& sample) const {
     auto [primID, pdf] = area_distribution->sample_index(RNG::uniform<float>());
     return { SurfaceHit(sample, primID, this), pdf };
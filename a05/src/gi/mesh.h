@@ -1,9 +1,11 @@
 #pragma once
 #include <tuple>
+#include <cmath>
 #include <cstdint>
 #include <embree4/rtcore.h>
 #include <vector>
 #include <memory>
+#include <glm/gtc/packing.hpp>
 
 #include "par_shapes.h"
 #include "material.h"
@@ -14,10 +16,72 @@ class aiMesh;
 class AreaLight;
 class SurfaceHit;
 
+/**
+ * @brief Mesh attribute array, either owning its elements or viewing external memory (e.g. a mapped cache file)
+ * @note Views are read-only and keep their backing memory alive via a shared owner.
+ */
+template <typename T> class MeshArray {
+public:
+    MeshArray() : ptr(nullptr), count(0) {}
+    MeshArray(const T* data, size_t size, const std::shared_ptr<const void>& owner) : ptr(data), count(size), owner(owner) {}
+
+    inline bool is_view() const { return ptr != nullptr; }
+    inline size_t size() const { return is_view() ? count : storage.size(); }
+    inline bool empty() const { return size() == 0; }
+    inline const T* data() const { return is_view() ? ptr : storage.data(); }
+    inline const T& operator[](size_t i) const { assert(i < size()); return data()[i]; }
+    inline const T* begin() const { return data(); }
+    inline const T* end() const { return data() + size(); }
+
+    // memory in bytes held by this array, respectively viewed in external memory
+    inline size_t owned_bytes() const { return storage.size() * sizeof(T); }
+    inline size_t viewed_bytes() const { return is_view() ? count * sizeof(T) : 0; }
+
+    // only for owning arrays
+    inline void reserve(size_t n) { assert(!is_view()); storage.reserve(n); }
+    template <typename... Args> inline void emplace_back(Args&&... args) { assert(!is_view()); storage.emplace_back(std::forward<Args>(args)...); }
+
+private:
+    // data
+    std::vector<T> storage;             ///< Elements, if owning
+    const T* ptr;                       ///< Elements, if viewing
+    size_t count;                       ///< Number of elements, if viewing
+    std::shared_ptr<const void> owner;  ///< Keeps viewed memory alive
+};
+
+/**
+ * @brief Encode a unit vector as octahedral map coordinates, quantized to 2x16 bit snorm
+ */
+inline uint32_t encode_octahedral(const glm::vec3& n) {
+    const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 <= 0.f) return glm::packSnorm2x16(glm::vec2(0));
+    glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+    if (n.z < 0.f) // fold lower hemisphere over the diagonals
+        p = (1.f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.f ? 1.f : -1.f, p.y >= 0.f ? 1.f : -1.f);
+    return glm::packSnorm2x16(p);
+}
+
+/**
+ * @brief Decode a unit vector from quantized octahedral map coordinates
+ */
+inline glm::vec3 decode_octahedral(uint32_t v) {
+    const glm::vec2 p = glm::unpackSnorm2x16(v);
+    glm::vec3 n(p.x, p.y, 1.f - fabsf(p.x) - fabsf(p.y));
+    const float t = fmaxf(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return glm::normalize(n);
+}
+
 class Mesh {
 public:
-    Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const aiMesh* ai_mesh);
-    Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const par_shapes_mesh_s* par_mesh);
+    // alias: use an alias table for sampling triangles by area (see Distribution1D)
+    Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const aiMesh* ai_mesh, bool alias = false);
+    Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat, const par_shapes_mesh_s* par_mesh, bool alias = false);
+    // from prepared buffers, e.g. views into a mapped cache file (see MeshCache)
+    // note: vertex attribute views need to be readable for 4 bytes past their end (embree SSE padding)
+    Mesh(RTCDevice& device, RTCScene& scene, const std::shared_ptr<Material>& mat,
+        MeshArray<glm::vec3>&& vbo, MeshArray<glm::uvec3>&& ibo, MeshArray<glm::vec3>&& normals, MeshArray<glm::vec2>&& tcs, bool alias = false);
     ~Mesh();
 
     Mesh(const Mesh&)            = delete;
@@ -31,6 +95,28 @@ public:
 
     inline bool is_light() const { assert(mat); return mat->emissive_strength > 0.f; }
 
+    inline bool is_compressed() const { return !normals_oct.empty(); }
+
+    inline bool has_tcs() const { return !tcs.empty() || !tcs_half.empty(); }
+
+    // vertex attribute access, decodes compressed attributes
+    inline glm::vec3 normal(uint32_t i) const { return normals_oct.empty() ? normals[i] : decode_octahedral(normals_oct[i]); }
+    inline glm::vec2 tc(uint32_t i) const { return tcs_half.empty() ? tcs[i] : glm::unpackHalf2x16(tcs_half[i]); }
+
+    // memory owned by the normal and texcoord buffers in bytes, excluding views into mapped cache files
+    inline size_t attribute_bytes() const {
+        return normals.owned_bytes() + tcs.owned_bytes() + (normals_oct.size() + tcs_half.size()) * sizeof(uint32_t);
+    }
+
+    // memory of the normal and texcoord buffers viewed in mapped cache files in bytes (paged in on demand)
+    inline size_t mapped_attribute_bytes() const { return normals.viewed_bytes() + tcs.viewed_bytes(); }
+
+    /**
+     * @brief Replace normals by octahedral 2x16 bit and texcoords by 2x16 bit half float encodings (32 -> 20 bytes per vertex)
+     * @note Irreversible, e.g. the mesh can no longer be written to a MeshCache afterwards.
+     */
+    void compress();
+
     /**
      * @brief Importance sample a triangle of the mesh according to the relative area
      *
@@ -41,14 +127,40 @@ public:
      */
     std::tuple<SurfaceHit, float> sample(const glm::vec2& sample) const;
 
+    /**
+     * @brief Commit the embree geometry with the given BVH build quality
+     * @note Thread-safe for distinct meshes. The geometry has to be attached via attach() afterwards.
+     *
+     * @param quality Embree build quality of this geometry
+     */
+    void commit(RTCBuildQuality quality);
+
+    /**
+     * @brief Attach the committed geometry to the embree scene and assign its geomID
+     * @note Not thread-safe, attach meshes in a fixed order for deterministic geomIDs.
+     */
+    void attach();
+
+private:
+    // compute bounds, hand buffers to embree and build area distribution and light, once all buffers are filled
+    void init(bool alias);
+
+public:
     // data
     RTCGeometry geom;                                   ///< Embree geometry
-    uint32_t geomID;                                    ///< Embree geometry ID
-    std::vector<glm::vec3> vbo;                         ///< Vertex buffer
-    std::vector<glm::uvec3> ibo;                        ///< Index buffer
-    std::vector<glm::vec3> normals;                     ///< Normals buffer
-    std::vector<glm::vec2> tcs;                         ///< Texture coor buffer
+    uint32_t geomID;                                    ///< Embree geometry ID (-1 until attached)
+    RTCBuildQuality build_quality;                      ///< Embree build quality of the last commit
+    MeshArray<glm::vec3> vbo;                           ///< Vertex buffer
+    MeshArray<glm::uvec3> ibo;                          ///< Index buffer
+    MeshArray<glm::vec3> normals;                       ///< Normals buffer
+    MeshArray<glm::vec2> tcs;                           ///< Texture coor buffer
+    std::vector<uint32_t> normals_oct;                  ///< Octahedral encoded normals (replaces normals if compressed)
+    std::vector<uint32_t> tcs_half;                     ///< Half float texture coords (replaces tcs if compressed)
     std::shared_ptr<Material> mat;                      ///< Pointer to material
+    // per triangle data (SoA), precomputed from the vertex and index buffers
+    std::vector<float> areas;                           ///< Surface area per triangle
+    std::vector<glm::vec3> face_normals;                ///< Unit face normal per triangle, oriented along the vertex normals
+    std::vector<float> uv_areas;                        ///< Texture coordinate space area per triangle (empty without texcoords)
     std::shared_ptr<Distribution1D> area_distribution;  ///< Area distribution of triangles for importance sampling
     glm::vec3 bb_min;                                   ///< AABB (lower left corner)
     glm::vec3 bb_max;                                   ///< AABB (upper right corner)
@@ -0,0 +1,205 @@
+#include "mesh_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char CACHE_MAGIC[8] = "GICACHE";
+
+inline uint64_t align16(uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+
+// ---------------------------------------------------------
+// reading
+
+std::shared_ptr<MeshCache> MeshCache::open(const std::filesystem::path& source, uint32_t import_flags) {
+    const std::filesystem::path path = cache_path(source);
+    if (!std::filesystem::exists(path) || !std::filesystem::exists(source)) return nullptr;
+    try {
+        auto cache = std::make_shared<MeshCache>();
+        cache->file = std::make_shared<MappedFile>(path);
+        const MappedFile& file = *cache->file;
+        if (file.size() < sizeof(Header)) return nullptr;
+        // validate header
+        const Header& header = *file.at<Header>(0);
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != VERSION || header.import_flags != import_flags)
+            return nullptr;
+        if (header.source_size != std::filesystem::file_size(source))
+            return nullptr;
+        // only hash the source if it was touched since writing the cache
+        if (header.source_time != file_time(source)) {
+            const MappedFile mapped_source(source);
+            if (header.source_hash != fnv1a(mapped_source.data(), mapped_source.size()))
+                return nullptr;
+        }
+        // read material records
+        size_t offset = sizeof(Header);
+        for (uint32_t i = 0; i < header.num_materials; ++i) {
+            if (offset + sizeof(MaterialEntry) > file.size()) return nullptr;
+            MaterialEntry entry; // may be unaligned after the strings of the previous record
+            std::memcpy(&entry, file.at<MaterialEntry>(offset), sizeof(MaterialEntry));
+            offset += sizeof(MaterialEntry);
+            MaterialRecord record;
+            record.albedo_col = glm::vec3(entry.albedo_col[0], entry.albedo_col[1], entry.albedo_col[2]);
+            record.emissive_strength = entry.emissive_strength;
+            record.ior = entry.ior;
+            record.roughness_val = entry.roughness_val;
+            for (uint32_t s = 0; s < 1 + MaterialRecord::NUM_TEXTURES; ++s) {
+                if (offset + entry.string_length[s] > file.size()) return nullptr;
+                std::string& str = s == 0 ? record.name : record.textures[s - 1];
+                str.assign(file.at<char>(offset), entry.string_length[s]);
+                offset += entry.string_length[s];
+            }
+            cache->materials.push_back(record);
+        }
+        // read mesh entries and validate buffer ranges
+        if (header.meshes_offset + uint64_t(header.num_meshes) * sizeof(MeshEntry) > file.size()) return nullptr;
+        const MeshEntry* entries = file.at<MeshEntry>(header.meshes_offset);
+        cache->entries.assign(entries, entries + header.num_meshes);
+        for (const MeshEntry& entry : cache->entries) {
+            // vertex attributes are padded by one element (embree SSE padding)
+            const uint64_t verts = entry.num_vertices + 1;
+            if (entry.material >= cache->materials.size() ||
+                entry.vbo + verts * sizeof(glm::vec3) > file.size() ||
+                entry.normals + verts * sizeof(glm::vec3) > file.size() ||
+                (entry.has_tcs && entry.tcs + verts * sizeof(glm::vec2) > file.size()) ||
+                entry.ibo + entry.num_triangles * sizeof(glm::uvec3) > file.size())
+                return nullptr;
+        }
+        return cache;
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: failed to read mesh cache " << path << ": " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+MeshArray<glm::vec3> MeshCache::vbo(size_t i) const {
+    return MeshArray<glm::vec3>(file->at<glm::vec3>(entries[i].vbo), entries[i].num_vertices, file);
+}
+
+MeshArray<glm::uvec3> MeshCache::ibo(size_t i) const {
+    return MeshArray<glm::uvec3>(file->at<glm::uvec3>(entries[i].ibo), entries[i].num_triangles, file);
+}
+
+MeshArray<glm::vec3> MeshCache::normals(size_t i) const {
+    return MeshArray<glm::vec3>(file->at<glm::vec3>(entries[i].normals), entries[i].num_vertices, file);
+}
+
+MeshArray<glm::vec2> MeshCache::tcs(size_t i) const {
+    if (!entries[i].has_tcs) return MeshArray<glm::vec2>();
+    return MeshArray<glm::vec2>(file->at<glm::vec2>(entries[i].tcs), entries[i].num_vertices, file);
+}
+
+// ---------------------------------------------------------
+// writing
+
+bool MeshCache::write(const std::filesystem::path& source, uint32_t import_flags, const std::vector<MaterialRecord>& materials,
+        const std::vector<std::shared_ptr<Mesh>>& meshes, const std::vector<uint32_t>& mesh_materials) {
+    assert(meshes.size() == mesh_materials.size());
+    const std::filesystem::path path = cache_path(source);
+    // write to a temporary file first, so concurrent or aborted writes never leave a truncated cache behind
+    const std::filesystem::path tmp_path = path.string() + ".tmp";
+    try {
+        Header header;
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = VERSION;
+        header.import_flags = import_flags;
+        {
+            const MappedFile mapped_source(source);
+            header.source_hash = fnv1a(mapped_source.data(), mapped_source.size());
+            header.source_size = mapped_source.size();
+            header.source_time = file_time(source);
+        }
+        header.num_materials = materials.size();
+        header.num_meshes = meshes.size();
+
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        uint64_t offset = 0;
+        const auto put = [&](const void* data, size_t size) {
+            out.write((const char*)data, size);
+            offset += size;
+        };
+        const auto pad = [&]() {
+            static const char zeros[16] = { 0 };
+            put(zeros, align16(offset) - offset);
+        };
+
+        // header and materials
+        put(&header, sizeof(Header));
+        for (const MaterialRecord& record : materials) {
+            MaterialEntry entry;
+            entry.albedo_col[0] = record.albedo_col.x, entry.albedo_col[1] = record.albedo_col.y, entry.albedo_col[2] = record.albedo_col.z;
+            entry.emissive_strength = record.emissive_strength;
+            entry.ior = record.ior;
+            entry.roughness_val = record.roughness_val;
+            entry.string_length[0] = record.name.size();
+            for (uint32_t s = 0; s < MaterialRecord::NUM_TEXTURES; ++s)
+                entry.string_length[1 + s] = record.textures[s].size();
+            put(&entry, sizeof(MaterialEntry));
+            put(record.name.data(), record.name.size());
+            for (uint32_t s = 0; s < MaterialRecord::NUM_TEXTURES; ++s)
+                put(record.textures[s].data(), record.textures[s].size());
+        }
+
+        // mesh entries, buffer offsets are known up front
+        pad();
+        header.meshes_offset = offset;
+        std::vector<MeshEntry> entries(meshes.size());
+        uint64_t buffers = align16(offset + meshes.size() * sizeof(MeshEntry));
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            const Mesh& mesh = *meshes[i];
+            assert(!mesh.is_compressed());
+            MeshEntry& entry = entries[i];
+            entry.material = mesh_materials[i];
+            entry.has_tcs = !mesh.tcs.empty();
+            entry.num_vertices = mesh.num_vertices();
+            entry.num_triangles = mesh.num_triangles();
+            entry.vbo = buffers;
+            buffers = align16(buffers + (entry.num_vertices + 1) * sizeof(glm::vec3));
+            entry.normals = buffers;
+            buffers = align16(buffers + (entry.num_vertices + 1) * sizeof(glm::vec3));
+            entry.tcs = buffers;
+            if (entry.has_tcs)
+                buffers = align16(buffers + (entry.num_vertices + 1) * sizeof(glm::vec2));
+            entry.ibo = buffers;
+            buffers = align16(buffers + entry.num_triangles * sizeof(glm::uvec3));
+        }
+        put(entries.data(), entries.size() * sizeof(MeshEntry));
+
+        // buffers, vertex attributes padded by one element
+        const glm::vec3 zero(0);
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            const Mesh& mesh = *meshes[i];
+            pad();
+            assert(offset == entries[i].vbo);
+            put(mesh.vbo.data(), mesh.vbo.size() * sizeof(glm::vec3));
+            put(&zero, sizeof(glm::vec3));
+            pad();
+            put(mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3));
+            put(&zero, sizeof(glm::vec3));
+            pad();
+            if (entries[i].has_tcs) {
+                put(mesh.tcs.data(), mesh.tcs.size() * sizeof(glm::vec2));
+                put(&zero, sizeof(glm::vec2));
+                pad();
+            }
+            put(mesh.ibo.data(), mesh.ibo.size() * sizeof(glm::uvec3));
+        }
+
+        // patch header with mesh offset
+        out.seekp(0);
+        out.write((const char*)&header, sizeof(Header));
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp_path);
+            return false;
+        }
+        std::filesystem::rename(tmp_path, path);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: failed to write mesh cache " << path << ": " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+#include <glm/glm.hpp>
+
+#include "mmap.h"
+#include "mesh.h"
+#include "material.h"
+
+/**
+ * @brief Versioned binary cache (.gicache in the cache directory, see cache_file_path()) of an imported mesh file, to skip
+ * the assimp import on repeated loads
+ *
+ * The cache is keyed on the size, modification time and an FNV-1a hash of the source file and on the assimp import flags
+ * and stores material records followed by the raw vertex, normal, texcoord and index buffers of all meshes. On load, the
+ * file is memory mapped and mesh buffers are views into the mapping, which embree uses as shared buffers without any copies.
+ * @note Staleness is checked via size and modification time, the source is only hashed if its modification time changed.
+ * Only the mesh file itself is checked, changes to referenced files (e.g. .mtl) require deleting the cache.
+ */
+class MeshCache {
+public:
+    static constexpr uint32_t VERSION = 2;  ///< Bump on any change to the file layout
+
+    /**
+     * @brief Open the cache of a mesh file, if present and up to date
+     *
+     * @param source Path to the mesh file
+     * @param import_flags Assimp flags used to import the mesh file
+     *
+     * @return Cache or nullptr if missing, stale or invalid
+     */
+    static std::shared_ptr<MeshCache> open(const std::filesystem::path& source, uint32_t import_flags);
+
+    /**
+     * @brief Write the cache of an imported mesh file
+     *
+     * @param source Path to the mesh file
+     * @param import_flags Assimp flags used to import the mesh file
+     * @param materials Imported materials
+     * @param meshes Imported meshes
+     * @param mesh_materials Index into materials per mesh
+     *
+     * @return True on success
+     */
+    static bool write(const std::filesystem::path& source, uint32_t import_flags, const std::vector<MaterialRecord>& materials,
+        const std::vector<std::shared_ptr<Mesh>>& meshes, const std::vector<uint32_t>& mesh_materials);
+
+    static std::filesystem::path cache_path(const std::filesystem::path& source) { return cache_file_path(source, ".gicache"); }
+
+    inline size_t num_meshes() const { return entries.size(); }
+    inline uint32_t mesh_material(size_t i) const { return entries[i].material; }
+
+    // views into the mapped file, kept alive as long as any view exists
+    MeshArray<glm::vec3> vbo(size_t i) const;
+    MeshArray<glm::uvec3> ibo(size_t i) const;
+    MeshArray<glm::vec3> normals(size_t i) const;
+    MeshArray<glm::vec2> tcs(size_t i) const;
+
+    // on-disk layout: Header, MaterialEntry + strings per material, MeshEntry per mesh, buffers (16 byte aligned)
+    struct Header {
+        char magic[8];              ///< "GICACHE"
+        uint32_t version;           ///< File layout version
+        uint32_t import_flags;      ///< Assimp import flags
+        uint64_t source_hash;       ///< FNV-1a hash over the mesh file
+        uint64_t source_size;       ///< Size of the mesh file in bytes
+        int64_t source_time;        ///< Modification time of the mesh file
+        uint32_t num_materials;     ///< Number of material records
+        uint32_t num_meshes;        ///< Number of mesh entries
+        uint64_t meshes_offset;     ///< File offset of the first mesh entry
+    };
+
+    struct MaterialEntry {
+        float albedo_col[3];
+        float emissive_strength;
+        float ior;
+        float roughness_val;
+        uint32_t string_length[1 + MaterialRecord::NUM_TEXTURES]; ///< Name and texture paths, stored after this entry
+    };
+
+    struct MeshEntry {
+        uint32_t material;          ///< Index into materials
+        uint32_t has_tcs;           ///< Texcoords present?
+        uint64_t num_vertices;      ///< Number of vertices
+        uint64_t num_triangles;     ///< Number of triangles
+        uint64_t vbo, normals, tcs, ibo; ///< File offsets of the buffers
+    };
+
+    // data
+    std::vector<MaterialRecord> materials;  ///< Material records
+    std::vector<MeshEntry> entries;         ///< Mesh entries
+    std::shared_ptr<MappedFile> file;       ///< Mapped cache file
+};
@@ -0,0 +1,101 @@
+#include "mmap.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// ---------------------------------------------------------
+// MappedFile
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path) : ptr(nullptr), bytes(0) {
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Error: failed to open file: " + path.string());
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Error: failed to stat file: " + path.string());
+    }
+    bytes = size.QuadPart;
+    if (bytes > 0) {
+        const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        // the view stays valid after closing the mapping and file handles
+        if (mapping) CloseHandle(mapping);
+        if (!view) {
+            CloseHandle(file);
+            throw std::runtime_error("Error: failed to map file: " + path.string());
+        }
+        ptr = (const uint8_t*)view;
+    }
+    CloseHandle(file);
+}
+
+MappedFile::~MappedFile() {
+    if (ptr) UnmapViewOfFile(ptr);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) : ptr(nullptr), bytes(0) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Error: failed to open file: " + path.string());
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Error: failed to stat file: " + path.string());
+    }
+    bytes = st.st_size;
+    if (bytes > 0) {
+        void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Error: failed to map file: " + path.string());
+        }
+        ptr = (const uint8_t*)mapping;
+    }
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (ptr) munmap((void*)ptr, bytes);
+}
+
+#endif
+
+void MappedFile::prefetch() const {
+#ifndef _WIN32
+    if (ptr) madvise((void*)ptr, bytes, MADV_WILLNEED);
+#endif
+}
+
+// ---------------------------------------------------------
+// cache files
+
+std::filesystem::path cache_file_path(const std::filesystem::path& source, const std::string& extension) {
+    static const std::filesystem::path dir = []() {
+        std::error_code ec;
+        const char* env = std::getenv("GI_CACHE_DIR");
+        std::filesystem::path dir = env && *env ? std::filesystem::path(env) : std::filesystem::temp_directory_path(ec) / "gi_cache";
+        std::filesystem::create_directories(dir, ec);
+        return dir;
+    }();
+    const std::string absolute = std::filesystem::absolute(source).string();
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a(absolute.data(), absolute.size()));
+    return dir / (source.filename().string() + "." + hash + extension);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <filesystem>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ * @note The mapping is private, pages are loaded lazily by the OS on first access.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Map the given file into memory
+     * @note Throws std::runtime_error if the file cannot be opened or mapped.
+     *
+     * @param path File to map
+     */
+    MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline const uint8_t* data() const { return ptr; }
+    inline size_t size() const { return bytes; }
+
+    template <typename T> inline const T* at(size_t offset) const { return (const T*)(ptr + offset); }
+
+    /**
+     * @brief Hint the OS to read the whole file into the page cache ahead of the first access
+     * @note Returns immediately, pages are read asynchronously. No-op on Windows.
+     */
+    void prefetch() const;
+
+private:
+    // data
+    const uint8_t* ptr;     ///< Start of the mapping
+    size_t bytes;           ///< Size of the mapping in bytes
+};
+
+/**
+ * @brief 64-bit FNV-1a hash
+ *
+ * @param data Bytes to hash
+ * @param size Number of bytes
+ * @param hash Hash to continue from, use the default to start a new hash
+ *
+ * @return Hash over the given bytes
+ */
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Modification time of a file, stored in cache headers to detect stale caches
+ *
+ * @param path File to query
+ *
+ * @return Modification time in ticks of the filesystem clock
+ */
+inline int64_t file_time(const std::filesystem::path& path) {
+    return std::filesystem::last_write_time(path).time_since_epoch().count();
+}
+
+/**
+ * @brief Path of a generated cache file (e.g. mesh cache, tiled texture) for a source file
+ * @note Cache files are stored in $GI_CACHE_DIR if set, else in "gi_cache" within the system temp directory (created on
+ * demand), so data directories stay untouched. File names combine the source file name with a hash of its absolute path.
+ *
+ * @param source Path to the source file
+ * @param extension Extension of the cache file, including the dot
+ *
+ * @return Path to the cache file
+ */
+std::filesystem::path cache_file_path(const std::filesystem::path& source, const std::string& extension);
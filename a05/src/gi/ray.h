@@ -20,7 +20,9 @@ public:
         flags(0),
         primID(RTC_INVALID_GEOMETRY_ID),
         geomID(RTC_INVALID_GEOMETRY_ID),
-        instID(RTC_INVALID_GEOMETRY_ID) {}
+        instID(RTC_INVALID_GEOMETRY_ID),
+        cone_width(0),
+        cone_spread(0) {}
 
     /**
      * @brief Construct as valid ray
@@ -38,7 +40,9 @@ public:
         flags(0),
         primID(RTC_INVALID_GEOMETRY_ID),
         geomID(RTC_INVALID_GEOMETRY_ID),
-        instID(RTC_INVALID_GEOMETRY_ID) {}
+        instID(RTC_INVALID_GEOMETRY_ID),
+        cone_width(0),
+        cone_spread(0) {}
 
     /**
      * @brief Test if ray has hit something
@@ -56,6 +60,16 @@ public:
      */
     inline glm::vec3 operator()(float t) const { return org + t * dir; }
 
+    /**
+     * @brief Continue the ray cone of a parent ray, e.g. after a specular bounce
+     *
+     * @param parent Parent ray, after intersection (tfar is the hit distance)
+     */
+    inline void continue_cone(const Ray& parent) {
+        cone_width = parent.cone_width + parent.cone_spread * parent.tfar;
+        cone_spread = parent.cone_spread;
+    }
+
     // ray data
     glm::vec3 org;              ///< World space ray origin
     float tnear;                ///< Start of ray segment
@@ -73,9 +87,68 @@ public:
     unsigned int geomID;        ///< Hit geometry ID
     unsigned int instID;        ///< Hit instance ID
     unsigned int instPrimID;    ///< Hit instance primitive ID
+    // ray cone for texture filtering (not touched by embree)
+    float cone_width;           ///< World space cone width at the ray origin
+    float cone_spread;          ///< Cone spread angle, 0 disables texture filtering
 };
 
 // some helpful embree conversions
 inline RTCRayHit* toRTCRayHit(Ray &ray) { return (RTCRayHit*)&ray; }
 inline RTCRay* toRTCRay(Ray &ray) { return (RTCRay*)&ray; }
 inline RTCHit* toRTCHit(Ray &ray) { return (RTCHit*)&(ray.Ng.x); }
+
+// ---------------------------------------------------------
+// SoA ray packets for coherent batches of rays
+
+static constexpr uint32_t PACKET_SIZE = 8;
+
+/**
+ * @brief Packet of PACKET_SIZE rays in SoA layout, as expected by rtcIntersect8/rtcOccluded8
+ */
+struct RTC_ALIGN(32) RayPacket {
+    /**
+     * @brief Store a ray in the given lane and activate it
+     *
+     * @param i Lane index
+     * @param ray Ray to store
+     */
+    inline void set(uint32_t i, const Ray& ray) {
+        rayhit.ray.org_x[i] = ray.org.x;
+        rayhit.ray.org_y[i] = ray.org.y;
+        rayhit.ray.org_z[i] = ray.org.z;
+        rayhit.ray.tnear[i] = ray.tnear;
+        rayhit.ray.dir_x[i] = ray.dir.x;
+        rayhit.ray.dir_y[i] = ray.dir.y;
+        rayhit.ray.dir_z[i] = ray.dir.z;
+        rayhit.ray.time[i] = 0.f;
+        rayhit.ray.tfar[i] = ray.tfar;
+        rayhit.ray.mask[i] = ray.mask;
+        rayhit.ray.id[i] = i;
+        rayhit.ray.flags[i] = 0;
+        rayhit.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+        rayhit.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+        // degenerate rays (e.g. failed light samples) stay inactive
+        valid[i] = ray.tnear <= ray.tfar ? -1 : 0;
+    }
+
+    /**
+     * @brief Write segment end and hit data of the given lane back into a ray
+     *
+     * @param i Lane index
+     * @param ray Ray to update
+     */
+    inline void get(uint32_t i, Ray& ray) const {
+        if (!valid[i]) return;
+        ray.tfar = rayhit.ray.tfar[i];
+        ray.Ng = glm::vec3(rayhit.hit.Ng_x[i], rayhit.hit.Ng_y[i], rayhit.hit.Ng_z[i]);
+        ray.u = rayhit.hit.u[i];
+        ray.v = rayhit.hit.v[i];
+        ray.primID = rayhit.hit.primID[i];
+        ray.geomID = rayhit.hit.geomID[i];
+        ray.instID = rayhit.hit.instID[0][i];
+    }
+
+    // data
+    int valid[PACKET_SIZE];     ///< Lane mask (-1: active, 0: inactive)
+    RTCRayHit8 rayhit;          ///< SoA ray and hit data
+};
@@ -1,8 +1,8 @@
 #pragma once
 
 #include <omp.h>
-#include <random>
 #include <vector>
+#include <cstdint>
 #include <climits>
 #include <algorithm>
 #include "glm/glm.hpp"
@@ -10,14 +10,32 @@
 // -------------------------------------
 // Random generator interface
 
+static constexpr uint32_t RNG_CAMERA_DIMS = 4;      ///< Dimensions reserved for the camera ray (pixel and lens sample)
+static constexpr uint32_t RNG_BOUNCE_DIMS = 16;     ///< Dimensions reserved per path vertex
+
 /**
- * @brief Random generator engine for concurrent usage in multiple OMP threads
+ * @brief Stateless counter-based random generator for concurrent usage in multiple OMP threads
  *
- * The C++ random engine is hidden behind a lazy instantiated singleton (yes.) instance.
+ * Each random number is a hash of a 64 bit key and a counter. The key is derived from (pixel, sample index)
+ * via seed(), the counter starts at the given dimension and increments with every draw. Thus, results only
+ * depend on where a sample is taken and not on the thread or the order in which pixels are processed.
+ * Without a call to seed(), each thread draws from its own default stream.
  */
 class RNG {
 public:
 
+    /**
+     * @brief Select the stream of the calling thread
+     *
+     * @param pixel Pixel index (e.g. y * w + x), or any other index identifying the sample domain
+     * @param sample Sample index within the pixel
+     * @param dimension First sample dimension to draw
+     */
+    inline static void seed(uint32_t pixel, uint32_t sample, uint32_t dimension = 0) {
+        state.key = mix((uint64_t(pixel) << 32) | sample);
+        state.counter = dimension;
+    }
+
     /**
      * @brief Generic function to retrieve random samples of templated type
      *
@@ -35,8 +53,8 @@ public:
      * @return Random float in [0.f, 1.f)
      */
     inline static float uniform_float() {
-        // there's a bug in the C++ standard on windows, causing 1.f as possible return value
-        return std::min(instance().uniform_float_distribution(instance().per_thread_rng[omp_get_thread_num()]), 0.99999f);
+        // upper 24 bits fit the mantissa exactly, so 1.f can never be returned
+        return (uniform_uint() >> 8) * 0x1p-24f;
     }
 
     /**
@@ -45,7 +63,7 @@ public:
      * @return Random unsigned integer in [0, UINT_MAX]
      */
     inline static uint32_t uniform_uint() {
-        return instance().uniform_uint_distribution(instance().per_thread_rng[omp_get_thread_num()]);
+        return uint32_t(mix(state.key + 0x9e3779b97f4a7c15ull * ++state.counter) >> 32);
     }
 
     /**
@@ -54,30 +72,37 @@ public:
      * @param target Vector of samples to be shuffled
      */
     template <typename T> inline static void shuffle(std::vector<T>& target) {
-        std::shuffle(target.begin(), target.end(), instance().per_thread_rng[omp_get_thread_num()]);
+        std::shuffle(target.begin(), target.end(), Engine());
     }
 
+    /**
+     * @brief Adapter to use the current stream as UniformRandomBitGenerator, e.g. for std::shuffle
+     */
+    struct Engine {
+        using result_type = uint32_t;
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return UINT_MAX; }
+        inline result_type operator()() { return uniform_uint(); }
+    };
+
+    RNG()                       = delete;
     RNG(const RNG&)             = delete;
     RNG& operator=(const RNG&)  = delete;
     RNG& operator=(const RNG&&) = delete;
 
-protected:
-    inline static RNG& instance() {
-        static RNG rng;
-        return rng;
-    }
-
 private:
-    RNG() : per_thread_rng(omp_get_max_threads()) {
-        for (int i = 0; i < omp_get_max_threads(); ++i)
-            per_thread_rng[i].seed(i);
+    // splitmix64 finalizer
+    inline static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
     }
 
-    ~RNG() {}
-
-    std::vector<std::mt19937> per_thread_rng;
-    std::uniform_real_distribution<float> uniform_float_distribution{0.f, 1.f};
-    std::uniform_int_distribution<uint32_t> uniform_uint_distribution{0, UINT_MAX};
+    struct State {
+        uint64_t key;
+        uint64_t counter;
+    };
+    inline static thread_local State state = { mix(~uint64_t(omp_get_thread_num())), 0 };
 };
 
 // uniform<T>() specializations
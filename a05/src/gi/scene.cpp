@@ -2,13 +2,20 @@
 #include "ray.h"
 #include "distribution.h"
 #include "light.h"
+#include "light_bvh.h"
 #include "material.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
+#include "instance.h"
 #include "timer.h"
 #include "color.h"
 
 #include <cfloat>
 #include <iostream>
+#include <algorithm>
+#include <exception>
+#include <omp.h>
 
 #include <assimp/material.h>
 #include <assimp/postprocess.h>
@@ -33,72 +40,200 @@ Scene::~Scene() {
 void Scene::clear() {
     // clear this scene
     mesh_files.clear();
+    instances.clear();
+    prototypes.clear();
     meshes.clear();
     rtcCommitScene(scene);
+    mark_dirty(DIRTY_ALL);
     materials.clear();
+    TextureCache::global().clear();
     lights.clear();
     sky.reset();
     volume.reset();
+    volume_light.reset();
     volume_path.clear();
     light_distribution.reset();
+    light_bvh.reset();
     bb_min = glm::vec3(FLT_MAX), bb_max = glm::vec3(FLT_MIN), center = glm::vec3(0);
     radius = FLT_MIN;
 }
 
+std::vector<std::shared_ptr<Mesh>> Scene::import_meshes(const std::filesystem::path& path, RTCScene& target) {
+    Timer timer;
+    timer.start("load");
+
+    // textures of the imported materials are loaded tiled if the texture cache has a budget
+    TextureCache::global().set_budget(size_t(TEXTURE_CACHE_MB) << 20);
+
+    const uint32_t ass_flags = aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_OptimizeMeshes;
+    const std::shared_ptr<MeshCache> cache = MESH_CACHE ? MeshCache::open(path, ass_flags) : nullptr;
+    const uint32_t material_offset = materials.size();
+    std::vector<std::shared_ptr<Mesh>> imported;
+
+    // construct materials in parallel, as loading their textures dominates, errors are rethrown after the loop
+    // (one level of parallelism: with fewer materials than threads, load them one by one and let the texture loops use all threads instead)
+    const auto add_materials = [&](const std::vector<MaterialRecord>& records) {
+        materials.resize(material_offset + records.size());
+        std::exception_ptr error;
+        #pragma omp parallel for schedule(dynamic) if(int(records.size()) >= omp_get_max_threads())
+        for (int i = 0; i < int(records.size()); ++i) {
+            try {
+                materials[material_offset + i] = std::make_shared<Material>(records[i], path.parent_path(), false);
+            } catch (...) {
+                #pragma omp critical
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error) std::rethrow_exception(error);
+        // register in index order, independent of the completion order of the loop
+        for (size_t i = 0; i < records.size(); ++i)
+            Material::add_instance(materials[material_offset + i].get());
+    };
+
+    if (cache) {
+        // extract materials and meshes from the mapped cache, mesh buffers are views into the mapping
+        add_materials(cache->materials);
+        imported.resize(cache->num_meshes());
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < int(cache->num_meshes()); ++i) {
+            const auto& mat = materials[material_offset + cache->mesh_material(i)];
+            imported[i] = std::make_shared<Mesh>(device, target, mat, cache->vbo(i), cache->ibo(i), cache->normals(i), cache->tcs(i), ALIAS_SAMPLING);
+            imported[i]->commit(BVH_QUALITY);
+        }
+    } else {
+        const aiScene* scene_ai = importer.ReadFile(path.string().c_str(), ass_flags);
+        if (!scene_ai)
+            throw std::runtime_error("Error: failed to load mesh: " + path.string());
+
+        // extract materials
+        std::vector<MaterialRecord> records;
+        for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i)
+            records.emplace_back(scene_ai->mMaterials[i]);
+        add_materials(records);
+
+        // extract meshes in parallel
+        std::vector<uint32_t> mesh_materials(scene_ai->mNumMeshes);
+        imported.resize(scene_ai->mNumMeshes);
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < int(scene_ai->mNumMeshes); ++i) {
+            const aiMesh* ai_mesh = scene_ai->mMeshes[i];
+            const auto& mat = materials[material_offset + ai_mesh->mMaterialIndex];
+            imported[i] = std::make_shared<Mesh>(device, target, mat, ai_mesh, ALIAS_SAMPLING);
+            imported[i]->commit(BVH_QUALITY);
+            mesh_materials[i] = ai_mesh->mMaterialIndex;
+        }
+
+        // store cache for the next load
+        if (MESH_CACHE && !MeshCache::write(path, ass_flags, records, imported, mesh_materials))
+            std::cerr << "Warning: failed to write mesh cache " << MeshCache::cache_path(path) << std::endl;
+    }
+
+    // compress vertex attributes (after writing the cache, which stores full precision)
+    if (COMPRESS_ATTRIBUTES) {
+        size_t bytes_before = 0, bytes_after = 0, mapped_before = 0, mapped_after = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+: bytes_before, bytes_after, mapped_before, mapped_after)
+        for (int i = 0; i < int(imported.size()); ++i) {
+            bytes_before += imported[i]->attribute_bytes();
+            mapped_before += imported[i]->mapped_attribute_bytes();
+            imported[i]->compress();
+            bytes_after += imported[i]->attribute_bytes();
+            mapped_after += imported[i]->mapped_attribute_bytes();
+        }
+        std::cout << "compressed vertex attributes: " << bytes_before / 1048576.0 << "MB owned + " << mapped_before / 1048576.0 << "MB mapped -> "
+            << bytes_after / 1048576.0 << "MB owned + " << mapped_after / 1048576.0 << "MB mapped" << std::endl;
+    }
+
+    timer.stop("load");
+    std::cout << "loaded " << imported.size() << " meshes " << (cache ? "from cache" : "via assimp") << " in " << timer.get_ms("load") << "ms" << std::endl;
+    return imported;
+}
+
 void Scene::load_mesh(const std::filesystem::path& path) {
     const std::filesystem::path resolved_path = std::filesystem::exists(path) ? path : std::filesystem::path(GI_DATA_DIR) / path;
     std::cout << "loading: " << path << " (" << resolved_path << ")..." << std::endl;
-
-    const uint32_t ass_flags = aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_OptimizeMeshes;
-    const aiScene* scene_ai = importer.ReadFile(resolved_path.string().c_str(), ass_flags);
-    if (!scene_ai)
-        throw std::runtime_error("Error: failed to load mesh: " + path.string());
+    const std::vector<std::shared_ptr<Mesh>> imported = import_meshes(resolved_path, scene);
 
     // remember relative path
     mesh_files.push_back(path);
 
-    // extract materials
-    uint32_t material_offset = materials.size();
-    materials.resize(materials.size() + scene_ai->mNumMaterials);
-    for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i)
-        materials[material_offset + i] = std::make_shared<Material>(scene_ai->mMaterials[i], resolved_path.parent_path());
-
-    // extract meshes
-    uint32_t mesh_offset = meshes.size();
-    meshes.resize(meshes.size() + scene_ai->mNumMeshes);
-    for (uint32_t i = 0; i < scene_ai->mNumMeshes; ++i) {
-        const aiMesh* ai_mesh = scene_ai->mMeshes[i];
-        const auto& mat = materials[material_offset + ai_mesh->mMaterialIndex];
-        meshes[mesh_offset + i] = std::make_shared<Mesh>(device, scene, mat, ai_mesh);
-        // update AABB and radius
-        bb_min = glm::min(bb_min, meshes[mesh_offset + i]->bb_min);
-        bb_max = glm::max(bb_max, meshes[mesh_offset + i]->bb_max);
-        center = (bb_min + bb_max) * .5f;
-        radius = glm::length(bb_max - bb_min) * .5f;
+    // attach in order for deterministic geomIDs and update AABB and radius
+    for (const auto& mesh : imported) {
+        mesh->attach();
+        meshes.push_back(mesh);
+        bb_min = glm::min(bb_min, mesh->bb_min);
+        bb_max = glm::max(bb_max, mesh->bb_max);
     }
+    center = (bb_min + bb_max) * .5f;
+    radius = glm::length(bb_max - bb_min) * .5f;
+
+    mark_dirty(DIRTY_GEOMETRY | DIRTY_EMITTERS);
+}
+
+void Scene::add_instance(const std::filesystem::path& path, const glm::mat4& transform) {
+    // find or import prototype, geometry is shared between all instances of the same mesh file
+    std::shared_ptr<Prototype> prototype;
+    for (const auto& proto : prototypes)
+        if (proto->path == path)
+            prototype = proto;
+    if (!prototype) {
+        const std::filesystem::path resolved_path = std::filesystem::exists(path) ? path : std::filesystem::path(GI_DATA_DIR) / path;
+        std::cout << "loading prototype: " << path << " (" << resolved_path << ")..." << std::endl;
+        prototype = std::make_shared<Prototype>(device, path);
+        prototype->meshes = import_meshes(resolved_path, prototype->scene);
+        for (const auto& mesh : prototype->meshes)
+            if (mesh->is_light())
+                std::cerr << "Warning: emissive material " << mesh->mat->name << " in instanced " << path << " is not used as light source" << std::endl;
+        prototype->commit(BVH_QUALITY);
+        prototypes.push_back(prototype);
+    }
+
+    // place instance and update AABB and radius
+    instances.push_back(std::make_shared<Instance>(device, scene, prototype, transform));
+    bb_min = glm::min(bb_min, instances.back()->bb_min);
+    bb_max = glm::max(bb_max, instances.back()->bb_max);
+    center = (bb_min + bb_max) * .5f;
+    radius = glm::length(bb_max - bb_min) * .5f;
+
+    mark_dirty(DIRTY_GEOMETRY);
 }
 
 void Scene::load_sky(const std::filesystem::path& path) {
     const std::filesystem::path resolved_path = std::filesystem::exists(path) ? path : std::filesystem::path(GI_DATA_DIR) / path;
     sky.reset(new SkyLight(resolved_path.string(), *this));
-    sky->build_distribution();
+    mark_dirty(DIRTY_EMITTERS);
 }
 
 void Scene::load_volume(const std::filesystem::path& path) {
     const std::filesystem::path resolved_path = std::filesystem::exists(path) ? path : std::filesystem::path(GI_DATA_DIR) / path;
     std::cout << "loading: " << path << " (" << resolved_path << ")..." << std::endl;
-    volume = std::make_shared<Volume>(resolved_path);
+    if (std::filesystem::is_directory(resolved_path)) {
+        // frame sequence: all .nvdb files of the directory in lexicographic order
+        std::vector<std::filesystem::path> frames;
+        for (const auto& entry : std::filesystem::directory_iterator(resolved_path))
+            if (entry.path().extension() == ".nvdb")
+                frames.push_back(entry.path());
+        if (frames.empty())
+            throw std::runtime_error("Error: no .nvdb files in volume sequence directory: " + resolved_path.string());
+        std::sort(frames.begin(), frames.end());
+        volume = std::make_shared<Volume>(frames[0]);
+        volume->set_sequence(frames);
+    } else
+        volume = std::make_shared<Volume>(resolved_path);
     volume_path = resolved_path;
+    mark_dirty(DIRTY_VOLUME | DIRTY_VOLUME_EMISSION);
     // update AABB and radius
     const auto [vol_bb_min, vol_bb_max] = volume->compute_AABB();
     bb_min = glm::min(bb_min, vol_bb_min);
-    bb_max = glm::max(bb_max, vol_bb_min);
+    bb_max = glm::max(bb_max, vol_bb_max);
     center = (bb_min + bb_max) * .5f;
     radius = glm::length(bb_max - bb_min) * .5f;
 }
 
 void Scene::add(const par_shapes_mesh* par_mesh, const std::shared_ptr<Material>& mat) {
-    meshes.push_back(std::make_shared<Mesh>(device, scene, mat, par_mesh));
+    meshes.push_back(std::make_shared<Mesh>(device, scene, mat, par_mesh, ALIAS_SAMPLING));
+    meshes.back()->commit(BVH_QUALITY);
+    meshes.back()->attach();
+    mark_dirty(DIRTY_GEOMETRY | DIRTY_EMITTERS);
     // update AABB and radius
     bb_min = glm::min(bb_min, meshes[meshes.size() - 1]->bb_min);
     bb_max = glm::max(bb_max, meshes[meshes.size() - 1]->bb_max);
@@ -107,34 +242,101 @@ void Scene::add(const par_shapes_mesh* par_mesh, const std::shared_ptr<Material>
 }
 
 void Scene::commit() {
-    // let embree build the BVH
-    rtcCommitScene(scene);
+    uint32_t flags = dirty.exchange(DIRTY_NONE);
+    if (flags & DIRTY_GEOMETRY) {
+        // apply BVH build quality, REFIT only exists per geometry, so the scene BVH is built with LOW quality then
+        const bool dynamic = BVH_QUALITY == RTC_BUILD_QUALITY_LOW || BVH_QUALITY == RTC_BUILD_QUALITY_REFIT;
+        rtcSetSceneFlags(scene, dynamic ? RTC_SCENE_FLAG_DYNAMIC : RTC_SCENE_FLAG_NONE);
+        rtcSetSceneBuildQuality(scene, BVH_QUALITY == RTC_BUILD_QUALITY_REFIT ? RTC_BUILD_QUALITY_LOW : BVH_QUALITY);
+        #pragma omp parallel for
+        for (int i = 0; i < int(meshes.size()); ++i)
+            if (meshes[i]->build_quality != BVH_QUALITY)
+                meshes[i]->commit(BVH_QUALITY);
+        for (auto& prototype : prototypes)
+            prototype->commit(BVH_QUALITY);
+        // let embree build the BVH
+        rtcCommitScene(scene);
+    }
+    // cache volume transforms, all other volume parameters are looked up during rendering
+    if (flags & (DIRTY_VOLUME | DIRTY_VOLUME_EMISSION)) {
+        if (volume) {
+            volume->commit();
+            // the model matrix or frame may have changed the extent of the volume
+            update_bounds();
+        }
+        // the power of the volume light follows the density and absorption scales, so only recollect lights
+        if (volume_light) flags |= DIRTY_EMITTERS;
+        // rebuild the emission distribution if emission or the frame changed (or it has no power yet)
+        if ((flags & DIRTY_VOLUME_EMISSION) || !volume_light) {
+            volume_light.reset();
+            if (volume && volume->emission_grid()) {
+                Timer timer;
+                timer.start("volume light");
+                volume_light = std::make_shared<VolumeLight>(*volume);
+                timer.stop("volume light");
+                std::cout << "built volume emission distribution over " << volume_light->voxel_cdf.size() / 512 << " leaf nodes in " << timer.get_ms("volume light") << "ms" << std::endl;
+                if (luma(volume_light->power()) > 0.f)
+                    flags |= DIRTY_EMITTERS;
+                else
+                    volume_light.reset();
+            }
+        }
+    }
     // (re-)collect light sources
-    lights.clear();
-    for (auto& mesh : meshes)
-        if (mesh->is_light())
-            lights.push_back(mesh->area_light);
-    if (sky) lights.push_back(sky);
+    std::vector<std::shared_ptr<Light>> emitters;
+    if (flags & (DIRTY_EMITTERS | DIRTY_MATERIALS)) {
+        for (auto& mesh : meshes)
+            if (mesh->is_light())
+                emitters.push_back(mesh->area_light);
+        if (sky) emitters.push_back(sky);
+        if (volume_light) emitters.push_back(volume_light);
+        // material edits only matter for light sampling if they turned a mesh into a light source or vice versa
+        if (emitters != lights)
+            flags |= DIRTY_EMITTERS;
+    }
+    if (!(flags & DIRTY_EMITTERS)) return;
+    lights = std::move(emitters);
     // build distribution for light source importance sampling
     light_distribution.reset();
     if (!lights.empty()) {
         std::vector<float> f(lights.size());
         for (uint32_t i = 0; i < lights.size(); ++i)
             f[i] = luma(lights[i]->power());
-        light_distribution = std::make_shared<Distribution1D>(f.data(), f.size());
+        light_distribution = std::make_shared<Distribution1D>(f.data(), f.size(), ALIAS_SAMPLING);
+    }
+    // build light BVH over all emissive triangles
+    light_bvh.reset();
+    if (LIGHT_BVH) {
+        light_bvh = std::make_shared<LightBVH>(meshes);
+        if (light_bvh->empty()) light_bvh.reset();
     }
 }
 
+void Scene::update_bounds() {
+    bb_min = glm::vec3(FLT_MAX), bb_max = glm::vec3(-FLT_MAX);
+    for (const auto& mesh : meshes) {
+        bb_min = glm::min(bb_min, mesh->bb_min);
+        bb_max = glm::max(bb_max, mesh->bb_max);
+    }
+    for (const auto& instance : instances) {
+        bb_min = glm::min(bb_min, instance->bb_min);
+        bb_max = glm::max(bb_max, instance->bb_max);
+    }
+    if (volume) {
+        bb_min = glm::min(bb_min, volume->bb_min);
+        bb_max = glm::max(bb_max, volume->bb_max);
+    }
+    center = (bb_min + bb_max) * .5f;
+    radius = glm::length(bb_max - bb_min) * .5f;
+}
+
 const SurfaceHit Scene::intersect(Ray &ray) const {
     {
         STAT("intersect");
         // traverse bvh and return hit
         rtcIntersect1(scene, toRTCRayHit(ray));
     }
-    if (ray)
-        return SurfaceHit(ray, get_mesh(ray.geomID));
-    else
-        return SurfaceHit(sky.get());
+    return surface_hit(ray);
 }
 
 const VolumeHit Scene::intersect_volume(Ray &ray) const {
@@ -185,6 +387,57 @@ float Scene::visibility(Ray &ray) const {
     }
 }
 
+void Scene::intersect(Ray* rays, size_t count) const {
+    RayPacket packet;
+    for (size_t i = 0; i < count; i += PACKET_SIZE) {
+        const uint32_t N = std::min(size_t(PACKET_SIZE), count - i);
+        for (uint32_t j = 0; j < PACKET_SIZE; ++j) {
+            if (j < N)
+                packet.set(j, rays[i + j]);
+            else
+                packet.valid[j] = 0;
+        }
+        {
+            STAT("intersect8");
+            // traverse bvh with the whole packet
+            rtcIntersect8(packet.valid, scene, &packet.rayhit);
+        }
+        for (uint32_t j = 0; j < N; ++j)
+            packet.get(j, rays[i + j]);
+    }
+}
+
+void Scene::occluded(Ray* rays, size_t count) const {
+    RayPacket packet;
+    for (size_t i = 0; i < count; i += PACKET_SIZE) {
+        const uint32_t N = std::min(size_t(PACKET_SIZE), count - i);
+        for (uint32_t j = 0; j < PACKET_SIZE; ++j) {
+            if (j < N)
+                packet.set(j, rays[i + j]);
+            else
+                packet.valid[j] = 0;
+        }
+        {
+            STAT("occluded8");
+            // traverse bvh with the whole packet, occluded rays get tfar = -inf
+            rtcOccluded8(packet.valid, scene, &packet.rayhit.ray);
+        }
+        for (uint32_t j = 0; j < N; ++j)
+            if (packet.valid[j])
+                rays[i + j].tfar = packet.rayhit.ray.tfar[j];
+    }
+}
+
+const SurfaceHit Scene::surface_hit(const Ray& ray) const {
+    if (!ray)
+        return SurfaceHit(sky.get());
+    if (ray.instID != RTC_INVALID_GEOMETRY_ID) {
+        const Instance* instance = get_instance(ray.instID);
+        return SurfaceHit(ray, instance->prototype->get_mesh(ray.geomID), instance);
+    }
+    return SurfaceHit(ray, get_mesh(ray.geomID));
+}
+
 std::tuple<std::shared_ptr<Light>, float> Scene::sample_light_source(float sample) const {
     assert(light_distribution && !lights.empty());
     // select and return light source
@@ -198,6 +451,42 @@ float Scene::light_source_pdf(const Light* light) const {
     return luma(light->power()) / light_distribution->integral();
 }
 
+std::tuple<std::shared_ptr<Light>, uint32_t, float> Scene::sample_light_source(const glm::vec3& P, const glm::vec3& N, float sample) const {
+    assert(light_distribution && !lights.empty());
+    if (light_bvh) {
+        // select the sky or the volume according to their intensities, else let the BVH choose a triangle
+        const float p_sky = sky ? light_source_pdf(sky.get()) : 0.f;
+        const float p_volume = volume_light ? light_source_pdf(volume_light.get()) : 0.f;
+        if (sample < p_sky) return { sky, 0, p_sky };
+        if (sample < p_sky + p_volume) return { volume_light, 0, p_volume };
+        sample = fminf((sample - p_sky - p_volume) / (1.f - p_sky - p_volume), 0.99999f);
+        const auto [mesh, primID, pdf] = light_bvh->sample(P, N, sample);
+        if (!mesh) return { lights[0], 0, 0.f };
+        return { mesh->area_light, primID, (1.f - p_sky - p_volume) * pdf };
+    }
+    // select light source, reuse the fraction within its bin to select a triangle
+    const auto [u, pdf_u] = light_distribution->sample_01(sample);
+    const float x = u * lights.size();
+    const uint32_t index = std::min(uint32_t(x), uint32_t(lights.size() - 1));
+    const float pdf = light_distribution->pdf(size_t(index));
+    const AreaLight* area_light = dynamic_cast<const AreaLight*>(lights[index].get());
+    if (!area_light) return { lights[index], 0, pdf };
+    const auto [primID, pdf_tri] = area_light->mesh.area_distribution->sample_index(fminf(x - index, 0.99999f));
+    return { lights[index], primID, pdf * pdf_tri };
+}
+
+float Scene::light_source_pdf(const glm::vec3& P, const glm::vec3& N, const SurfaceHit& light) const {
+    assert(light.light && light_distribution && !lights.empty());
+    if (!light.valid) return light_source_pdf(light.light);
+    assert(light.mesh);
+    if (light_bvh) {
+        const float p_sky = sky ? light_source_pdf(sky.get()) : 0.f;
+        const float p_volume = volume_light ? light_source_pdf(volume_light.get()) : 0.f;
+        return (1.f - p_sky - p_volume) * light_bvh->pdf(P, N, light.mesh, light.primID);
+    }
+    return light_source_pdf(light.light) * light.mesh->area_distribution->pdf(size_t(light.primID));
+}
+
 float Scene::total_light_source_power() const {
     return light_distribution ? light_distribution->integral() : 0.f;
 }
@@ -207,6 +496,17 @@ Mesh* Scene::get_mesh(uint32_t geomID) const {
     return (Mesh*) rtcGetGeometryUserData(rtcGetGeometry(scene, geomID));
 }
 
+Mesh* Scene::get_mesh(const Ray& ray) const {
+    if (ray.instID != RTC_INVALID_GEOMETRY_ID)
+        return get_instance(ray.instID)->prototype->get_mesh(ray.geomID);
+    return get_mesh(ray.geomID);
+}
+
+Instance* Scene::get_instance(uint32_t instID) const {
+    assert(instID != RTC_INVALID_GEOMETRY_ID);
+    return (Instance*) rtcGetGeometryUserData(rtcGetGeometry(scene, instID));
+}
+
 inline std::string fix_data_path(const std::filesystem::path& path) {
     std::string fixed_path = path.string();
     if (fixed_path.find(GI_DATA_DIR) != std::string::npos)
@@ -221,16 +521,50 @@ inline std::vector<std::string> fix_data_paths(const std::vector<std::filesystem
     return fixed_paths;
 }
 
+inline json11::Json mat4_to_json(const glm::mat4& m) {
+    return json11::Json::array{
+        json11::Json::array{m[0][0], m[0][1], m[0][2], m[0][3]},
+        json11::Json::array{m[1][0], m[1][1], m[1][2], m[1][3]},
+        json11::Json::array{m[2][0], m[2][1], m[2][2], m[2][3]},
+        json11::Json::array{m[3][0], m[3][1], m[3][2], m[3][3]}};
+}
+
+inline glm::mat4 mat4_from_json(const json11::Json& cfg) {
+    glm::mat4 m(1);
+    if (cfg.is_array() && cfg.array_items().size() >= 4) {
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = cfg[i][j].number_value();
+    }
+    return m;
+}
+
 json11::Json Scene::to_json() const {
     std::vector<json11::Json> mats;
     for (auto& mat : materials)
         mats.push_back(mat->to_json());
+    // instances grouped by prototype
+    std::vector<json11::Json> insts;
+    for (auto& prototype : prototypes) {
+        std::vector<json11::Json> transforms;
+        for (auto& instance : instances)
+            if (instance->prototype == prototype)
+                transforms.push_back(mat4_to_json(instance->transform));
+        insts.push_back(json11::Json::object{ { "mesh_file", fix_data_path(prototype->path) }, { "transforms", transforms } });
+    }
     return json11::Json::object{
         { "mesh_files", json11::Json(fix_data_paths(mesh_files)) },
         { "materials", json11::Json(mats) },
+        { "instances", json11::Json(insts) },
         { "sky", (sky ? sky->to_json() : json11::Json()) },
         { "volume_path", volume_path.empty() ? json11::Json() : fix_data_path(volume_path) },
-        { "volume", (volume ? volume->to_json() : json11::Json()) }
+        { "volume", (volume ? volume->to_json() : json11::Json()) },
+        { "alias_sampling", ALIAS_SAMPLING },
+        { "light_bvh", LIGHT_BVH },
+        { "mesh_cache", MESH_CACHE },
+        { "compress_attributes", COMPRESS_ATTRIBUTES },
+        { "texture_cache_mb", int(TEXTURE_CACHE_MB) },
+        { "bvh_quality", BVH_QUALITY_NAMES[BVH_QUALITY] }
     };
 }
 
@@ -238,10 +572,29 @@ void Scene::from_json(const json11::Json &cfg) {
     if (cfg.is_object()) {
         // clear current scene
         clear();
+        // parse settings
+        json_set_bool(cfg, "alias_sampling", ALIAS_SAMPLING);
+        json_set_bool(cfg, "light_bvh", LIGHT_BVH);
+        json_set_bool(cfg, "mesh_cache", MESH_CACHE);
+        json_set_bool(cfg, "compress_attributes", COMPRESS_ATTRIBUTES);
+        json_set_uint(cfg, "texture_cache_mb", TEXTURE_CACHE_MB);
+        if (cfg["bvh_quality"].is_string()) {
+            const auto it = std::find(std::begin(BVH_QUALITY_NAMES), std::end(BVH_QUALITY_NAMES), cfg["bvh_quality"].string_value());
+            if (it != std::end(BVH_QUALITY_NAMES))
+                BVH_QUALITY = RTCBuildQuality(it - std::begin(BVH_QUALITY_NAMES));
+            else
+                std::cerr << "Warning: unknown bvh_quality: " << cfg["bvh_quality"].string_value() << std::endl;
+        }
         // load meshes
         if (cfg["mesh_files"].is_array())
             for (auto &file : cfg["mesh_files"].array_items())
                 load_mesh(file.string_value());
+        // load instances
+        if (cfg["instances"].is_array())
+            for (auto& inst : cfg["instances"].array_items())
+                if (inst["mesh_file"].is_string() && inst["transforms"].is_array())
+                    for (auto& transform : inst["transforms"].array_items())
+                        add_instance(inst["mesh_file"].string_value(), mat4_from_json(transform));
         // patch materials
         if (cfg["materials"].is_array()) {
             for (auto& mat_json : cfg["materials"].array_items())
@@ -254,11 +607,14 @@ void Scene::from_json(const json11::Json &cfg) {
         if (cfg["sky"].is_object()) {
             sky.reset(new SkyLight);
             sky->from_json(cfg["sky"]);
+            mark_dirty(DIRTY_EMITTERS);
         }
         // load volume
         if (cfg["volume_path"].is_string())
             load_volume(cfg["volume_path"].string_value());
-        if (volume && cfg["volume"].is_object())
+        if (volume && cfg["volume"].is_object()) {
             volume->from_json(cfg["volume"]);
+            mark_dirty(DIRTY_VOLUME | DIRTY_VOLUME_EMISSION);
+        }
     }
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <tuple>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <memory>
@@ -19,7 +20,11 @@ class Mesh;
 class Material;
 class Light;
 class SkyLight;
+class VolumeLight;
 class Distribution1D;
+class LightBVH;
+class Prototype;
+class Instance;
 
 /**
  * @brief Scene class containing all meshes, light sources and materials in the scene
@@ -36,23 +41,61 @@ public:
 
     void load_mesh(const std::filesystem::path& path);
     void load_sky(const std::filesystem::path& path);
-    void load_volume(const std::filesystem::path& path);
+    void load_volume(const std::filesystem::path& path);   // .nvdb file, or a directory of .nvdb files (frame sequence)
 
     void add(const par_shapes_mesh* par_mesh, const std::shared_ptr<Material>& mat);
 
+    /**
+     * @brief Place an instance of a mesh file, all instances of the same file share one prototype (geometry and BVH)
+     * @note Emissive meshes within instances are not supported as light sources and do not emit light.
+     *
+     * @param path Path to the mesh file
+     * @param transform Object to world transform of the instance
+     */
+    void add_instance(const std::filesystem::path& path, const glm::mat4& transform);
+
     /**
      * @brief Clear all contents of the scene
      */
     void clear();
 
+    /**
+     * @brief Parts of the scene that changed since the last commit(), each only redoes its affected work
+     */
+    enum Dirty : uint32_t {
+        DIRTY_NONE      = 0,
+        DIRTY_GEOMETRY  = 1 << 0,   ///< Meshes or BVH settings changed: rebuild the embree BVH
+        DIRTY_EMITTERS  = 1 << 1,   ///< Light sources or their power changed: rebuild light distribution and light BVH
+        DIRTY_MATERIALS = 1 << 2,   ///< Material parameters changed: only recollect lights if emission was toggled
+        DIRTY_VOLUME    = 1 << 3,   ///< Volume parameters changed: cache transforms and update the power of the volume emission
+        DIRTY_VOLUME_EMISSION = 1 << 4, ///< Volume emission parameters or the frame changed: additionally rebuild the volume emission distribution
+        DIRTY_ALL       = ~0u,
+    };
+
+    /**
+     * @brief Flag parts of the scene as changed, to be updated in the next commit()
+     * @note Thread-safe, e.g. for GUI edits while rendering.
+     *
+     * @param flags Combination of Dirty flags
+     */
+    inline void mark_dirty(uint32_t flags) { dirty |= flags; }
+    inline bool is_dirty(uint32_t flags = DIRTY_ALL) const { return dirty & flags; }
+
     /**
      * @brief Commit scene and prepare for rendering
      * @note This function has to be called in between adding or removing meshes or light sources
      * and performing intersection or occlusion tests or sampling a light source!
      * @note This will be called once before rendering from the driver module.
+     * @note Only parts flagged via mark_dirty() are updated, i.e. committing an unchanged scene is free.
      */
     void commit();
 
+    /**
+     * @brief Recompute AABB, center and radius from all meshes, instances and the volume
+     * @note Called on commit() if the volume moved or switched frames.
+     */
+    void update_bounds();
+
     const SurfaceHit intersect(Ray& ray) const;
     const VolumeHit intersect_volume(Ray& ray) const;
 
@@ -60,6 +103,33 @@ public:
     float transmittance(Ray& ray) const;    // only check for volumetric occlusion
     float visibility(Ray& ray) const;       // both opaque and volumetric occlusion
 
+    /**
+     * @brief Intersect a batch of rays with the scene, traced in packets of PACKET_SIZE rays
+     * @note Hit data is written back into the given rays, use surface_hit() to construct the interactions.
+     *
+     * @param rays Rays to intersect
+     * @param count Number of rays
+     */
+    void intersect(Ray* rays, size_t count) const;
+
+    /**
+     * @brief Test a batch of rays for occlusion by opaque geometry, traced in packets of PACKET_SIZE rays
+     * @note As for a single ray, occluded rays are marked via tfar < 0.
+     *
+     * @param rays Rays to test
+     * @param count Number of rays
+     */
+    void occluded(Ray* rays, size_t count) const;
+
+    /**
+     * @brief Construct the surface interaction of an already intersected ray
+     *
+     * @param ray Ray with valid hit data, e.g. from a batched intersect()
+     *
+     * @return Surface interaction or invalid hit with sky light contribution on miss
+     */
+    const SurfaceHit surface_hit(const Ray& ray) const;
+
     /**
      * @brief Sample a light source accoring to their respective intensities
      * @note Assumes Scene::commit() has been called previously.
@@ -79,6 +149,34 @@ public:
      */
     float light_source_pdf(const Light* light) const;
 
+    /**
+     * @brief Sample a light source and one of its primitives (emissive triangle) for a given shading point
+     * @note Uses the light BVH if enabled (LIGHT_BVH), otherwise light sources are selected according to their
+     * intensities and triangles according to their area.
+     * @note Assumes Scene::commit() has been called previously.
+     *
+     * @param P Shading position
+     * @param N Shading normal, or vec3(0) for points in a volume
+     * @param sample Random sample in [0, 1)
+     *
+     * @return Tuple consisting of:
+     *      - Sampled light source (std::shared_ptr<Light>)
+     *      - Sampled primitive of the light source, to be passed to Light::sample_Li (uint)
+     *      - Discrete PDF of selecting the light source and primitive (float)
+     */
+    std::tuple<std::shared_ptr<Light>, uint32_t, float> sample_light_source(const glm::vec3& P, const glm::vec3& N, float sample) const;
+
+    /**
+     * @brief Query PDF for selecting the light source and primitive of a given hit via sample_light_source(P, N, sample)
+     *
+     * @param P Shading position
+     * @param N Shading normal, or vec3(0) for points in a volume
+     * @param light Hit on a light source (or invalid hit with sky light)
+     *
+     * @return Discrete PDF of selecting the light source and primitive
+     */
+    float light_source_pdf(const glm::vec3& P, const glm::vec3& N, const SurfaceHit& light) const;
+
     inline bool has_sky() const { return sky.operator bool(); }
     inline glm::vec3 Le(const Ray& ray) const { return has_sky() ? sky->Le(ray) : glm::vec3(0.f); }
 
@@ -98,7 +196,36 @@ public:
      */
     Mesh* get_mesh(uint32_t geomID) const;
 
+    /**
+     * @brief Translate the hit data of a ray into a mesh pointer, resolving hits on instanced geometry
+     *
+     * @param ray Ray with valid hit data
+     *
+     * @return Mesh pointer or nullptr if not found
+     */
+    Mesh* get_mesh(const Ray& ray) const;
+
+    /**
+     * @brief Translate an instance ID into an instance pointer, e.g. Ray::instID
+     *
+     * @param instID Instance ID to translate
+     *
+     * @return Instance pointer
+     */
+    Instance* get_instance(uint32_t instID) const;
+
 private:
+    /**
+     * @brief Import all materials and meshes of a mesh file (from its cache if possible)
+     * @note Materials are added to the scene, meshes are committed but not yet attached to the target scene.
+     *
+     * @param path Resolved path to the mesh file
+     * @param target Embree scene the meshes belong to
+     *
+     * @return Imported meshes
+     */
+    std::vector<std::shared_ptr<Mesh>> import_meshes(const std::filesystem::path& path, RTCScene& target);
+
     friend class Context;
     friend class json11::Json;
 
@@ -108,7 +235,17 @@ private:
     bool render_GUI();
 
 public:
+    // settings
+    bool ALIAS_SAMPLING = false;                        ///< Use alias tables to sample light sources and emissive triangles?
+    bool LIGHT_BVH = false;                             ///< Use the light BVH to sample emissive triangles per shading point?
+    bool MESH_CACHE = true;                             ///< Load meshes from (and store them to) binary .gicache files in the cache directory?
+    bool COMPRESS_ATTRIBUTES = false;                   ///< Store normals octahedral encoded and texcoords as half floats?
+    uint32_t TEXTURE_CACHE_MB = 0;                      ///< Memory budget of the tiled texture cache in MB (0: load textures fully into memory)
+    RTCBuildQuality BVH_QUALITY = RTC_BUILD_QUALITY_HIGH; ///< Embree BVH build quality (LOW, MEDIUM, HIGH or REFIT)
+    inline static const char* BVH_QUALITY_NAMES[] = { "LOW", "MEDIUM", "HIGH", "REFIT" }; ///< Indexed by RTCBuildQuality
+
     // data
+    std::atomic<uint32_t> dirty = DIRTY_ALL;            ///< Changes since the last commit (see Dirty)
     RTCScene scene;                                     ///< Embree4 scene
     RTCDevice& device;                                  ///< Embree4 device
     Assimp::Importer importer;                          ///< Assimp importer
@@ -116,10 +253,14 @@ public:
     std::vector<std::filesystem::path> mesh_files;      ///< File paths of present meshes
     std::vector<std::shared_ptr<Mesh>> meshes;          ///< All present meshes
     std::vector<std::shared_ptr<Material>> materials;   ///< All present materials
+    std::vector<std::shared_ptr<Prototype>> prototypes; ///< Geometry shared by instances, one per mesh file
+    std::vector<std::shared_ptr<Instance>> instances;   ///< All present instances
     std::shared_ptr<SkyLight> sky;                      ///< Sky light (if present)
     std::vector<std::shared_ptr<Light>> lights;         ///< All light source currently in the scene
     std::shared_ptr<Distribution1D> light_distribution; ///< For importance sampling light sources
+    std::shared_ptr<LightBVH> light_bvh;                ///< For importance sampling emissive triangles (if enabled)
     std::shared_ptr<Volume> volume;                     ///< Volume (if present)
+    std::shared_ptr<VolumeLight> volume_light;          ///< Emission of the volume (if present and emissive)
     std::filesystem::path volume_path;                  ///< File path to current volume (if present)
     glm::vec3 bb_min;                                   ///< AABB (lower left corner)
     glm::vec3 bb_max;                                   ///< AABB (upper right corner)
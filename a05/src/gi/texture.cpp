@@ -1,6 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "texture.h"
+#include "texture_cache.h"
 #include "color.h"
 #include <fstream>
 #include <iostream>
@@ -9,7 +10,7 @@
 // -------------------------------------------
 // Texture
 
-Texture::Texture() : w(0), h(0), has_alpha(false) {}
+Texture::Texture() : w(0), h(0), format(TEXEL_RGB32F), has_alpha(false) {}
 
 Texture::Texture(const std::filesystem::path& path, bool sRGB) : Texture() {
     load(path, sRGB);
@@ -23,8 +24,10 @@ Texture::Texture(const glm::vec3& col) : Texture() {
     load(col);
 }
 
-void Texture::load(const std::filesystem::path& path, bool sRGB) {
+void Texture::load(const std::filesystem::path& path, bool sRGB, std::vector<float>* luma) {
     src_path = path;
+    levels.clear();
+    tiled.reset();
     // load image from disk
     int chan_file, chan_forced = 3; // number of color channels
 	bool HDR = stbi_is_hdr(path.string().c_str());
@@ -32,28 +35,38 @@ void Texture::load(const std::filesystem::path& path, bool sRGB) {
         float* img_data = stbi_loadf(path.string().c_str(), (int*)&w, (int*)&h, &chan_file, chan_forced);
         if (!img_data)
             throw std::runtime_error("Failed to load texture: " + path.string());
-        texels.resize(w * h);
-        for (size_t i = 0; i < w * h; ++i) {
-            const glm::vec3 col = glm::vec3(img_data[i*3+0], img_data[i*3+1], img_data[i*3+2]);
-            texels[i] = col; // always in linear color space
+        format = TEXEL_RGB16F; // always in linear color space
+        levels.emplace_back(w * h * texel_size());
+        if (luma) luma->resize(w * h);
+        #pragma omp parallel for
+        for (int64_t i = 0; i < int64_t(w * h); ++i) {
+            const glm::vec3 col(img_data[i*3+0], img_data[i*3+1], img_data[i*3+2]);
+            encode(col, format, &levels[0][i * texel_size()]);
+            if (luma) (*luma)[i] = ::luma(col);
         }
         stbi_image_free(img_data);
     } else {
         uint8_t* img_data = stbi_load(path.string().c_str(), (int*)&w, (int*)&h, &chan_file, chan_forced);
         if (!img_data)
             throw std::runtime_error("Failed to load texture: " + path.string());
-        texels.resize(w * h);
-        for (size_t i = 0; i < w * h; ++i) {
-            const glm::vec3 col = glm::vec3(img_data[i*3+0], img_data[i*3+1], img_data[i*3+2]) / 255.f;
-            texels[i] = sRGB ? srgb_to_rgb(col) : col;
-        }
+        // keep the 8 bit texels as they are, decoding happens on lookup
+        format = sRGB ? TEXEL_SRGB8 : TEXEL_RGB8;
+        levels.emplace_back(img_data, img_data + w * h * 3);
         stbi_image_free(img_data);
+        if (luma) {
+            luma->resize(w * h);
+            #pragma omp parallel for
+            for (int64_t i = 0; i < int64_t(w * h); ++i)
+                (*luma)[i] = ::luma(decode(&levels[0][i * 3]));
+        }
     }
     has_alpha = chan_file == 4;
 }
 
 void Texture::load_alpha(const std::filesystem::path& path) {
     src_path = path;
+    levels.clear();
+    tiled.reset();
     // load image from disk
     int chan_file, chan_forced = 4; // number of color channels
     bool HDR = stbi_is_hdr(path.string().c_str());
@@ -61,21 +74,21 @@ void Texture::load_alpha(const std::filesystem::path& path) {
         float* img_data = stbi_loadf(path.string().c_str(), (int*)&w, (int*)&h, &chan_file, chan_forced);
         if (!img_data)
             throw std::runtime_error("Failed to load texture: " + path.string());
-        texels.resize(w * h);
-        for (size_t i = 0; i < w * h; ++i) {
-            const glm::vec3 col = glm::vec3(img_data[i*4+3]);
-            texels[i] = col; // always in linear color space
-        }
+        format = TEXEL_RGB16F; // always in linear color space
+        levels.emplace_back(w * h * texel_size());
+        #pragma omp parallel for
+        for (int64_t i = 0; i < int64_t(w * h); ++i)
+            encode(glm::vec3(img_data[i*4+3]), format, &levels[0][i * texel_size()]);
         stbi_image_free(img_data);
     } else {
         uint8_t* img_data = stbi_load(path.string().c_str(), (int*)&w, (int*)&h, &chan_file, chan_forced);
         if (!img_data)
             throw std::runtime_error("Failed to load texture: " + path.string());
-        texels.resize(w * h);
-        for (size_t i = 0; i < w * h; ++i) {
-            const glm::vec3 col = glm::vec3(img_data[i*4+3]) / 255.f;
-            texels[i] = col; // assume alpha to always be in linear space
-        }
+        format = TEXEL_R8; // assume alpha to always be in linear space
+        levels.emplace_back(w * h);
+        #pragma omp parallel for
+        for (int64_t i = 0; i < int64_t(w * h); ++i)
+            levels[0][i] = img_data[i*4+3];
         stbi_image_free(img_data);
     }
     has_alpha = chan_file == 4;
@@ -85,25 +98,166 @@ void Texture::load(size_t w, size_t h, const glm::vec3* data) {
     src_path.clear();
     this->w = w;
     this->h = h;
-    texels.resize(w * h);
-    for (size_t i = 0; i < w * h; ++i)
-        texels[i] = data[i];
+    format = TEXEL_RGB32F;
+    levels.clear();
+    tiled.reset();
+    levels.emplace_back((const uint8_t*)data, (const uint8_t*)(data + w * h));
 }
 
 void Texture::load(const glm::vec3& col) {
-    src_path.clear();
-    w = 1;
-    h = 1;
-    texels.resize(1);
-    texels[0] = col;
+    load(1, 1, &col);
+}
+
+void Texture::load(const std::shared_ptr<TiledTexture>& tiled) {
+    src_path = tiled->source;
+    w = tiled->header.width;
+    h = tiled->header.height;
+    format = TexelFormat(tiled->header.format);
+    has_alpha = tiled->header.has_alpha;
+    // keep one (empty) entry per level, so level queries work the same for both storages
+    levels.clear();
+    levels.resize(tiled->num_levels());
+    this->tiled = tiled;
+}
+
+glm::vec3 Texture::fetch_tiled(const glm::uvec2& xy, uint32_t level) const {
+    return tiled->fetch(xy, level);
+}
+
+void Texture::encode(const glm::vec3& col, TexelFormat format, uint8_t* texel) {
+    const auto unorm8 = [](float val) { return uint8_t(glm::clamp(int(roundf(val * 255.f)), 0, 255)); };
+    switch (format) {
+        case TEXEL_SRGB8:
+            for (int c = 0; c < 3; ++c)
+                texel[c] = encode_srgb8(col[c]);
+            break;
+        case TEXEL_RGB8:
+            for (int c = 0; c < 3; ++c)
+                texel[c] = unorm8(col[c]);
+            break;
+        case TEXEL_R8:
+            texel[0] = unorm8(luma(col));
+            break;
+        case TEXEL_RGB9E5: {
+            const uint32_t packed = glm::packF3x9_E1x5(glm::clamp(col, glm::vec3(0), glm::vec3(65408.f)));
+            std::memcpy(texel, &packed, sizeof(uint32_t));
+            break;
+        }
+        case TEXEL_RGB16F: {
+            const glm::vec3 c = glm::clamp(col, glm::vec3(-65504.f), glm::vec3(65504.f)); // avoid infinities
+            const uint16_t packed[3] = { glm::packHalf1x16(c.x), glm::packHalf1x16(c.y), glm::packHalf1x16(c.z) };
+            std::memcpy(texel, packed, sizeof(packed));
+            break;
+        }
+        default:
+            std::memcpy(texel, &col, sizeof(glm::vec3));
+    }
+}
+
+void Texture::convert(TexelFormat format) {
+    if (format == this->format) return;
+    assert(!tiled);
+    for (auto& level : levels) {
+        const size_t N = level.size() / texel_size();
+        std::vector<uint8_t> converted(N * TEXEL_SIZE[format]);
+        #pragma omp parallel for
+        for (int64_t i = 0; i < int64_t(N); ++i) {
+            encode(decode(&level[i * texel_size()]), format, &converted[i * TEXEL_SIZE[format]]);
+        }
+        level = std::move(converted);
+    }
+    this->format = format;
+}
+
+size_t Texture::size_bytes() const {
+    size_t bytes = 0;
+    for (const auto& level : levels)
+        bytes += level.size();
+    return bytes;
+}
+
+// source texel range [begin, end) of destination texel i when halving src_res texels to res, the last one also covers an odd remainder
+static inline glm::uvec2 mip_footprint(uint32_t i, uint32_t res, uint32_t src_res) {
+    return glm::uvec2(std::min(2 * i, src_res - 1), i == res - 1 ? src_res : 2 * i + 2);
+}
+
+void Texture::build_mipmaps() {
+    if (levels.empty() || tiled) return;
+    levels.resize(1);
+    // halve resolution until 1x1 (in linear space), for odd dimensions the last row/column averages three source texels
+    for (uint32_t level = 1; dim(level - 1) != glm::uvec2(1); ++level) {
+        const glm::uvec2 src_res = dim(level - 1), res = dim(level);
+        std::vector<uint8_t> dst(res.x * res.y * texel_size());
+        if (format == TEXEL_SRGB8 || format == TEXEL_RGB8 || format == TEXEL_R8) {
+            // 8 bit formats: filter each channel directly on the bytes, the inner loop over 2x2 footprints vectorizes
+            const uint32_t C = texel_size();
+            const bool srgb = format == TEXEL_SRGB8;
+            const uint8_t* src = levels[level - 1].data();
+            const uint32_t nx = src_res.x % 2 ? res.x - 1 : res.x, ny = src_res.y % 2 ? res.y - 1 : res.y; // texels with 2x2 footprints
+            const auto filter = [&](uint32_t x, uint32_t y, uint8_t* out) {
+                const glm::uvec2 fx = mip_footprint(x, res.x, src_res.x), fy = mip_footprint(y, res.y, src_res.y);
+                const float n = float((fx.y - fx.x) * (fy.y - fy.x));
+                for (uint32_t c = 0; c < C; ++c) {
+                    float sum = 0.f;
+                    for (uint32_t sy = fy.x; sy < fy.y; ++sy)
+                        for (uint32_t sx = fx.x; sx < fx.y; ++sx) {
+                            const uint8_t val = src[(sy * src_res.x + sx) * C + c];
+                            sum += srgb ? SRGB8_LUT[val] : float(val);
+                        }
+                    out[c] = srgb ? encode_srgb8(sum / n) : uint8_t(sum / n + .5f);
+                }
+            };
+            #pragma omp parallel for
+            for (int y = 0; y < int(res.y); ++y) {
+                uint8_t* out = &dst[y * res.x * C];
+                const uint32_t x_begin = uint32_t(y) < ny ? nx : 0;
+                if (uint32_t(y) < ny) {
+                    const uint8_t* row0 = src + 2 * y * src_res.x * C;
+                    const uint8_t* row1 = row0 + src_res.x * C;
+                    #pragma omp simd
+                    for (uint32_t i = 0; i < nx * C; ++i) {
+                        const uint32_t x = i / C, c = i % C;
+                        const uint32_t i0 = 2 * x * C + c, i1 = i0 + C;
+                        out[i] = srgb ?
+                            encode_srgb8(.25f * (SRGB8_LUT[row0[i0]] + SRGB8_LUT[row0[i1]] + SRGB8_LUT[row1[i0]] + SRGB8_LUT[row1[i1]])) :
+                            uint8_t((row0[i0] + row0[i1] + row1[i0] + row1[i1] + 2) / 4);
+                    }
+                }
+                // last column and row of odd dimensions
+                for (uint32_t x = x_begin; x < res.x; ++x)
+                    filter(x, y, out + x * C);
+            }
+            levels.push_back(std::move(dst));
+            continue;
+        }
+        #pragma omp parallel for
+        for (int y = 0; y < int(res.y); ++y) {
+            const glm::uvec2 fy = mip_footprint(y, res.y, src_res.y);
+            for (uint32_t x = 0; x < res.x; ++x) {
+                const glm::uvec2 fx = mip_footprint(x, res.x, src_res.x);
+                glm::vec3 col(0);
+                for (uint32_t sy = fy.x; sy < fy.y; ++sy)
+                    for (uint32_t sx = fx.x; sx < fx.y; ++sx)
+                        col += fetch(glm::uvec2(sx, sy), level - 1);
+                encode(col / float((fx.y - fx.x) * (fy.y - fy.x)), format, &dst[(y * res.x + x) * texel_size()]);
+            }
+        }
+        levels.push_back(std::move(dst));
+    }
 }
 
 void Texture::save_png(const std::filesystem::path& path) const {
-    Texture::save_png(path, w, h, data());
+    std::vector<glm::vec3> rgb(w * h);
+    for (size_t i = 0; i < w * h; ++i)
+        rgb[i] = fetch(glm::uvec2(i % w, i / w));
+    Texture::save_png(path, w, h, rgb.data());
 }
 
 void Texture::save_jpg(const std::filesystem::path& path) const {
-    Texture::save_jpg(path, w, h, data());
+    std::vector<glm::vec3> rgb(w * h);
+    for (size_t i = 0; i < w * h; ++i)
+        rgb[i] = fetch(glm::uvec2(i % w, i / w));
+    Texture::save_jpg(path, w, h, rgb.data());
 }
 
 void Texture::save_png(const std::filesystem::path& path, size_t w, size_t h, const glm::vec3* rgb, bool flip) {
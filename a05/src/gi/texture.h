@@ -1,14 +1,53 @@
 #pragma once
 
+#include <array>
+#include <cfloat>
+#include <memory>
 #include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
 #include <filesystem>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include "timer.h"
+#include "color.h"
+
+/**
+ * @brief Texel storage formats, decoded to linear RGB on lookup
+ */
+enum TexelFormat : uint8_t {
+    TEXEL_RGB32F,   ///< 3x float (12 bytes), for generated data
+    TEXEL_SRGB8,    ///< 3x 8 bit sRGB (3 bytes), decoded via lookup table, for LDR color textures
+    TEXEL_RGB8,     ///< 3x 8 bit linear (3 bytes), e.g. for normal maps
+    TEXEL_R8,       ///< 1x 8 bit linear (1 byte), replicated to RGB, e.g. for roughness and alpha maps
+    TEXEL_RGB9E5,   ///< 3x 9 bit mantissa with shared 5 bit exponent (4 bytes), for HDR images
+    TEXEL_RGB16F,   ///< 3x half float (6 bytes), for HDR images
+};
+
+class TiledTexture;
 
 class Texture {
 public:
+    inline static const size_t TEXEL_SIZE[] = { 12, 3, 3, 1, 4, 6 }; ///< Bytes per texel, indexed by TexelFormat
+    inline static const char* TEXEL_FORMAT_NAMES[] = { "RGB32F", "SRGB8", "RGB8", "R8", "RGB9E5", "RGB16F" };
+    inline static const std::array<float, 256> SRGB8_LUT = []() {
+        std::array<float, 256> lut;
+        for (int i = 0; i < 256; ++i)
+            lut[i] = srgb_to_rgb(i / 255.f);
+        return lut;
+    }();
+    // linear values at the midpoints between consecutive sRGB codes, for encoding without powf (see encode_srgb8)
+    inline static const std::array<float, 256> SRGB8_THRESHOLDS = []() {
+        std::array<float, 256> thresholds;
+        for (int i = 0; i < 255; ++i)
+            thresholds[i] = srgb_to_rgb((i + .5f) / 255.f);
+        thresholds[255] = FLT_MAX;
+        return thresholds;
+    }();
+
     // construct invalid texture
     Texture();
     // construct from file on disk
@@ -18,20 +57,44 @@ public:
     // construct as 1x1 texture from given color
     Texture(const glm::vec3& col);
 
-    // load texture from disk (rgb only)
-    void load(const std::filesystem::path& path, bool sRGB = true);
-    // load alpha channel of texture from disk
+    // load texture from disk (rgb only), LDR images are stored as SRGB8 or RGB8, HDR images as RGB16F
+    // if luma is given, it receives the (linear) luma of each texel in the same pass, e.g. for importance sampling
+    void load(const std::filesystem::path& path, bool sRGB = true, std::vector<float>* luma = nullptr);
+    // load alpha channel of texture from disk (as R8 or RGB16F)
     void load_alpha(const std::filesystem::path& path);
     // load texture from given texel data
     void load(size_t w, size_t h, const glm::vec3* data);
     // load 1x1 texture with given color
     void load(const glm::vec3& col);
+    // load texture from a tiled file, texels are read on demand through the TextureCache
+    void load(const std::shared_ptr<TiledTexture>& tiled);
+
+    // build mip pyramid (2x2 box filter in linear space, 3 texels wide at the last row/column of odd dimensions) for filtered lookups via trilin(), tiled textures are pre-mipped
+    void build_mipmaps();
+    // re-encode all levels in the given format (R8 stores luma), not supported for tiled textures
+    void convert(TexelFormat format);
+
+    // texel encoding and decoding
+    inline glm::vec3 decode(const uint8_t* texel) const { return decode(texel, format); }
+    static inline glm::vec3 decode(const uint8_t* texel, TexelFormat format);
+    static void encode(const glm::vec3& col, TexelFormat format, uint8_t* texel);
+    static inline uint8_t encode_srgb8(float val);
 
     // texture lookups
-    inline glm::vec3 fetch(const glm::uvec2& xy) const;
-    inline glm::vec3 bilin(const glm::vec2& uv) const;
+    inline glm::vec3 fetch(const glm::uvec2& xy, uint32_t level = 0) const;
+    inline glm::vec3 bilin(const glm::vec2& uv, uint32_t level = 0) const;
     inline glm::vec3 env(const glm::vec3& dir) const;
 
+    /**
+     * @brief Trilinear lookup between the two mip levels matching a footprint
+     *
+     * @param uv Texture coordinates
+     * @param lod Log2 of the footprint size in texture coordinates (resolution independent), see SurfaceHit::lod
+     *
+     * @return Filtered texel value, equals bilin(uv) without mipmaps
+     */
+    inline glm::vec3 trilin(const glm::vec2& uv, float lod) const;
+
     // check if texture is valid and it is save to perform texture lookups
     inline explicit operator bool() const { return w != 0 && h != 0; }
 
@@ -42,14 +105,20 @@ public:
     inline glm::vec3 operator()(uint64_t x, uint64_t y) const { return fetch(glm::uvec2(x, y)); }
     inline glm::vec3 operator()(const glm::vec2& uv) const { return bilin(uv); }
     inline glm::vec3 operator()(float u, float v) const { return bilin(glm::vec2(u, v)); }
+    inline glm::vec3 operator()(const glm::vec2& uv, float lod) const { return trilin(uv, lod); }
 
     // "accessors"
     inline size_t width() const { return w; }
     inline size_t height() const { return h; }
     inline glm::uvec2 dim() const { return glm::uvec2(w, h); }
-    inline const glm::vec3* data() const { return texels.data(); }
+    inline glm::uvec2 dim(uint32_t level) const { return glm::uvec2(std::max<size_t>(1, w >> level), std::max<size_t>(1, h >> level)); }
+    inline uint32_t num_levels() const { return levels.size(); }
+    inline size_t texel_size() const { return TEXEL_SIZE[format]; }
     inline std::filesystem::path path() const { return src_path; }
 
+    // memory used by all levels in bytes (excluding tiles resident in the TextureCache)
+    size_t size_bytes() const;
+
     // save as PNG / JPG
     void save_png(const std::filesystem::path& path) const;
     void save_jpg(const std::filesystem::path& path) const;
@@ -58,10 +127,16 @@ public:
     static void save_png(const std::filesystem::path& path, size_t w, size_t h, const glm::vec3* rgb, bool flip = true);
     static void save_jpg(const std::filesystem::path& path, size_t w, size_t h, const glm::vec3* rgb, bool flip = true);
 
+private:
+    glm::vec3 fetch_tiled(const glm::uvec2& xy, uint32_t level) const;
+
+public:
     // data
     size_t w;                       ///< Texture width
     size_t h;                       ///< Texture height
-    std::vector<glm::vec3> texels;  ///< Raw texel data
+    TexelFormat format;             ///< Storage format of all levels
+    std::vector<std::vector<uint8_t>> levels; ///< Encoded texels per mip level (level 0 is the full resolution image), empty placeholders if tiled
+    std::shared_ptr<TiledTexture> tiled; ///< Tiled storage on disk, if loaded from a tiled file
     std::filesystem::path src_path; ///< Filename, if loaded from disk
     bool has_alpha;                 ///< Image from disk had alpha channel (which was discarded on loading)
 };
@@ -69,24 +144,71 @@ public:
 // --------------------------------------
 // inline implementations
 
-glm::vec3 Texture::fetch(const glm::uvec2& xy) const {
+glm::vec3 Texture::decode(const uint8_t* texel, TexelFormat format) {
+    switch (format) {
+        case TEXEL_SRGB8:
+            return glm::vec3(SRGB8_LUT[texel[0]], SRGB8_LUT[texel[1]], SRGB8_LUT[texel[2]]);
+        case TEXEL_RGB8:
+            return glm::vec3(texel[0], texel[1], texel[2]) * (1.f / 255.f);
+        case TEXEL_R8:
+            return glm::vec3(texel[0] * (1.f / 255.f));
+        case TEXEL_RGB9E5: {
+            uint32_t packed;
+            std::memcpy(&packed, texel, sizeof(uint32_t));
+            return glm::unpackF3x9_E1x5(packed);
+        }
+        case TEXEL_RGB16F: {
+            uint16_t packed[3];
+            std::memcpy(packed, texel, sizeof(packed));
+            return glm::vec3(glm::unpackHalf1x16(packed[0]), glm::unpackHalf1x16(packed[1]), glm::unpackHalf1x16(packed[2]));
+        }
+        default: {
+            glm::vec3 col;
+            std::memcpy(&col, texel, sizeof(glm::vec3));
+            return col;
+        }
+    }
+}
+
+uint8_t Texture::encode_srgb8(float val) {
+    // branchless binary search for the number of thresholds below val, equals round(rgb_to_srgb(val) * 255) clamped to [0, 255]
+    uint32_t code = 0;
+    for (uint32_t step = 128; step > 0; step >>= 1)
+        code += val >= SRGB8_THRESHOLDS[code + step - 1] ? step : 0;
+    return code;
+}
+
+glm::vec3 Texture::fetch(const glm::uvec2& xy, uint32_t level) const {
     STAT("Texture lookup");
-    return texels[(xy.y % h) * w + (xy.x % w)];
+    assert(level < levels.size());
+    const glm::uvec2 res = dim(level);
+    if (tiled) return fetch_tiled(glm::uvec2(xy.x % res.x, xy.y % res.y), level);
+    return decode(levels[level].data() + ((xy.y % res.y) * res.x + (xy.x % res.x)) * texel_size());
 }
 
-glm::vec3 Texture::bilin(const glm::vec2& uv) const {
+glm::vec3 Texture::bilin(const glm::vec2& uv, uint32_t level) const {
     assert(std::isfinite(uv.x) && std::isfinite(uv.y));
     STAT("Texture lookup");
     const glm::vec2 uv_map = glm::fract(uv);
-    const glm::vec2 xy = uv_map * glm::vec2(w, h);
-    const glm::vec3 bl = fetch(glm::uvec2(xy) + glm::uvec2(0, 0));
-    const glm::vec3 br = fetch(glm::uvec2(xy) + glm::uvec2(1, 0));
-    const glm::vec3 tl = fetch(glm::uvec2(xy) + glm::uvec2(0, 1));
-    const glm::vec3 tr = fetch(glm::uvec2(xy) + glm::uvec2(1, 1));
+    const glm::vec2 xy = uv_map * glm::vec2(dim(level));
+    const glm::vec3 bl = fetch(glm::uvec2(xy) + glm::uvec2(0, 0), level);
+    const glm::vec3 br = fetch(glm::uvec2(xy) + glm::uvec2(1, 0), level);
+    const glm::vec3 tl = fetch(glm::uvec2(xy) + glm::uvec2(0, 1), level);
+    const glm::vec3 tr = fetch(glm::uvec2(xy) + glm::uvec2(1, 1), level);
     const glm::vec2 f = glm::fract(xy);
     return glm::mix(glm::mix(bl, br, f.x), glm::mix(tl, tr, f.x), f.y);
 }
 
+glm::vec3 Texture::trilin(const glm::vec2& uv, float lod) const {
+    if (levels.size() <= 1) return bilin(uv);
+    // footprint in texels of the base level
+    const float level = glm::clamp(lod + .5f * log2f(float(w * h)), 0.f, float(levels.size() - 1));
+    const uint32_t lower = uint32_t(level);
+    const float f = level - lower;
+    if (f <= 0.f) return bilin(uv, lower);
+    return glm::mix(bilin(uv, lower), bilin(uv, lower + 1), f);
+}
+
 glm::vec3 Texture::env(const glm::vec3& dir) const {
     STAT("Texture lookup");
     const float u = atan2f(dir.z, dir.x) / (2.f * M_PI);
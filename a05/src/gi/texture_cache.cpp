@@ -0,0 +1,250 @@
+#include "texture_cache.h"
+
+#include <array>
+#include <cstring>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <omp.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char TILED_MAGIC[8] = "GITEX";
+
+// ---------------------------------------------------------
+// TiledTexture
+
+TiledTexture::TiledTexture(const std::filesystem::path& source, uint32_t load_flags) : id([]() {
+        static std::atomic<uint32_t> next_id = 0;
+        return next_id++;
+    }()), source(source) {
+    std::memset(&header, 0, sizeof(Header));
+    const std::filesystem::path path = cache_path(source, load_flags);
+#ifdef _WIN32
+    handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+#endif
+        throw std::runtime_error("Error: failed to open tiled texture: " + path.string());
+}
+
+TiledTexture::~TiledTexture() {
+#ifdef _WIN32
+    CloseHandle(handle);
+#else
+    close(fd);
+#endif
+}
+
+bool TiledTexture::read(void* dst, size_t bytes, uint64_t offset) const {
+#ifdef _WIN32
+    // an explicit offset via OVERLAPPED makes ReadFile independent of the shared file pointer
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = DWORD(offset);
+    overlapped.OffsetHigh = DWORD(offset >> 32);
+    DWORD read_bytes = 0;
+    return ReadFile(handle, dst, DWORD(bytes), &read_bytes, &overlapped) && read_bytes == bytes;
+#else
+    return pread(fd, dst, bytes, offset) == ssize_t(bytes);
+#endif
+}
+
+std::shared_ptr<TiledTexture> TiledTexture::open(const std::filesystem::path& source, uint32_t load_flags) {
+    const std::filesystem::path path = cache_path(source, load_flags);
+    if (!std::filesystem::exists(path) || !std::filesystem::exists(source)) return nullptr;
+    try {
+        auto tex = std::make_shared<TiledTexture>(source, load_flags);
+        // validate header
+        Header& header = tex->header;
+        if (!tex->read(&header, sizeof(Header), 0)) return nullptr;
+        if (std::memcmp(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC)) != 0 || header.version != VERSION || header.load_flags != load_flags ||
+            header.tile_size != TILE_SIZE || header.format > TEXEL_RGB16F || header.num_levels == 0 || header.num_levels > 32)
+            return nullptr;
+        if (header.source_size != std::filesystem::file_size(source) || header.source_time != file_time(source))
+            return nullptr;
+        // read level table and validate tile ranges
+        tex->levels.resize(header.num_levels);
+        const size_t table_bytes = header.num_levels * sizeof(LevelEntry);
+        if (!tex->read(tex->levels.data(), table_bytes, sizeof(Header))) return nullptr;
+        const uint64_t file_size = std::filesystem::file_size(path);
+        for (const LevelEntry& level : tex->levels)
+            if (level.offset + uint64_t(level.tiles_x) * level.tiles_y * tex->tile_bytes() > file_size)
+                return nullptr;
+        return tex;
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: failed to read tiled texture " << path << ": " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+bool TiledTexture::write(const std::filesystem::path& source, uint32_t load_flags, const Texture& tex) {
+    assert(!tex.tiled);
+    const std::filesystem::path path = cache_path(source, load_flags);
+    // write to a temporary file per thread first, so concurrent (materials sharing a texture) or aborted writes never leave a truncated file behind
+    const std::filesystem::path tmp_path = path.string() + ".tmp" + std::to_string(omp_get_thread_num());
+    try {
+        Header header;
+        std::memcpy(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC));
+        header.version = VERSION;
+        header.load_flags = load_flags;
+        header.source_size = std::filesystem::file_size(source);
+        header.source_time = file_time(source);
+        header.width = tex.width();
+        header.height = tex.height();
+        header.format = tex.format;
+        header.tile_size = TILE_SIZE;
+        header.num_levels = tex.num_levels();
+        header.has_alpha = tex.has_alpha;
+
+        // level table, tile offsets are known up front
+        const size_t texel_size = tex.texel_size(), tile_bytes = TILE_SIZE * TILE_SIZE * texel_size;
+        std::vector<LevelEntry> levels(header.num_levels);
+        uint64_t offset = sizeof(Header) + levels.size() * sizeof(LevelEntry);
+        for (uint32_t i = 0; i < levels.size(); ++i) {
+            const glm::uvec2 res = tex.dim(i);
+            levels[i] = { res.x, res.y, (res.x + TILE_SIZE - 1) / TILE_SIZE, (res.y + TILE_SIZE - 1) / TILE_SIZE, offset };
+            offset += uint64_t(levels[i].tiles_x) * levels[i].tiles_y * tile_bytes;
+        }
+
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write((const char*)&header, sizeof(Header));
+        out.write((const char*)levels.data(), levels.size() * sizeof(LevelEntry));
+
+        // tiles, border tiles clamp to the last row/column
+        std::vector<uint8_t> tile(tile_bytes);
+        for (uint32_t i = 0; i < levels.size(); ++i) {
+            const LevelEntry& level = levels[i];
+            for (uint32_t ty = 0; ty < level.tiles_y; ++ty) {
+                for (uint32_t tx = 0; tx < level.tiles_x; ++tx) {
+                    for (uint32_t y = 0; y < TILE_SIZE; ++y) {
+                        const uint32_t sy = std::min(ty * TILE_SIZE + y, level.height - 1);
+                        for (uint32_t x = 0; x < TILE_SIZE; ++x) {
+                            const uint32_t sx = std::min(tx * TILE_SIZE + x, level.width - 1);
+                            std::memcpy(&tile[(y * TILE_SIZE + x) * texel_size], &tex.levels[i][(size_t(sy) * level.width + sx) * texel_size], texel_size);
+                        }
+                    }
+                    out.write((const char*)tile.data(), tile.size());
+                }
+            }
+        }
+
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp_path);
+            return false;
+        }
+        std::filesystem::rename(tmp_path, path);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: failed to write tiled texture " << path << ": " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+}
+
+glm::vec3 TiledTexture::fetch(const glm::uvec2& xy, uint32_t level) const {
+    assert(level < levels.size());
+    const uint32_t tile = (xy.y / TILE_SIZE) * levels[level].tiles_x + xy.x / TILE_SIZE;
+    const uint32_t texel = (xy.y % TILE_SIZE) * TILE_SIZE + xy.x % TILE_SIZE;
+    // neighbouring lookups mostly hit the same tile, so remember the last tile per texture and thread to skip the shard lock
+    // (direct-mapped by texture id, so interleaved albedo/normal/roughness fetches of a material keep their own slots)
+    struct LastTile {
+        uint64_t key = uint64_t(-1);
+        std::shared_ptr<const TextureCache::Tile> tile;
+    };
+    thread_local std::array<LastTile, 16> last_tiles;
+    LastTile& last = last_tiles[id % last_tiles.size()];
+    const uint64_t key = TextureCache::key(id, level, tile);
+    if (key != last.key) {
+        last.tile = TextureCache::global().get(*this, level, tile);
+        last.key = key;
+    }
+    return Texture::decode(last.tile->data() + texel * Texture::TEXEL_SIZE[header.format], TexelFormat(header.format));
+}
+
+void TiledTexture::read_tile(uint32_t level, uint32_t tile, uint8_t* dst) const {
+    const size_t bytes = tile_bytes();
+    if (!read(dst, bytes, levels[level].offset + uint64_t(tile) * bytes)) {
+        // render with black texels instead of failing inside a render thread
+        std::cerr << "Warning: failed to read tile " << tile << " of level " << level << " from " << cache_path(source, header.load_flags) << std::endl;
+        std::memset(dst, 0, bytes);
+    }
+}
+
+// ---------------------------------------------------------
+// TextureCache
+
+TextureCache& TextureCache::global() {
+    static TextureCache cache;
+    return cache;
+}
+
+void TextureCache::set_budget(size_t bytes) {
+    budget_bytes = bytes;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        evict(shard, bytes / NUM_SHARDS);
+    }
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::get(const TiledTexture& tex, uint32_t level, uint32_t tile) {
+    const uint64_t key = TextureCache::key(tex.id, level, tile);
+    Shard& shard = shards[(key * 0x9e3779b97f4a7c15ull) >> 58];
+    static_assert(NUM_SHARDS == 64, "shard selection uses the upper 6 bits of the hashed key");
+    {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        const auto it = shard.tiles.find(key);
+        if (it != shard.tiles.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.second);
+            return it->second.first;
+        }
+    }
+    // read outside of the lock, concurrent misses on the same tile may both read it and the first insert wins
+    auto data = std::make_shared<Tile>(tex.tile_bytes());
+    tex.read_tile(level, tile, data->data());
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    const auto it = shard.tiles.find(key);
+    if (it != shard.tiles.end())
+        return it->second.first;
+    const size_t max_bytes = budget_bytes / NUM_SHARDS;
+    evict(shard, max_bytes > data->size() ? max_bytes - data->size() : 0);
+    shard.lru.push_front(key);
+    shard.tiles.emplace(key, std::make_pair(data, shard.lru.begin()));
+    shard.bytes += data->size();
+    return data;
+}
+
+void TextureCache::evict(Shard& shard, size_t max_bytes) {
+    while (shard.bytes > max_bytes && !shard.lru.empty()) {
+        const auto it = shard.tiles.find(shard.lru.back());
+        shard.bytes -= it->second.first->size();
+        shard.tiles.erase(it);
+        shard.lru.pop_back();
+    }
+}
+
+void TextureCache::clear() {
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        evict(shard, 0);
+    }
+}
+
+size_t TextureCache::size_bytes() {
+    size_t bytes = 0;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        bytes += shard.bytes;
+    }
+    return bytes;
+}
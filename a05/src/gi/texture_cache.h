@@ -0,0 +1,158 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+#include "mmap.h"
+#include "texture.h"
+
+/**
+ * @brief Pre-tiled, pre-mipped texture file (.gitx in the cache directory, see cache_file_path()), read tile by tile through the TextureCache
+ *
+ * The file stores all mip levels of a prepared Texture in its TexelFormat, split into square tiles of TILE_SIZE^2 texels
+ * (border tiles are padded by clamping). It is generated once from the decoded image and afterwards replaces the image
+ * decode entirely: opening only reads the header, tiles are read on first access, so textures that are never hit never
+ * occupy memory.
+ * @note Staleness is detected via size and modification time of the image file, each set of load flags gets its own file.
+ */
+class TiledTexture {
+public:
+    static constexpr uint32_t VERSION = 1;      ///< Bump on any change to the file layout
+    static constexpr uint32_t TILE_SIZE = 64;   ///< Tile width and height in texels
+
+    /**
+     * @brief Open the tiled file of an image, if present and up to date
+     *
+     * @param source Path to the image file
+     * @param load_flags Caller defined flags describing how the texture was prepared (e.g. sRGB, channel conversion)
+     *
+     * @return Tiled texture or nullptr if missing, stale or invalid
+     */
+    static std::shared_ptr<TiledTexture> open(const std::filesystem::path& source, uint32_t load_flags);
+
+    /**
+     * @brief Conversion step: write all levels of a loaded texture as tiled file
+     *
+     * @param source Path to the image file the texture was loaded from
+     * @param load_flags Caller defined flags describing how the texture was prepared, see open()
+     * @param tex Texture to convert, including its mipmaps
+     *
+     * @return True on success
+     */
+    static bool write(const std::filesystem::path& source, uint32_t load_flags, const Texture& tex);
+
+    static std::filesystem::path cache_path(const std::filesystem::path& source, uint32_t load_flags) {
+        return cache_file_path(source, ".f" + std::to_string(load_flags) + ".gitx");
+    }
+
+    // open the tiled file of the given image and load flags for reading, throws std::runtime_error on failure
+    TiledTexture(const std::filesystem::path& source, uint32_t load_flags);
+    ~TiledTexture();
+
+    TiledTexture(const TiledTexture&)            = delete;
+    TiledTexture& operator=(const TiledTexture&) = delete;
+
+    // texel lookup (xy within the level resolution), loads the tile through the TextureCache if not resident
+    glm::vec3 fetch(const glm::uvec2& xy, uint32_t level) const;
+
+    // read one tile from disk, called by the TextureCache on a miss
+    void read_tile(uint32_t level, uint32_t tile, uint8_t* dst) const;
+
+    // positional read from the tiled file (thread-safe), returns true if all bytes were read
+    bool read(void* dst, size_t bytes, uint64_t offset) const;
+
+    inline uint32_t num_levels() const { return levels.size(); }
+    inline size_t tile_bytes() const { return TILE_SIZE * TILE_SIZE * Texture::TEXEL_SIZE[header.format]; }
+
+    // on-disk layout: Header, LevelEntry per level, tiles of all levels (row-major per level)
+    struct Header {
+        char magic[8];              ///< "GITEX"
+        uint32_t version;           ///< File layout version
+        uint32_t load_flags;        ///< Flags given on conversion
+        uint64_t source_size;       ///< Size of the image file in bytes
+        int64_t source_time;        ///< Modification time of the image file
+        uint32_t width, height;     ///< Resolution of level 0
+        uint32_t format;            ///< TexelFormat of all levels
+        uint32_t tile_size;         ///< Tile width and height in texels
+        uint32_t num_levels;        ///< Number of mip levels
+        uint32_t has_alpha;         ///< Image had an alpha channel?
+    };
+
+    struct LevelEntry {
+        uint32_t width, height;     ///< Level resolution in texels
+        uint32_t tiles_x, tiles_y;  ///< Number of tiles
+        uint64_t offset;            ///< File offset of the first tile
+    };
+
+    // data
+    const uint32_t id;                  ///< Unique id, part of the cache key
+    std::filesystem::path source;       ///< Image file path
+    Header header;                      ///< File header
+    std::vector<LevelEntry> levels;     ///< Level table
+#ifdef _WIN32
+    void* handle;                       ///< Open file handle, read via ReadFile at explicit offsets (thread-safe)
+#else
+    int fd;                             ///< Open file descriptor, read via pread (thread-safe)
+#endif
+};
+
+/**
+ * @brief Process wide, thread-safe LRU cache of texture tiles with a fixed memory budget
+ *
+ * Tiles are loaded lazily on first access and the least recently used tiles are evicted once the budget is exceeded.
+ * The cache is split into shards with one mutex each to keep lock contention between the render threads low, the budget
+ * is split evenly across the shards. Lookups hand out shared pointers, so evicted tiles stay valid while still in use.
+ */
+class TextureCache {
+public:
+    static constexpr uint32_t NUM_SHARDS = 64;
+    using Tile = std::vector<uint8_t>;
+
+    static TextureCache& global();
+
+    // set the memory budget in bytes (0 disables tiled loading of textures), evicts tiles if needed
+    void set_budget(size_t bytes);
+    inline size_t budget() const { return budget_bytes; }
+    inline bool enabled() const { return budget_bytes > 0; }
+
+    /**
+     * @brief Look up a tile, reading it from disk on a miss
+     *
+     * @param tex Tiled texture
+     * @param level Mip level
+     * @param tile Tile index within the level (row-major)
+     *
+     * @return Tile texels
+     */
+    std::shared_ptr<const Tile> get(const TiledTexture& tex, uint32_t level, uint32_t tile);
+
+    // drop all tiles
+    void clear();
+
+    // memory used by all resident tiles in bytes
+    size_t size_bytes();
+
+    static inline uint64_t key(uint32_t id, uint32_t level, uint32_t tile) { return (uint64_t(id) << 40) | (uint64_t(level) << 32) | tile; }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::list<uint64_t> lru;    ///< Keys, most recently used first
+        std::unordered_map<uint64_t, std::pair<std::shared_ptr<const Tile>, std::list<uint64_t>::iterator>> tiles;
+        size_t bytes = 0;           ///< Memory used by the tiles of this shard
+    };
+
+    void evict(Shard& shard, size_t max_bytes);
+
+    // data
+    Shard shards[NUM_SHARDS];
+    std::atomic<size_t> budget_bytes = 0;
+};
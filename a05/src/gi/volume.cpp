@@ -1,10 +1,17 @@
 #include "volume.h"
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <future>
+#include <chrono>
 #include <glm/gtx/string_cast.hpp>
 
 #include "rng.h"
+#include "color.h"
+#include "timer.h"
 #include "NanoVDB.h"
 #include "sampling.h"
 
@@ -38,98 +45,352 @@ struct NanoVDBMetaData {
 };
 static_assert(sizeof(NanoVDBMetaData) == 176, "nanovdb padding error");
 
-NVDBGrid::NVDBGrid(const std::filesystem::path& path, float density_scale) : density_scale(density_scale) {
-    if (!std::filesystem::exists(path))
-        throw std::runtime_error{path.string() + " does not exist."};
-    std::ifstream f{path, std::ios::in | std::ios::binary};
-    NanoVDBFileHeader header;
-    NanoVDBMetaData metadata;
-    f.read(reinterpret_cast<char*>(&header), sizeof(header));
-    f.read(reinterpret_cast<char*>(&metadata), sizeof(metadata));
-
-    if (header.magic != NANOVDB_MAGIC_NUMBER)
-        throw std::runtime_error{"Not a nanovdb file: " + path.string()};
-    if (header.gridCount == 0)
+// -----------------------------------------------
+// NVDBFile
+
+NVDBFile::NVDBFile(const std::filesystem::path& path) : path(path)
+#ifndef _WIN32
+    , file(path)
+#endif
+{
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error{"Error: failed to open file: " + path.string()};
+    num_bytes = size_t(in.tellg());
+    buffer.resize((num_bytes + sizeof(Block) - 1) / sizeof(Block));
+    in.seekg(0);
+    if (!in.read((char*)buffer.data(), num_bytes))
+        throw std::runtime_error{"Error: failed to read file: " + path.string()};
+    bytes = (const uint8_t*)buffer.data();
+#else
+    bytes = file.data();
+    num_bytes = file.size();
+#endif
+    // sequence of segments, each: header, meta data and name per grid, grid data per grid
+    const auto check_size = [&](size_t offset, size_t bytes) {
+        if (offset + bytes > num_bytes)
+            throw std::runtime_error{"Truncated nanovdb file: " + path.string()};
+    };
+    size_t offset = 0;
+    while (offset < num_bytes) {
+        check_size(offset, sizeof(NanoVDBFileHeader));
+        const NanoVDBFileHeader* header = at<NanoVDBFileHeader>(offset);
+        if (header->magic != NANOVDB_MAGIC_NUMBER)
+            throw std::runtime_error{"Not a nanovdb file: " + path.string()};
+        if (header->codec != 0)
+            throw std::runtime_error{"Can not use compressed nanovdb files: " + path.string()};
+        offset += sizeof(NanoVDBFileHeader);
+        std::vector<std::pair<const NanoVDBMetaData*, std::string>> metas;
+        for (uint32_t i = 0; i < header->gridCount; ++i) {
+            check_size(offset, sizeof(NanoVDBMetaData));
+            const NanoVDBMetaData* meta = at<NanoVDBMetaData>(offset);
+            if (meta->codec != 0)
+                throw std::runtime_error{"Can not use compressed nanovdb files: " + path.string()};
+            offset += sizeof(NanoVDBMetaData);
+            check_size(offset, meta->nameSize);
+            metas.emplace_back(meta, std::string(at<char>(offset), strnlen(at<char>(offset), meta->nameSize)));
+            offset += meta->nameSize;
+        }
+        for (const auto& [meta, name] : metas) {
+            check_size(offset, meta->gridSize);
+            const uint8_t* data = at<uint8_t>(offset);
+            if (!nanovdb::isAligned(data)) {
+                // names are not padded, so grids may start at any offset: copy those, all others stay in the mapping
+                aligned_copies.emplace_back((meta->gridSize + sizeof(Block) - 1) / sizeof(Block));
+                std::memcpy(aligned_copies.back().data(), data, meta->gridSize);
+                data = (const uint8_t*)aligned_copies.back().data();
+            }
+            grids.push_back({ name, nanovdb::GridType(meta->gridType), (const nanovdb::GridData*)data });
+            offset += meta->gridSize;
+        }
+    }
+    if (grids.empty())
         throw std::runtime_error{"No grids in file: " + path.string()};
-    if (header.gridCount > 1)
-        std::cerr << "Warning: Only loading first grid in file";
-    if (metadata.codec != 0)
-        throw std::runtime_error{"Can not use compressed nanovdb files."};
-    char name[256] = {};
-    if (metadata.nameSize > 256)
-        throw std::runtime_error{"Nanovdb name too long."};
-    f.read(name, metadata.nameSize);
-
-    nvdb_data.resize(metadata.gridSize);
-    f.read(nvdb_data.data(), metadata.gridSize);
-    const nanovdb::FloatGrid* grid = reinterpret_cast<const nanovdb::FloatGrid*>(nvdb_data.data());
-    if (!grid || !grid->isValid() || !grid->isFogVolume())
-        throw std::runtime_error("Empty or invalid NanoVDB grid!");
+}
+
+const nanovdb::FloatGrid* NVDBFile::find(const std::string& name) const {
+    for (const Entry& entry : grids)
+        if (entry.type == nanovdb::GridType::Float && entry.name == name)
+            return (const nanovdb::FloatGrid*)entry.data;
+    return nullptr;
+}
+
+std::string NVDBFile::density_grid() const {
+    if (find("density")) return "density";
+    for (const Entry& entry : grids)
+        if (entry.type == nanovdb::GridType::Float && ((const nanovdb::FloatGrid*)entry.data)->isFogVolume())
+            return entry.name;
+    throw std::runtime_error{"No density grid (float fog volume) in nanovdb file: " + path.string()};
+}
+
+void NVDBFile::prefetch() const {
+#ifndef _WIN32
+    file.prefetch();
+#endif
+}
+
+// -----------------------------------------------
+// NVDBGrid
+
+NVDBGrid::NVDBGrid(const std::shared_ptr<NVDBFile>& file, const std::string& name, float density_scale) :
+    file(file), nvdb(file->find(name)), name(name), density_scale(density_scale), majorant_origin(0), majorant_res(0) {
+    if (!nvdb || !nvdb->isValid())
+        throw std::runtime_error{"Empty or invalid NanoVDB grid \"" + name + "\" in " + file->path.string()};
 
     // compute index bounding box (lower-left corner and extent)
-    const nanovdb::CoordBBox ibb = grid->indexBBox();
-    ibb_min = grid->isEmpty() ? vec3(0) : vec3(ibb.min()[0], ibb.min()[1], ibb.min()[2]);
-    ibb_max = grid->isEmpty() ? vec3(0) : vec3(ibb.max()[0] + 1, ibb.max()[1] + 1, ibb.max()[2] + 1);
+    const nanovdb::CoordBBox ibb = nvdb->indexBBox();
+    ibb_min = nvdb->isEmpty() ? vec3(0) : vec3(ibb.min()[0], ibb.min()[1], ibb.min()[2]);
+    ibb_max = nvdb->isEmpty() ? vec3(0) : vec3(ibb.max()[0] + 1, ibb.max()[1] + 1, ibb.max()[2] + 1);
     // extract transform
     transform = mat4(1);
     for (int i = 0; i < 3; ++i) {
         for (int j = 0; j < 3; ++j)
-            transform[i][j] = grid->map().mMatF[i * 3 + j];
-        transform[3][i] = grid->map().mVecF[i];
+            transform[i][j] = nvdb->map().mMatF[i * 3 + j];
+        transform[3][i] = nvdb->map().mVecF[i];
     }
 }
 
 NVDBGrid::~NVDBGrid() {}
 
 float NVDBGrid::min_value() const {
-    const nanovdb::FloatGrid* grid = reinterpret_cast<const nanovdb::FloatGrid*>(nvdb_data.data());
-    return density_scale * grid->tree().root().minimum();
+    return density_scale * nvdb->tree().root().minimum();
 }
 
 float NVDBGrid::max_value() const {
-    const nanovdb::FloatGrid* grid = reinterpret_cast<const nanovdb::FloatGrid*>(nvdb_data.data());
-    return density_scale * grid->tree().root().maximum();
+    return density_scale * nvdb->tree().root().maximum();
 }
 
 float NVDBGrid::lookup_density(const uvec3& ipos) const {
-    const nanovdb::FloatGrid* grid = reinterpret_cast<const nanovdb::FloatGrid*>(nvdb_data.data());
-    const auto acc = grid->getAccessor();
-    return density_scale * acc.getValue(nanovdb::Coord(ipos.x, ipos.y, ipos.z));
+    return lookup_density(accessor(), ivec3(ipos));
 }
 
 float NVDBGrid::lookup_density_trilinear(const vec3& ipos) const {
+    return lookup_density_trilinear(accessor(), ipos);
+}
+
+float NVDBGrid::lookup_density_stochastic(const vec3& ipos) const {
+    return lookup_density_stochastic(accessor(), ipos);
+}
+
+NVDBGrid::Accessor NVDBGrid::accessor() const {
+    return nvdb->getAccessor();
+}
+
+float NVDBGrid::lookup_density(const Accessor& acc, const ivec3& ipos) const {
+    return density_scale * acc.getValue(nanovdb::Coord(ipos.x, ipos.y, ipos.z));
+}
+
+float NVDBGrid::lookup_density_trilinear(const Accessor& acc, const vec3& ipos) const {
     const vec3 f = fract(ipos - .5f);
     const ivec3 iipos = ivec3(floor(ipos - .5f));
-    const float lx0 = mix(lookup_density(iipos + ivec3(0, 0, 0)), lookup_density(iipos + ivec3(1, 0, 0)), f.x);
-    const float lx1 = mix(lookup_density(iipos + ivec3(0, 1, 0)), lookup_density(iipos + ivec3(1, 1, 0)), f.x);
-    const float hx0 = mix(lookup_density(iipos + ivec3(0, 0, 1)), lookup_density(iipos + ivec3(1, 0, 1)), f.x);
-    const float hx1 = mix(lookup_density(iipos + ivec3(0, 1, 1)), lookup_density(iipos + ivec3(1, 1, 1)), f.x);
-    return mix(mix(lx0, lx1, f.y), mix(hx0, hx1, f.y), f.z);
+    const nanovdb::Coord ijk(iipos.x, iipos.y, iipos.z);
+    // stencil values indexed by x * 4 + y * 2 + z
+    float v[8];
+    const auto* leaf = (iipos.x & 7) != 7 && (iipos.y & 7) != 7 && (iipos.z & 7) != 7 ? acc.probeLeaf(ijk) : nullptr;
+    if (leaf) {
+        // stencil within one leaf: fixed offsets into its value array (x: 64, y: 8, z: 1)
+        const uint32_t offset = leaf->CoordToOffset(ijk);
+        for (uint32_t i = 0; i < 8; ++i)
+            v[i] = leaf->getValue(offset + (i >> 2) * 64 + ((i >> 1) & 1) * 8 + (i & 1));
+    } else {
+        // stencil across leaves or in a tile, the accessor still caches the shared internal nodes
+        for (uint32_t i = 0; i < 8; ++i)
+            v[i] = acc.getValue(ijk + nanovdb::Coord(i >> 2, (i >> 1) & 1, i & 1));
+    }
+    const float lx0 = mix(v[0], v[4], f.x), lx1 = mix(v[2], v[6], f.x);
+    const float hx0 = mix(v[1], v[5], f.x), hx1 = mix(v[3], v[7], f.x);
+    return density_scale * mix(mix(lx0, lx1, f.y), mix(hx0, hx1, f.y), f.z);
 }
 
-float NVDBGrid::lookup_density_stochastic(const vec3& ipos) const {
-    return lookup_density(uvec3(ipos + RNG::uniform<vec3>() - .5f));
+float NVDBGrid::lookup_density_stochastic(const Accessor& acc, const vec3& ipos) const {
+    return lookup_density(acc, ivec3(floor(ipos + RNG::uniform<vec3>() - .5f)));
+}
+
+void NVDBGrid::build_majorants() {
+    const auto& tree = nvdb->tree();
+    // cells aligned to the leaf nodes, covering the index bounding box
+    majorant_origin = ivec3(floor(ibb_min / float(MAJORANT_CELL)));
+    majorant_res = max(ivec3(ceil(ibb_max / float(MAJORANT_CELL))) - majorant_origin, ivec3(1));
+    // background and root tiles bound all space not covered by an internal node
+    float base = tree.background();
+    const auto* root = tree.root().data();
+    for (uint32_t i = 0; i < root->mTableSize; ++i)
+        if (!root->tile(i)->isChild())
+            base = fmaxf(base, root->tile(i)->value);
+    std::vector<float> cells(size_t(majorant_res.x) * majorant_res.y * majorant_res.z, base);
+    // max value into all cells overlapping the index-space box [origin, origin + size) (node origins are multiples of the cell size)
+    const auto splat = [&](const nanovdb::Coord& origin, int size, float value) {
+        if (value <= base) return;
+        const ivec3 lo = ivec3(origin[0], origin[1], origin[2]) / MAJORANT_CELL - majorant_origin;
+        const ivec3 hi = min(lo + size / MAJORANT_CELL, majorant_res);
+        for (int z = std::max(lo.z, 0); z < hi.z; ++z)
+            for (int y = std::max(lo.y, 0); y < hi.y; ++y)
+                for (int x = std::max(lo.x, 0); x < hi.x; ++x)
+                    cells[(size_t(z) * majorant_res.y + y) * majorant_res.x + x] = fmaxf(cells[(size_t(z) * majorant_res.y + y) * majorant_res.x + x], value);
+    };
+    // constant tiles of the internal nodes (child slots are linearized as x, y, z from major to minor)
+    const auto splat_tiles = [&](const auto& node, int log2dim, int child_size) {
+        for (uint32_t n = 0; n < (1u << (3 * log2dim)); ++n) {
+            if (node.data()->isChild(n)) continue;
+            const int mask = (1 << log2dim) - 1;
+            const nanovdb::Coord offset(int(n >> (2 * log2dim)) * child_size, int((n >> log2dim) & mask) * child_size, int(n & mask) * child_size);
+            splat(node.origin() + offset, child_size, node.data()->getValue(n));
+        }
+    };
+    for (uint32_t i = 0; i < tree.nodeCount(2); ++i)
+        splat_tiles(tree.getFirstUpper()[i], 5, 128);
+    for (uint32_t i = 0; i < tree.nodeCount(1); ++i)
+        splat_tiles(tree.getFirstLower()[i], 4, 8);
+    // leaf nodes
+    for (uint32_t i = 0; i < tree.nodeCount(0); ++i)
+        splat(tree.getFirstLeaf()[i].origin(), 8, tree.getFirstLeaf()[i].maximum());
+    // dilate by one cell, as trilinear lookups reach half a voxel into the neighbouring cells
+    majorants.resize(cells.size());
+    #pragma omp parallel for
+    for (int z = 0; z < majorant_res.z; ++z) {
+        for (int y = 0; y < majorant_res.y; ++y) {
+            for (int x = 0; x < majorant_res.x; ++x) {
+                float m = base;
+                for (int dz = std::max(z - 1, 0); dz <= std::min(z + 1, majorant_res.z - 1); ++dz)
+                    for (int dy = std::max(y - 1, 0); dy <= std::min(y + 1, majorant_res.y - 1); ++dy)
+                        for (int dx = std::max(x - 1, 0); dx <= std::min(x + 1, majorant_res.x - 1); ++dx)
+                            m = fmaxf(m, cells[(size_t(dz) * majorant_res.y + dy) * majorant_res.x + dx]);
+                majorants[(size_t(z) * majorant_res.y + y) * majorant_res.x + x] = m;
+            }
+        }
+    }
 }
 
 // -----------------------------------------------
 // Volume
 
-Volume::Volume(const std::filesystem::path& path, float density_scale) :
-    grid(path, density_scale),
+Volume::Frame Volume::load_frame(const std::filesystem::path& path, float density_scale) {
+    const auto file = std::make_shared<NVDBFile>(path);
+    file->prefetch();
+    Frame frame { NVDBGrid(file, file->density_grid(), density_scale), {} };
+    // all other float grids share the mapping, other value types (e.g. velocity) are not used
+    for (const NVDBFile::Entry& entry : file->grids)
+        if (entry.type == nanovdb::GridType::Float && entry.name != frame.grid.name)
+            frame.grids.emplace_back(file, entry.name);
+    // build majorant grid (visits every leaf node, so this also pages in the grid)
+    Timer timer;
+    timer.start("majorants");
+    frame.grid.build_majorants();
+    timer.stop("majorants");
+    std::cout << "built majorant grid " << frame.grid.majorant_res.x << "x" << frame.grid.majorant_res.y << "x" << frame.grid.majorant_res.z
+        << " for " << path.filename() << " in " << timer.get_ms("majorants") << "ms" << std::endl;
+    return frame;
+}
+
+Volume::Volume(const std::filesystem::path& path, float density_scale) : Volume(load_frame(path, density_scale)) {}
+
+Volume::Volume(Frame&& frame) :
+    grid(std::move(frame.grid)),
+    grids(std::move(frame.grids)),
     model(1),
     scattering_cross_section(0.001),
     absorption_cross_section(0.001),
     phase_g(0),
-    raymarch_dt(0.1) {}
+    raymarch_dt(0.1),
+    majorant_grid(true),
+    raymarch_coherent(true),
+    blackbody(false),
+    emission_color(1),
+    emission_scale(1),
+    temperature_scale(1),
+    temperature_offset(0),
+    current_frame(0),
+    next_frame(0) {
+    // pick up common emission grids of fire and explosion assets
+    if (find_grid("temperature")) {
+        emission_grid_name = "temperature";
+        blackbody = true;
+    } else if (find_grid("flames"))
+        emission_grid_name = "flames";
+    else if (find_grid("emission"))
+        emission_grid_name = "emission";
+    commit();
+}
 
 Volume::~Volume() {}
 
-vec3 Volume::world_to_index(const vec4& wpos) const {
-    return vec3(inverse(model * grid.transform) * wpos);
+const NVDBGrid* Volume::find_grid(const std::string& name) const {
+    if (grid.name == name) return &grid;
+    for (const NVDBGrid& g : grids)
+        if (g.name == name) return &g;
+    return nullptr;
+}
+
+void Volume::set_sequence(const std::vector<std::filesystem::path>& paths) {
+    frames = paths;
+    current_frame = 0;
+    retire_prefetch();
+    // load the second frame while the first one renders
+    if (frames.size() > 1) {
+        next_frame = 1;
+        next = std::async(std::launch::async, load_frame, frames[next_frame], 1.f);
+    }
+}
+
+void Volume::set_frame(uint32_t index) {
+    if (frames.empty() || index % frames.size() == current_frame) return;
+    index %= frames.size();
+    // take the prefetched frame if it matches (blocks until loaded), else load synchronously
+    Frame frame = next.valid() && next_frame == index ? next.get() : load_frame(frames[index]);
+    frame.grid.density_scale = grid.density_scale;
+    grid = std::move(frame.grid);
+    grids = std::move(frame.grids);
+    current_frame = index;
+    retire_prefetch();
+    // prefetch the following frame while this one renders
+    if (frames.size() > 1) {
+        next_frame = (current_frame + 1) % frames.size();
+        next = std::async(std::launch::async, load_frame, frames[next_frame], 1.f);
+    }
+}
+
+void Volume::retire_prefetch() {
+    // destroying a pending std::async future blocks until it finishes, so park outdated loads instead of dropping them
+    if (next.valid()) stale.push_back(std::move(next));
+    stale.erase(std::remove_if(stale.begin(), stale.end(), [](const std::future<Frame>& load) {
+        return load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), stale.end());
+}
+
+void Volume::commit() {
+    index_to_world_mat = model * grid.transform;
+    world_to_index_mat = inverse(index_to_world_mat);
+    // world-space AABB from the transformed corners of the index-space AABB
+    bb_min = vec3(FLT_MAX), bb_max = vec3(-FLT_MAX);
+    for (uint32_t i = 0; i < 8; ++i) {
+        const vec3 corner((i & 1) ? grid.ibb_max.x : grid.ibb_min.x, (i & 2) ? grid.ibb_max.y : grid.ibb_min.y, (i & 4) ? grid.ibb_max.z : grid.ibb_min.z);
+        const vec3 world = index_to_world(vec4(corner, 1.f));
+        bb_min = min(bb_min, world);
+        bb_max = max(bb_max, world);
+    }
+    const NVDBGrid* emission = emission_grid();
+    emission_index_to_world_mat = emission ? model * emission->transform : index_to_world_mat;
+    emission_world_to_index_mat = inverse(emission_index_to_world_mat);
+}
+
+const NVDBGrid* Volume::emission_grid() const {
+    return emission_grid_name.empty() ? nullptr : find_grid(emission_grid_name);
+}
+
+vec3 Volume::Le(float value) const {
+    if (blackbody)
+        return emission_scale * ::blackbody(temperature_scale * value + temperature_offset);
+    return emission_scale * fmaxf(0.f, value) * emission_color;
 }
 
-vec3 Volume::index_to_world(const vec4& ipos) const {
-    return vec3(model * grid.transform * ipos);
+vec3 Volume::Le(const vec3& wpos) const {
+    const NVDBGrid* emission = emission_grid();
+    if (!emission) return vec3(0);
+    const ivec3 ipos = ivec3(floor(vec3(emission_world_to_index_mat * vec4(wpos, 1.f))));
+    const nanovdb::Coord ijk(ipos.x, ipos.y, ipos.z);
+    const auto* leaf = emission->accessor().probeLeaf(ijk);
+    return leaf ? Le(leaf->getValue(ijk)) : vec3(0);
 }
 
 float Volume::albedo() const {
@@ -141,81 +402,166 @@ float Volume::extinction_cross_section() const {
 }
 
 std::tuple<vec3, vec3> Volume::compute_AABB() const {
-    return { index_to_world(vec4(grid.ibb_min, 1.f)), index_to_world(vec4(grid.ibb_max, 1.f)) };
+    return { bb_min, bb_max };
 }
 
 std::tuple<bool, float, float> Volume::intersect(const Ray& ray) const {
-    const auto [aabb_min, aabb_max] = compute_AABB();
-    const vec3 inv_dir = 1.f / ray.dir;
-    const vec3 lo = (aabb_min - ray.org) * inv_dir;
-    const vec3 hi = (aabb_max - ray.org) * inv_dir;
+    return intersect_index(world_to_index(vec4(ray.org, 1.f)), world_to_index(vec4(ray.dir, 0.f)), ray.tnear, ray.tfar);
+}
+
+std::tuple<bool, float, float> Volume::intersect_index(const vec3& ipos, const vec3& idir, float tnear, float tfar) const {
+    // slab test against the index-space AABB, which is exact under rotation (unlike the world-space AABB)
+    const vec3 inv_dir = 1.f / idir;
+    const vec3 lo = (grid.ibb_min - ipos) * inv_dir;
+    const vec3 hi = (grid.ibb_max - ipos) * inv_dir;
     const vec3 tmin = min(lo, hi), tmax = max(lo, hi);
-    const float near = fmaxf(ray.tnear, fmaxf(tmin.x, fmaxf(tmin.y, tmin.z)));
-    const float far = fminf(ray.tfar, fminf(tmax.x, fminf(tmax.y, tmax.z)));
+    const float near = fmaxf(tnear, fmaxf(tmin.x, fmaxf(tmin.y, tmin.z)));
+    const float far = fminf(tfar, fminf(tmax.x, fminf(tmax.y, tmax.z)));
     return { near < far && std::isfinite(near) && far != FLT_MAX, near, far };
 }
 
+template <typename F> void Volume::traverse_majorants(const vec3& ipos, const vec3& idir, float near, float far, F&& segment) const {
+    if (!majorant_grid || grid.majorants.empty()) {
+        segment(near, far, grid.max_value());
+        return;
+    }
+    // ray in majorant grid cells, the parametrization stays the same
+    const vec3 gpos = ipos / float(NVDBGrid::MAJORANT_CELL) - vec3(grid.majorant_origin);
+    const vec3 gdir = idir / float(NVDBGrid::MAJORANT_CELL);
+    ivec3 cell = clamp(ivec3(floor(gpos + near * gdir)), ivec3(0), grid.majorant_res - 1);
+    // 3D DDA (Amanatides and Woo, "A Fast Voxel Traversal Algorithm for Ray Tracing")
+    ivec3 step;
+    vec3 t_next, t_delta;
+    for (int a = 0; a < 3; ++a) {
+        if (gdir[a] == 0.f) {
+            step[a] = 0, t_next[a] = FLT_MAX, t_delta[a] = 0.f;
+            continue;
+        }
+        step[a] = gdir[a] > 0.f ? 1 : -1;
+        t_next[a] = (cell[a] + (step[a] > 0 ? 1 : 0) - gpos[a]) / gdir[a];
+        t_delta[a] = step[a] / gdir[a];
+    }
+    for (float t = near; t < far; ) {
+        const int a = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+        const float t1 = fminf(t_next[a], far);
+        if (t1 > t && !segment(t, t1, grid.majorant(cell))) return;
+        t = t1;
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= grid.majorant_res[a]) return;
+        t_next[a] += t_delta[a];
+    }
+}
+
 float Volume::transmittance_raymarching(const Ray& ray) const {
-    // clip ray against volume AABB
-    const auto [hit, near, far] = intersect(ray);
-    if (!hit) return 1.f;
     // transform ray to index-space
     const vec3 ipos = world_to_index(vec4(ray.org, 1.f));
     const vec3 idir = world_to_index(vec4(ray.dir, 0.f)); // non-normalized!
+    // clip ray against volume AABB
+    const auto [hit, near, far] = intersect_index(ipos, idir, ray.tnear, ray.tfar);
+    if (!hit) return 1.f;
 
-    // TODO: ASSIGNMENT5: implement transmittance estimation using ray marching in the ray segment [near, far]
-    // Hint: see the class members raymarch_dt, absorption_cross_section and scattering_cross_section
-    // Hint: use NVDBGrid::lookup_density*() to fetch density values from the index-space grid
-    // Hint: randomly offset the start position using RNG::uniform<float>() to avoid banding artifacts
-
-    return 1.f;
+    // accumulate optical depth with one jittered sample per step (the same offset for all steps avoids banding)
+    const float sigma_t = extinction_cross_section();
+    const NVDBGrid::Accessor acc = grid.accessor();
+    const float offset = RNG::uniform<float>();
+    float tau = 0.f;
+    for (float t0 = near; t0 < far; t0 += raymarch_dt) {
+        const float dt = fminf(raymarch_dt, far - t0);
+        const vec3 p = ipos + (t0 + offset * dt) * idir;
+        ++density_lookups;
+        tau += (raymarch_coherent ? grid.lookup_density_trilinear(acc, p) : grid.lookup_density_trilinear(p)) * sigma_t * dt;
+    }
+    return expf(-tau);
 }
 
 float Volume::transmittance_ratio_tracking(const Ray& ray) const {
-    // clip ray against volume AABB
-    const auto [hit, near, far] = intersect(ray);
-    if (!hit) return 1.f;
     // transform ray to index-space
     const vec3 ipos = world_to_index(vec4(ray.org, 1.f));
     const vec3 idir = world_to_index(vec4(ray.dir, 0.f)); // non-normalized!
+    // clip ray against volume AABB
+    const auto [hit, near, far] = intersect_index(ipos, idir, ray.tnear, ray.tfar);
+    if (!hit) return 1.f;
 
-    // TODO: ASSIGNMENT5: implement transmittance estimation using ratio tracking in the ray segment [near, far]
-    // Hint: see the class members absorption_cross_section and scattering_cross_section
-    // Hint: use NVDBGrid::max_value() to fetch the maximum density value in volume
-
-    return 1.f;
+    // ratio tracking with local majorants, restarting the free-flight sampling at every majorant segment
+    const float sigma_t = extinction_cross_section();
+    const NVDBGrid::Accessor acc = grid.accessor();
+    float Tr = 1.f;
+    traverse_majorants(ipos, idir, near, far, [&](float t0, float t1, float majorant) {
+        const float mu_bar = majorant * sigma_t;
+        if (mu_bar <= 0.f) return true; // empty space
+        for (float t = t0 - logf(1.f - RNG::uniform<float>()) / mu_bar; t < t1; t -= logf(1.f - RNG::uniform<float>()) / mu_bar) {
+            ++density_lookups;
+            const float mu = grid.lookup_density_trilinear(acc, ipos + t * idir) * sigma_t;
+            Tr *= fmaxf(0.f, 1.f - mu / mu_bar);
+            // russian roulette on low transmittance
+            if (Tr < .1f) {
+                if (RNG::uniform<float>() >= Tr / .1f) {
+                    Tr = 0.f;
+                    return false;
+                }
+                Tr = .1f;
+            }
+        }
+        return true;
+    });
+    return Tr;
 }
 
 std::tuple<bool, float> Volume::sample_raymarching(const Ray& ray) const {
-    // clip ray against volume AABB
-    const auto [hit, near, far] = intersect(ray);
-    if (!hit) return { false, ray.tnear };
     // transform ray to index-space
     const vec3 ipos = world_to_index(vec4(ray.org, 1.f));
     const vec3 idir = world_to_index(vec4(ray.dir, 0.f)); // non-normalized!
+    // clip ray against volume AABB
+    const auto [hit, near, far] = intersect_index(ipos, idir, ray.tnear, ray.tfar);
+    if (!hit) return { false, ray.tnear };
 
-    // TODO: ASSIGNMENT5: implement volume sampling using ray marching in the ray segment [near, far]
-    // Hint: see the class members raymarch_dt, absorption_cross_section and scattering_cross_section
-    // Hint: use NVDBGrid::lookup_density*() to fetch density values from the index-space grid
-    // Hint: randomly offset the start position using RNG::uniform<float>() to avoid banding artifacts
-
+    // march until the accumulated optical depth reaches a sampled target, the density is constant per step
+    const float sigma_t = extinction_cross_section();
+    const NVDBGrid::Accessor acc = grid.accessor();
+    const float offset = RNG::uniform<float>();
+    const float target = -logf(1.f - RNG::uniform<float>());
+    float tau = 0.f;
+    for (float t0 = near; t0 < far; t0 += raymarch_dt) {
+        const float dt = fminf(raymarch_dt, far - t0);
+        const vec3 p = ipos + (t0 + offset * dt) * idir;
+        ++density_lookups;
+        const float mu = (raymarch_coherent ? grid.lookup_density_trilinear(acc, p) : grid.lookup_density_trilinear(p)) * sigma_t;
+        if (mu <= 0.f) continue; // empty step, also avoids 0 / 0 for a zero target
+        if (tau + mu * dt >= target)
+            return { true, t0 + (target - tau) / mu };
+        tau += mu * dt;
+    }
     return { false, ray.tfar };
 }
 
 std::tuple<bool, float> Volume::sample_delta_tracking(const Ray& ray) const {
-    // clip ray against volume AABB
-    const auto [hit, near, far] = intersect(ray);
-    if (!hit) return { false, ray.tfar };
     // transform ray to index-space
     const vec3 ipos = world_to_index(vec4(ray.org, 1.f));
     const vec3 idir = world_to_index(vec4(ray.dir, 0.f)); // non-normalized!
+    // clip ray against volume AABB
+    const auto [hit, near, far] = intersect_index(ipos, idir, ray.tnear, ray.tfar);
+    if (!hit) return { false, ray.tfar };
 
-    // TODO: ASSIGNMENT5: implement volume sampling using delta tracking in the ray segment [near, far]
-    // Hint: see the class members absorption_cross_section and scattering_cross_section
-    // Hint: use NVDBGrid::lookup_density*() to fetch density values from the index-space grid
-    // Hint: use NVDBGrid::max_value() to fetch the maximum density value in volume
-
-    return { false, ray.tfar };
+    // delta tracking with local majorants, restarting the free-flight sampling at every majorant segment
+    const float sigma_t = extinction_cross_section();
+    const NVDBGrid::Accessor acc = grid.accessor();
+    bool scattered = false;
+    float t_scatter = ray.tfar;
+    traverse_majorants(ipos, idir, near, far, [&](float t0, float t1, float majorant) {
+        const float mu_bar = majorant * sigma_t;
+        if (mu_bar <= 0.f) return true; // empty space
+        for (float t = t0 - logf(1.f - RNG::uniform<float>()) / mu_bar; t < t1; t -= logf(1.f - RNG::uniform<float>()) / mu_bar) {
+            ++density_lookups;
+            const float mu = grid.lookup_density_trilinear(acc, ipos + t * idir) * sigma_t;
+            if (RNG::uniform<float>() * mu_bar < mu) {
+                scattered = true;
+                t_scatter = t;
+                return false;
+            }
+        }
+        return true;
+    });
+    return { scattered, t_scatter };
 }
 
 float Volume::transmittance(const Ray& ray) const {
@@ -244,7 +590,16 @@ json11::Json Volume::to_json() const {
         { "scattering_cross_section", scattering_cross_section },
         { "phase_g", phase_g },
         { "unbiased_estimators", unbiased_estimators },
-        { "raymarch_dt", raymarch_dt }
+        { "raymarch_dt", raymarch_dt },
+        { "majorant_grid", majorant_grid },
+        { "raymarch_coherent", raymarch_coherent },
+        { "emission_grid", emission_grid_name },
+        { "blackbody", blackbody },
+        { "emission_color", json11::Json::array{ emission_color.x, emission_color.y, emission_color.z } },
+        { "emission_scale", emission_scale },
+        { "temperature_scale", temperature_scale },
+        { "temperature_offset", temperature_offset },
+        { "frame", int(current_frame) }
     };
 }
 
@@ -261,5 +616,99 @@ void Volume::from_json(const json11::Json& cfg) {
         json_set_float(cfg, "phase_g", phase_g);
         json_set_bool(cfg, "unbiased_estimators", unbiased_estimators);
         json_set_float(cfg, "raymarch_dt", raymarch_dt);
+        json_set_bool(cfg, "majorant_grid", majorant_grid);
+        json_set_bool(cfg, "raymarch_coherent", raymarch_coherent);
+        json_set_string(cfg, "emission_grid", emission_grid_name);
+        json_set_bool(cfg, "blackbody", blackbody);
+        json_set_vec3(cfg, "emission_color", emission_color);
+        json_set_float(cfg, "emission_scale", emission_scale);
+        json_set_float(cfg, "temperature_scale", temperature_scale);
+        json_set_float(cfg, "temperature_offset", temperature_offset);
+        uint32_t frame = current_frame;
+        json_set_uint(cfg, "frame", frame);
+        set_frame(frame);
+        commit();
+    }
+}
+
+// -----------------------------------------------
+// benchmarks
+
+void perform_volume_benchmarks(Volume& volume, uint32_t num_rays) {
+    // random rays from the bounding sphere of the volume towards random points inside its AABB
+    const auto [bb_min, bb_max] = volume.compute_AABB();
+    const vec3 center = .5f * (bb_min + bb_max);
+    const float radius = .5f * length(bb_max - bb_min);
+    std::vector<Ray> rays;
+    for (uint32_t i = 0; i < num_rays; ++i) {
+        const vec3 org = center + radius * uniform_sample_sphere(RNG::uniform<vec2>());
+        const vec3 target = bb_min + RNG::uniform<vec3>() * (bb_max - bb_min);
+        rays.emplace_back(org, normalize(target - org));
     }
+
+    // time an estimator over all rays
+    const auto run = [&](const char* label, const auto& estimator) {
+        Volume::density_lookups = 0;
+        Timer timer;
+        timer.start("volume");
+        float sum = 0.f;
+        for (const Ray& ray : rays)
+            sum += estimator(ray);
+        timer.stop("volume");
+        printf("%-40s %8.2f lookups/ray %10.2fns/ray %8.2f Mlookups/s (checksum: %f)\n", label, Volume::density_lookups / double(rays.size()),
+            timer.get_ns("volume") / double(rays.size()), Volume::density_lookups * 1e3 / timer.get_ns("volume"), sum / rays.size());
+    };
+    const auto delta_tracking = [&](const Ray& ray) { return float(std::get<0>(volume.sample_delta_tracking(ray))); };
+    const auto ratio_tracking = [&](const Ray& ray) { return volume.transmittance_ratio_tracking(ray); };
+    const auto raymarching = [&](const Ray& ray) { return volume.transmittance_raymarching(ray); };
+
+    // raw trilinear lookups along the rays in steps of half a voxel: 0: accessor per voxel (8 per lookup), 1: accessor per lookup, 2: accessor per ray
+    const auto run_lookups = [&](const char* label, int mode) {
+        const NVDBGrid& grid = volume.grid;
+        uint64_t lookups = 0;
+        float sum = 0.f;
+        Timer timer;
+        timer.start("lookups");
+        for (const Ray& ray : rays) {
+            const vec3 ipos = volume.world_to_index(vec4(ray.org, 1.f));
+            const vec3 idir = volume.world_to_index(vec4(ray.dir, 0.f));
+            const auto [hit, near, far] = volume.intersect_index(ipos, idir, ray.tnear, ray.tfar);
+            if (!hit) continue;
+            const NVDBGrid::Accessor acc = grid.accessor();
+            const float dt = .5f / length(idir);
+            for (float t = near; t < far; t += dt, ++lookups) {
+                const vec3 p = ipos + t * idir;
+                if (mode == 0) {
+                    const vec3 f = fract(p - .5f);
+                    const uvec3 i = uvec3(ivec3(floor(p - .5f)));
+                    const float lx0 = mix(grid.lookup_density(i + uvec3(0, 0, 0)), grid.lookup_density(i + uvec3(1, 0, 0)), f.x);
+                    const float lx1 = mix(grid.lookup_density(i + uvec3(0, 1, 0)), grid.lookup_density(i + uvec3(1, 1, 0)), f.x);
+                    const float hx0 = mix(grid.lookup_density(i + uvec3(0, 0, 1)), grid.lookup_density(i + uvec3(1, 0, 1)), f.x);
+                    const float hx1 = mix(grid.lookup_density(i + uvec3(0, 1, 1)), grid.lookup_density(i + uvec3(1, 1, 1)), f.x);
+                    sum += mix(mix(lx0, lx1, f.y), mix(hx0, hx1, f.y), f.z);
+                } else
+                    sum += mode == 1 ? grid.lookup_density_trilinear(p) : grid.lookup_density_trilinear(acc, p);
+            }
+        }
+        timer.stop("lookups");
+        printf("%-40s %8.2f Mlookups/s (checksum: %f)\n", label, lookups * 1e3 / timer.get_ns("lookups"), sum / std::max<uint64_t>(lookups, 1));
+    };
+
+    printf("Volume benchmarks: %zu rays, majorant grid %dx%dx%d\n", rays.size(), volume.grid.majorant_res.x, volume.grid.majorant_res.y, volume.grid.majorant_res.z);
+    const bool majorant_grid = volume.majorant_grid, raymarch_coherent = volume.raymarch_coherent;
+    run_lookups("trilinear (accessor per voxel):", 0);
+    run_lookups("trilinear (accessor per lookup):", 1);
+    run_lookups("trilinear (accessor per ray):", 2);
+    volume.majorant_grid = false;
+    run("delta tracking (global majorant):", delta_tracking);
+    run("ratio tracking (global majorant):", ratio_tracking);
+    volume.majorant_grid = true;
+    run("delta tracking (majorant grid):", delta_tracking);
+    run("ratio tracking (majorant grid):", ratio_tracking);
+    volume.raymarch_coherent = false;
+    run("raymarching (accessor per lookup):", raymarching);
+    volume.raymarch_coherent = true;
+    run("raymarching (step-coherent):", raymarching);
+    volume.majorant_grid = majorant_grid;
+    volume.raymarch_coherent = raymarch_coherent;
 }
@@ -1,17 +1,60 @@
 #pragma once
+#include <string>
 #include <vector>
+#include <memory>
+#include <future>
 #include <filesystem>
 
 #include "ray.h"
+#include "mmap.h"
 #include "json11.h"
+#include "NanoVDB.h"
 #include "glm/glm.hpp"
 
 // ----------------------------------------------------
-// NVDBGrid: load and sample a NanoVDB density grid (in index-space)
+// NVDBFile: memory-mapped NanoVDB file, grids are used in place (loads instantly, pages are shared between processes)
+// on Windows the file is read into memory instead, since a mapped view would lock it against re-exports while loaded
+
+class NVDBFile {
+public:
+    NVDBFile(const std::filesystem::path& path);
+
+    const nanovdb::FloatGrid* find(const std::string& name) const;  // float grid by name, nullptr if not present
+    std::string density_grid() const;                               // name of the "density" grid, or of the first float fog volume
+    void prefetch() const;                                          // start paging in the whole file asynchronously (no-op if read into memory)
+
+    struct Entry {
+        std::string name;                   // grid name
+        nanovdb::GridType type;             // grid value type
+        const nanovdb::GridData* data;      // grid data (in the file contents, or in an aligned copy)
+    };
+
+    // data
+    std::filesystem::path path;             // file path
+    std::vector<Entry> grids;               // all grids of all segments, in file order
+
+private:
+    template <typename T> inline const T* at(size_t offset) const { return (const T*)(bytes + offset); }
+
+    struct alignas(NANOVDB_DATA_ALIGNMENT) Block { char bytes[NANOVDB_DATA_ALIGNMENT]; };
+#ifdef _WIN32
+    std::vector<Block> buffer;              // contents of the whole file
+#else
+    MappedFile file;                        // read-only mapping of the whole file
+#endif
+    const uint8_t* bytes;                   // file contents (buffer or mapping)
+    size_t num_bytes;                       // file size in bytes
+    std::vector<std::vector<Block>> aligned_copies; // grids stored at offsets without the alignment NanoVDB requires
+};
+
+// ----------------------------------------------------
+// NVDBGrid: sample a float grid of a NanoVDB file (in index-space)
 
 class NVDBGrid {
 public:
-    NVDBGrid(const std::filesystem::path& path, float density_scale = 1.f);
+    NVDBGrid(const std::shared_ptr<NVDBFile>& file, const std::string& name, float density_scale = 1.f);
+    NVDBGrid(NVDBGrid&&) = default;
+    NVDBGrid& operator=(NVDBGrid&&) = default;
     virtual ~NVDBGrid();
 
     float min_value() const;
@@ -21,11 +64,32 @@ public:
     float lookup_density_trilinear(const glm::vec3& ipos) const;    // input in index-space!
     float lookup_density_stochastic(const glm::vec3& ipos) const;   // input in index-space!
 
+    // cached read accessor: remembers the nodes of the last lookup, so coherent lookups skip the tree descent (use one per ray, not thread-safe)
+    using Accessor = nanovdb::DefaultReadAccessor<float>;
+    Accessor accessor() const;
+
+    // lookups through a cached accessor, the trilinear lookup gathers the 2x2x2 stencil from a single leaf visit if possible
+    float lookup_density(const Accessor& acc, const glm::ivec3& ipos) const;            // input in index-space!
+    float lookup_density_trilinear(const Accessor& acc, const glm::vec3& ipos) const;   // input in index-space!
+    float lookup_density_stochastic(const Accessor& acc, const glm::vec3& ipos) const;  // input in index-space!
+
+    // majorant grid: conservative maximum density per cell of leaf node size, for tracking with local majorants
+    static constexpr int MAJORANT_CELL = 8;                         // cell size in voxels (NanoVDB leaf node)
+    void build_majorants();
+    inline float majorant(const glm::ivec3& cell) const {           // input in majorant grid cells!
+        return density_scale * majorants[(size_t(cell.z) * majorant_res.y + cell.y) * majorant_res.x + cell.x];
+    }
+
     // data
-    std::vector<char> nvdb_data;    // raw nanovdb grid data
+    std::shared_ptr<NVDBFile> file; // file holding the grid data (shared by all grids of the file)
+    const nanovdb::FloatGrid* nvdb; // grid data (in place)
+    std::string name;               // grid name
     glm::vec3 ibb_min, ibb_max;     // index-space bounding box
     glm::mat4 transform;            // affine transform from index to world space
     float density_scale;            // linearly scale density
+    glm::ivec3 majorant_origin;     // index-space position of the majorant grid origin (in cells)
+    glm::ivec3 majorant_res;        // majorant grid resolution (in cells)
+    std::vector<float> majorants;   // unscaled maximum density per cell, dilated by one cell to bound trilinear lookups
 };
 
 // ----------------------------------------------------
@@ -33,20 +97,45 @@ public:
 
 class Volume {
 public:
+    // grids of one .nvdb file: the density grid and all other float grids (e.g. temperature, flames)
+    struct Frame {
+        NVDBGrid grid;                  // density grid (with majorant grid)
+        std::vector<NVDBGrid> grids;    // remaining float grids
+    };
+    static Frame load_frame(const std::filesystem::path& path, float density_scale = 1.f);
+
     Volume(const std::filesystem::path& path, float density_scale = 1.f);
+    Volume(Frame&& frame);
     virtual ~Volume();
 
-    // coordinate space helpers
-    glm::vec3 world_to_index(const glm::vec4& wpos) const;
-    glm::vec3 index_to_world(const glm::vec4& ipos) const;
+    // float grid by name (including the density grid), nullptr if not present
+    const NVDBGrid* find_grid(const std::string& name) const;
+
+    // frame sequence (one .nvdb file per frame, the volume holds the first one): the next frame is always prefetched in the background
+    void set_sequence(const std::vector<std::filesystem::path>& paths);
+    void set_frame(uint32_t index);     // swap in the grids of the given frame, call commit() afterwards (see Scene::DIRTY_VOLUME)
+    void retire_prefetch();             // move the pending prefetch to the stale loads (without waiting) and drop finished ones
+
+    // cache transforms and the world-space AABB, call after changing the model matrix or the grid (see Scene::DIRTY_VOLUME)
+    void commit();
+
+    // coordinate space helpers (via the cached transforms)
+    inline glm::vec3 world_to_index(const glm::vec4& wpos) const { return glm::vec3(world_to_index_mat * wpos); }
+    inline glm::vec3 index_to_world(const glm::vec4& ipos) const { return glm::vec3(index_to_world_mat * ipos); }
 
     // volume parameter helpers
     float albedo() const;
     float extinction_cross_section() const;
 
-    // AABB intersection helpers (in world-space)
-    std::tuple<glm::vec3, glm::vec3> compute_AABB() const;          // returns: <aabb_min, aabb_max>
+    // emission from the emission grid (piecewise constant per voxel, limited to leaf nodes as sampled by the VolumeLight)
+    const NVDBGrid* emission_grid() const;                          // returns: nullptr if not present
+    glm::vec3 Le(float value) const;                                // emitted radiance for a value of the emission grid
+    glm::vec3 Le(const glm::vec3& wpos) const;                      // emitted radiance at a world-space position
+
+    // AABB intersection helpers (the ray parameter t is the same in world- and index-space)
+    std::tuple<glm::vec3, glm::vec3> compute_AABB() const;          // returns: <aabb_min, aabb_max> (in world-space)
     std::tuple<bool, float, float> intersect(const Ray& ray) const; // returns: <is_hit, near, far>
+    std::tuple<bool, float, float> intersect_index(const glm::vec3& ipos, const glm::vec3& idir, float tnear, float tfar) const; // input in index-space!
 
     // volume query functions (switches between raymarching and tracking based on unbiased_estimators flag)
     float transmittance(const Ray& ray) const;                      // returns: transmittance in [0, 1]
@@ -58,15 +147,41 @@ public:
     std::tuple<bool, float> sample_raymarching(const Ray& ray) const;
     std::tuple<bool, float> sample_delta_tracking(const Ray& ray) const;
 
+    // traverse the majorant grid via 3D DDA (index-space ray, t in world-space), calls segment(t0, t1, majorant) until it returns false
+    template <typename F> void traverse_majorants(const glm::vec3& ipos, const glm::vec3& idir, float near, float far, F&& segment) const;
+
     json11::Json to_json() const;
     void from_json(const json11::Json& cfg);
 
     // data
     NVDBGrid grid;                      // Sparse voxel grid containing density values (in 1/m^3)
+    std::vector<NVDBGrid> grids;        // All other float grids of the file (e.g. temperature, flames)
     glm::mat4 model;                    // Volume model matrix
     float absorption_cross_section;     // Isotropic cross-sectional area of absorbing particles (in m^2)
     float scattering_cross_section;     // Isotropic cross-sectional area of scattering particles (in m^2)
     float phase_g;                      // Henyey-Greenstein phase function anisotropy parameter
     bool unbiased_estimators;           // Use unbiased (delta/ratio tracking) or biased (raymarching) estimators
     float raymarch_dt;                  // Raymarching step size in m
+    bool majorant_grid;                 // Use local majorants from the majorant grid for tracking (or the global maximum density)
+    bool raymarch_coherent;             // Reuse one cached accessor along each raymarching ray (or a new accessor per lookup)
+    std::string emission_grid_name;     // Name of the emission grid (empty for none, defaults to "temperature", "flames" or "emission" if present)
+    bool blackbody;                     // Interpret the emission grid as temperature and convert via blackbody radiation (or scale emission_color)
+    glm::vec3 emission_color;           // Emitted radiance per unit of the emission grid (if not blackbody)
+    float emission_scale;               // Linearly scale emitted radiance
+    float temperature_scale;            // Temperature in K = temperature_scale * value + temperature_offset (if blackbody)
+    float temperature_offset;
+    glm::mat4 world_to_index_mat;       // Cached inverse(model * grid.transform)
+    glm::mat4 index_to_world_mat;       // Cached model * grid.transform
+    glm::vec3 bb_min, bb_max;           // Cached world-space AABB
+    glm::mat4 emission_world_to_index_mat; // Cached inverse(model * emission grid transform)
+    glm::mat4 emission_index_to_world_mat; // Cached model * emission grid transform
+    std::vector<std::filesystem::path> frames; // Frame sequence, empty for a single file
+    uint32_t current_frame;             // Index of the current frame in the sequence
+    std::future<Frame> next;            // Background load of the next frame
+    uint32_t next_frame;                // Index of the frame loaded in the background
+    std::vector<std::future<Frame>> stale; // Outdated background loads, dropped once finished so frame changes never wait on them
+    inline static thread_local uint64_t density_lookups = 0; // Density lookups of the estimators on this thread (statistics)
 };
+
+// measure density lookups and time per ray of the estimators (global vs. local majorants, per lookup vs. per ray accessors)
+void perform_volume_benchmarks(Volume& volume, uint32_t num_rays = 100000);